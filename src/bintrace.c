@@ -0,0 +1,537 @@
+/*
+ * Recording of traces in the binary format and replaying them.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * When recording, syscalls are decoded as usual but the text output
+ * is suppressed; instead, the registers of each event are recorded
+ * along with every piece of the tracee memory and every descriptor path
+ * that has been fetched by the decoders.  When replaying, the events
+ * are fed to the same decoders, and the fetches are served from
+ * the recorded data, so the output is the same as it would have been
+ * if the tracees had been traced with the same options.
+ */
+
+#include "defs.h"
+#include "bintrace.h"
+
+/* Records larger than this are considered corrupted.  */
+#define BINTRACE_MAX_RECORD_SIZE	(1U << 30)
+#define BINTRACE_RECORD_ALIGN		8
+
+bool bintrace_recording;
+bool bintrace_replaying;
+
+static FILE *bintrace_file;
+
+static void
+fill_header(struct bintrace_header *h)
+{
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, BINTRACE_MAGIC, sizeof(h->magic));
+	h->version = BINTRACE_VERSION;
+	h->byte_order = 0x01020304;
+	h->kernel_ulong_size = sizeof(kernel_ulong_t);
+	h->personalities = SUPPORTED_PERSONALITIES;
+	for (unsigned int i = 0; i < SUPPORTED_PERSONALITIES; ++i)
+		h->nsyscalls[i] = nsyscall_vec[i];
+}
+
+/*
+ * Recording.
+ *
+ * The records of the current event and of its data are kept in memory
+ * until the next event, as it is not known in advance whether the event
+ * is going to be filtered out.
+ */
+
+static char *rec_buf;
+static size_t rec_buf_size;
+static size_t rec_buf_len;
+static bool write_failed;
+
+static void
+write_data(const void *data, const size_t size)
+{
+	if (!write_failed && size && fwrite(data, size, 1, bintrace_file) != 1) {
+		perror_msg("binary trace output");
+		write_failed = true;
+	}
+}
+
+static void
+flush_records(void)
+{
+	write_data(rec_buf, rec_buf_len);
+	rec_buf_len = 0;
+}
+
+static void *
+alloc_record(const enum bintrace_record_type type, const pid_t pid,
+	     size_t size)
+{
+	size = ROUNDUP(size, BINTRACE_RECORD_ALIGN);
+
+	while (rec_buf_size - rec_buf_len < size)
+		rec_buf = xgrowarray(rec_buf, &rec_buf_size, 1);
+
+	struct bintrace_record *rec = (void *) (rec_buf + rec_buf_len);
+
+	memset(rec, 0, size);
+	rec->type = type;
+	rec->size = size;
+	rec->pid = pid;
+	rec_buf_len += size;
+
+	return rec;
+}
+
+static void *
+alloc_event(const enum bintrace_record_type type, const pid_t pid,
+	    const size_t size)
+{
+	flush_records();
+
+	struct bintrace_event *ev = alloc_record(type, pid, size);
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ev->realtime_sec = ts.tv_sec;
+	ev->realtime_nsec = ts.tv_nsec;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ev->monotonic_sec = ts.tv_sec;
+	ev->monotonic_nsec = ts.tv_nsec;
+
+	return ev;
+}
+
+void
+bintrace_start_recording(FILE *fp)
+{
+	struct bintrace_header h;
+
+	bintrace_file = fp;
+	fill_header(&h);
+	write_data(&h, sizeof(h));
+}
+
+void
+bintrace_finish_recording(void)
+{
+	flush_records();
+	if (fflush(bintrace_file) && !write_failed)
+		perror_msg("binary trace output");
+	if (bintrace_file != stderr)
+		fclose(bintrace_file);
+	bintrace_file = NULL;
+}
+
+void
+bintrace_cancel_event(void)
+{
+	rec_buf_len = 0;
+}
+
+void
+bintrace_record_syscall_entering(struct tcb *tcp, const int res)
+{
+	struct bintrace_syscall_entering *e =
+		alloc_event(BINTRACE_SYSCALL_ENTERING, tcp->pid, sizeof(*e));
+
+	e->res = res;
+	e->personality = tcp->currpers;
+	e->scno = tcp->scno;
+	e->true_scno = tcp->true_scno;
+	for (unsigned int i = 0; i < MAX_ARGS; ++i)
+		e->args[i] = tcp->u_arg[i];
+}
+
+void
+bintrace_record_syscall_exiting(struct tcb *tcp, const int res)
+{
+	struct bintrace_syscall_exiting *e =
+		alloc_event(BINTRACE_SYSCALL_EXITING, tcp->pid, sizeof(*e));
+
+	e->res = res;
+	e->error = tcp->u_error;
+	e->rval = tcp->u_rval;
+}
+
+void
+bintrace_record_signal(struct tcb *tcp, const siginfo_t *si,
+		       const unsigned int sig)
+{
+	struct bintrace_signal *s =
+		alloc_event(si ? BINTRACE_SIGNAL : BINTRACE_GROUP_STOP,
+			    tcp->pid, sizeof(*s));
+
+	s->sig = sig;
+	if (si)
+		s->si = *si;
+}
+
+void
+bintrace_record_status(struct tcb *tcp, const enum bintrace_record_type type,
+		       const int status)
+{
+	struct bintrace_status *s = alloc_event(type, tcp->pid, sizeof(*s));
+
+	s->status = status;
+}
+
+/* The number of data bytes recorded for the result of umoven or umovestr.  */
+static unsigned int
+mem_data_len(const enum bintrace_record_type type, const unsigned int len,
+	     const int rc)
+{
+	if (rc < 0)
+		return 0;
+	if (type == BINTRACE_STR && rc > 0)
+		return rc;
+	return len;
+}
+
+void
+bintrace_record_mem(struct tcb *tcp, const enum bintrace_record_type type,
+		    const kernel_ulong_t addr, const unsigned int len,
+		    const void *data, const int rc)
+{
+	/* Data fetched outside of a recorded event is of no use.  */
+	if (!rec_buf_len)
+		return;
+
+	const unsigned int data_len = mem_data_len(type, len, rc);
+	struct bintrace_mem *m =
+		alloc_record(type, tcp->pid, sizeof(*m) + data_len);
+
+	m->addr = addr;
+	m->len = len;
+	m->rc = rc;
+	memcpy(m->data, data, data_len);
+}
+
+void
+bintrace_record_fd_path(const pid_t pid, const int fd, const char *path,
+			const int rc, const bool deleted)
+{
+	if (!rec_buf_len)
+		return;
+
+	const size_t path_len = rc >= 0 ? strlen(path) + 1 : 0;
+	struct bintrace_fd_path *p =
+		alloc_record(BINTRACE_FD_PATH, pid, sizeof(*p) + path_len);
+
+	p->fd = fd;
+	p->rc = rc;
+	p->deleted = deleted;
+	memcpy(p->path, path, path_len);
+}
+
+/*
+ * Replaying.
+ */
+
+struct record_buf {
+	struct bintrace_record *rec;
+	size_t size;
+};
+
+static const char *replay_fname;
+static struct record_buf event_rec;
+static struct record_buf next_rec;	/* the record read ahead */
+static bool next_rec_valid;
+static struct record_buf *data_recs;	/* the data of the current event */
+static size_t data_recs_size;
+static size_t data_recs_count;
+static struct timespec event_realtime;
+static struct timespec event_monotonic;
+static uint64_t replay_misses;
+
+static void ATTRIBUTE_NORETURN
+replay_corrupted(const char *what)
+{
+	error_msg_and_die("%s: %s", replay_fname, what);
+}
+
+void
+bintrace_start_replay(const char *fname)
+{
+	struct bintrace_header h, expected;
+
+	replay_fname = fname;
+	bintrace_file = fopen(fname, "r");
+	if (!bintrace_file)
+		perror_msg_and_die("%s", fname);
+
+	if (fread(&h, sizeof(h), 1, bintrace_file) != 1 ||
+	    memcmp(h.magic, BINTRACE_MAGIC, sizeof(h.magic)))
+		replay_corrupted("not a binary trace");
+
+	fill_header(&expected);
+	if (h.version != expected.version)
+		error_msg_and_die("%s: unsupported binary trace version %u",
+				  fname, h.version);
+	if (memcmp(&h, &expected, sizeof(h)))
+		error_msg_and_die("%s: the binary trace has been recorded"
+				  " by strace built for a different"
+				  " architecture", fname);
+}
+
+static bool
+read_record(struct record_buf *buf)
+{
+	struct bintrace_record rec;
+	size_t n = fread(&rec, 1, sizeof(rec), bintrace_file);
+
+	if (n == 0 && feof(bintrace_file))
+		return false;
+	if (n != sizeof(rec))
+		goto truncated;
+
+	if (rec.size < sizeof(rec) || rec.size > BINTRACE_MAX_RECORD_SIZE ||
+	    rec.size % BINTRACE_RECORD_ALIGN)
+		replay_corrupted("invalid record size");
+
+	while (buf->size < rec.size)
+		buf->rec = xgrowarray(buf->rec, &buf->size, 1);
+
+	*buf->rec = rec;
+	if (rec.size == sizeof(rec) ||
+	    fread(buf->rec + 1, rec.size - sizeof(rec), 1, bintrace_file) == 1)
+		return true;
+
+truncated:
+	if (ferror(bintrace_file))
+		perror_msg_and_die("%s", replay_fname);
+	/* The tracer has been killed in the middle of writing a record.  */
+	error_msg("%s: truncated record at the end of the binary trace",
+		  replay_fname);
+	return false;
+}
+
+static size_t
+min_record_size(const uint32_t type)
+{
+	switch (type) {
+	case BINTRACE_SYSCALL_ENTERING:
+		return sizeof(struct bintrace_syscall_entering);
+	case BINTRACE_SYSCALL_EXITING:
+		return sizeof(struct bintrace_syscall_exiting);
+	case BINTRACE_SIGNAL:
+	case BINTRACE_GROUP_STOP:
+		return sizeof(struct bintrace_signal);
+	case BINTRACE_STOP_BEFORE_EXIT:
+	case BINTRACE_EXITED:
+	case BINTRACE_SIGNALLED:
+		return sizeof(struct bintrace_status);
+	case BINTRACE_MEM:
+	case BINTRACE_STR:
+		return sizeof(struct bintrace_mem);
+	case BINTRACE_FD_PATH:
+		return sizeof(struct bintrace_fd_path);
+	}
+	replay_corrupted("unknown record type");
+}
+
+static bool
+is_data_record(const struct bintrace_record *rec)
+{
+	return rec->type >= BINTRACE_MEM;
+}
+
+static void
+check_data_record(const struct bintrace_record *rec)
+{
+	size_t data_len;
+
+	if (rec->size < min_record_size(rec->type))
+		replay_corrupted("invalid data record");
+
+	if (rec->type == BINTRACE_FD_PATH) {
+		const struct bintrace_fd_path *p = (const void *) rec;
+
+		data_len = p->rc >= 0
+			   ? strnlen(p->path, rec->size - sizeof(*p)) + 1 : 0;
+	} else {
+		const struct bintrace_mem *m = (const void *) rec;
+
+		data_len = mem_data_len(rec->type, m->len, m->rc);
+	}
+
+	if (rec->size - min_record_size(rec->type) < data_len)
+		replay_corrupted("invalid data record");
+}
+
+static void
+swap_record_bufs(struct record_buf *a, struct record_buf *b)
+{
+	const struct record_buf t = *a;
+
+	*a = *b;
+	*b = t;
+}
+
+const struct bintrace_record *
+bintrace_next_event(void)
+{
+	data_recs_count = 0;
+
+	if (!next_rec_valid && !read_record(&next_rec))
+		return NULL;
+	next_rec_valid = false;
+	swap_record_bufs(&event_rec, &next_rec);
+
+	const struct bintrace_record *rec = event_rec.rec;
+
+	if (rec->size < min_record_size(rec->type) || is_data_record(rec) ||
+	    (rec->type == BINTRACE_SYSCALL_ENTERING &&
+	     ((const struct bintrace_syscall_entering *) rec)->personality
+	     >= SUPPORTED_PERSONALITIES))
+		replay_corrupted("invalid event record");
+
+	while (read_record(&next_rec)) {
+		if (!is_data_record(next_rec.rec)) {
+			next_rec_valid = true;
+			break;
+		}
+		check_data_record(next_rec.rec);
+
+		if (data_recs_count == data_recs_size) {
+			const size_t old_size = data_recs_size;
+
+			data_recs = xgrowarray(data_recs, &data_recs_size,
+					       sizeof(*data_recs));
+			memset(data_recs + old_size, 0,
+			       (data_recs_size - old_size) * sizeof(*data_recs));
+		}
+		swap_record_bufs(&data_recs[data_recs_count++], &next_rec);
+	}
+
+	const struct bintrace_event *ev = (const void *) rec;
+
+	event_realtime.tv_sec = ev->realtime_sec;
+	event_realtime.tv_nsec = ev->realtime_nsec;
+	event_monotonic.tv_sec = ev->monotonic_sec;
+	event_monotonic.tv_nsec = ev->monotonic_nsec;
+
+	return rec;
+}
+
+void
+bintrace_finish_replay(void)
+{
+	if (replay_misses)
+		error_msg("%" PRIu64 " lookups of the tracee data were not found"
+			  " in %s, the options of the replay might differ"
+			  " from those of the recording",
+			  replay_misses, replay_fname);
+	fclose(bintrace_file);
+	bintrace_file = NULL;
+}
+
+static const struct bintrace_mem *
+next_mem(size_t *const i, const enum bintrace_record_type type,
+	 const pid_t pid, const kernel_ulong_t addr)
+{
+	for (; *i < data_recs_count; ++*i) {
+		const struct bintrace_mem *m = (const void *) data_recs[*i].rec;
+
+		if (m->rec.type == type && m->rec.pid == pid && m->addr == addr)
+			return m;
+	}
+
+	return NULL;
+}
+
+int
+bintrace_replay_umoven(struct tcb *tcp, const kernel_ulong_t addr,
+		       const unsigned int len, void *const laddr)
+{
+	const struct bintrace_mem *m;
+
+	for (size_t i = 0; (m = next_mem(&i, BINTRACE_MEM, tcp->pid, addr));
+	     ++i) {
+		if (m->rc == 0 && m->len >= len) {
+			memcpy(laddr, m->data, len);
+			return 0;
+		}
+		if (m->rc < 0 && m->len <= len)
+			return -1;
+	}
+
+	replay_misses++;
+	return -1;
+}
+
+int
+bintrace_replay_umovestr(struct tcb *tcp, const kernel_ulong_t addr,
+			 const unsigned int len, char *const laddr)
+{
+	const struct bintrace_mem *m;
+
+	for (size_t i = 0; (m = next_mem(&i, BINTRACE_STR, tcp->pid, addr));
+	     ++i) {
+		if (m->rc > 0) {
+			/* The string has been fetched with its NUL.  */
+			const unsigned int n = MIN((unsigned int) m->rc, len);
+
+			memcpy(laddr, m->data, n);
+			return (unsigned int) m->rc <= len ? m->rc : 0;
+		}
+		if (m->rc == 0 && m->len >= len) {
+			memcpy(laddr, m->data, len);
+			return 0;
+		}
+		if (m->rc < 0 && m->len <= len)
+			return -1;
+	}
+
+	replay_misses++;
+	return -1;
+}
+
+int
+bintrace_replay_fd_path(const pid_t pid, const int fd, char *const buf,
+			const unsigned bufsize, bool *const deleted)
+{
+	for (size_t i = 0; i < data_recs_count; ++i) {
+		const struct bintrace_fd_path *p =
+			(const void *) data_recs[i].rec;
+
+		if (p->rec.type != BINTRACE_FD_PATH || p->rec.pid != pid ||
+		    p->fd != fd)
+			continue;
+
+		if (p->rc < 0 || !bufsize)
+			return -1;
+
+		const size_t len = strlen(p->path);
+		const size_t n = MIN(len, bufsize - 1);
+
+		memcpy(buf, p->path, n);
+		buf[n] = '\0';
+		if (deleted)
+			*deleted = p->deleted;
+		/* Truncate the path the same way readlink does.  */
+		return n < len ? (int) n : p->rc;
+	}
+
+	replay_misses++;
+	return -1;
+}
+
+void
+get_trace_time(const clockid_t clk, struct timespec *const ts)
+{
+	if (!bintrace_replaying) {
+		clock_gettime(clk, ts);
+		return;
+	}
+
+	*ts = clk == CLOCK_REALTIME ? event_realtime : event_monotonic;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef STRACE_BINTRACE_H
+# define STRACE_BINTRACE_H
+
+# include <signal.h>
+# include "defs.h"
+
+/*
+ * The binary trace is a header followed by a stream of records
+ * in the native byte order of the tracer.  Every record of an event
+ * is followed by the records of the data that has been fetched
+ * while the event was being decoded.
+ */
+
+# define BINTRACE_MAGIC		"STRACEBT"
+# define BINTRACE_VERSION	1
+
+struct bintrace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;		/* 0x01020304 */
+	uint32_t kernel_ulong_size;
+	uint32_t personalities;
+	uint32_t nsyscalls[3];
+};
+
+enum bintrace_record_type {
+	/* events */
+	BINTRACE_SYSCALL_ENTERING = 1,
+	BINTRACE_SYSCALL_EXITING,
+	BINTRACE_SIGNAL,
+	BINTRACE_GROUP_STOP,
+	BINTRACE_STOP_BEFORE_EXIT,
+	BINTRACE_EXITED,
+	BINTRACE_SIGNALLED,
+
+	/* data fetched while decoding the preceding event */
+	BINTRACE_MEM = 0x100,
+	BINTRACE_STR,
+	BINTRACE_FD_PATH,
+};
+
+struct bintrace_record {
+	uint32_t type;
+	uint32_t size;			/* of the whole record */
+	int32_t pid;
+	uint32_t reserved;
+};
+
+struct bintrace_event {
+	struct bintrace_record rec;
+	int64_t realtime_sec;
+	int64_t realtime_nsec;
+	int64_t monotonic_sec;
+	int64_t monotonic_nsec;
+};
+
+struct bintrace_syscall_entering {
+	struct bintrace_event ev;
+	int32_t res;			/* of syscall_entering_decode */
+	uint32_t personality;
+	uint64_t scno;
+	uint64_t true_scno;
+	uint64_t args[MAX_ARGS];
+};
+
+struct bintrace_syscall_exiting {
+	struct bintrace_event ev;
+	int32_t res;			/* of syscall_exiting_decode */
+	int32_t error;
+	int64_t rval;
+};
+
+/* BINTRACE_SIGNAL and BINTRACE_GROUP_STOP */
+struct bintrace_signal {
+	struct bintrace_event ev;
+	uint32_t sig;
+	uint32_t reserved;
+	siginfo_t si;			/* BINTRACE_SIGNAL only */
+};
+
+/* BINTRACE_STOP_BEFORE_EXIT, BINTRACE_EXITED, and BINTRACE_SIGNALLED */
+struct bintrace_status {
+	struct bintrace_event ev;
+	int32_t status;
+	uint32_t reserved;
+};
+
+/* BINTRACE_MEM and BINTRACE_STR */
+struct bintrace_mem {
+	struct bintrace_record rec;
+	uint64_t addr;
+	uint32_t len;
+	int32_t rc;			/* of umoven or umovestr */
+	unsigned char data[];
+};
+
+struct bintrace_fd_path {
+	struct bintrace_record rec;
+	int32_t fd;
+	int32_t rc;			/* of getfdpath_pid */
+	uint32_t deleted;
+	uint32_t reserved;
+	char path[];
+};
+
+extern bool bintrace_recording;
+extern bool bintrace_replaying;
+
+/* Recording, see --format=binary.  */
+extern void bintrace_start_recording(FILE *);
+extern void bintrace_finish_recording(void);
+extern void bintrace_record_syscall_entering(struct tcb *, int res);
+extern void bintrace_record_syscall_exiting(struct tcb *, int res);
+/* Drop the record of the current event and of its data.  */
+extern void bintrace_cancel_event(void);
+extern void bintrace_record_signal(struct tcb *, const siginfo_t *,
+				   unsigned int sig);
+extern void bintrace_record_status(struct tcb *, enum bintrace_record_type,
+				   int status);
+extern void bintrace_record_mem(struct tcb *, enum bintrace_record_type,
+				kernel_ulong_t addr, unsigned int len,
+				const void *data, int rc);
+extern void bintrace_record_fd_path(pid_t, int fd, const char *path, int rc,
+				    bool deleted);
+
+/* Replaying, see --replay.  */
+extern void bintrace_start_replay(const char *fname);
+/* Returns the next event with its data loaded, or NULL at the end.  */
+extern const struct bintrace_record *bintrace_next_event(void);
+extern void bintrace_finish_replay(void);
+extern int bintrace_replay_umoven(struct tcb *, kernel_ulong_t addr,
+				  unsigned int len, void *laddr);
+extern int bintrace_replay_umovestr(struct tcb *, kernel_ulong_t addr,
+				    unsigned int len, char *laddr);
+extern int bintrace_replay_fd_path(pid_t, int fd, char *buf, unsigned bufsize,
+				   bool *deleted);
+
+/*
+ * Like clock_gettime, but returns the time of the current event
+ * when replaying.
+ */
+extern void get_trace_time(clockid_t, struct timespec *);
+
+#endif /* !STRACE_BINTRACE_H */
@@ -17,6 +17,30 @@
 #include "defs.h"
 
 #include <stdarg.h>
+#include "trie.h"
+
+/*
+ * Log-linear latency histogram: durations in nanoseconds below
+ * 2^HIST_SUB_BITS have buckets of their own, every further power of two
+ * is split into 2^HIST_SUB_BITS buckets, so the relative error of a value
+ * taken from a bucket is below 2^-HIST_SUB_BITS.  Durations that do not
+ * fit into HIST_MAX_BITS bits (about 18 minutes) share the last bucket.
+ */
+#define HIST_SUB_BITS	5
+#define HIST_MAX_BITS	40
+#define HIST_SUB_COUNT	(1U << HIST_SUB_BITS)
+#define HIST_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+enum hist_percentiles {
+	HP_50,
+	HP_90,
+	HP_99,
+	HP_999,
+
+	HP_COUNT
+};
+
+static const unsigned int hist_permille[HP_COUNT] = { 500, 900, 990, 999 };
 
 /* Per-syscall stats structure */
 struct call_counts {
@@ -25,6 +49,12 @@ struct call_counts {
 	struct timespec time_min;
 	struct timespec time_max;
 	struct timespec time_avg;
+	struct timespec time_stddev;
+	struct timespec time_pct[HP_COUNT];
+	/* sum of squared durations in seconds, for the standard deviation */
+	double time_sq_sum;
+	/* HIST_BUCKETS counters, allocated on the first call */
+	uint64_t *hist;
 	uint64_t calls, errors;
 };
 
@@ -38,6 +68,68 @@ static const struct timespec max_ts = {
 
 static struct timespec overhead;
 
+/* Whether latency histograms are needed for percentiles.  */
+static bool hist_enabled;
+/* Whether latency histograms are printed after the summary table.  */
+static bool hist_print;
+
+/* The totals of the previous intervals, see call_summary_interval.  */
+static struct call_counts *total_countv[SUPPORTED_PERSONALITIES];
+static unsigned int intervals;
+
+/*
+ * Per-task stats for --summary-by: the totals and the counts of each
+ * syscall called by the task, kept in a small open addressing table
+ * keyed by syscall number and personality, as a task usually calls
+ * only a few of the syscalls.  The table of a process or a thread
+ * is folded into its totals and the syscall that took the most time
+ * when its last tcb is dropped, so the memory taken by the tasks
+ * that are gone does not depend on the number of syscalls.  As the
+ * counts of a folded task do not change, the folded tasks that cannot
+ * make it into the top summary_top tasks are freed from time to time,
+ * leaving only their sums in dropped_tasks.
+ */
+struct task_sc_counts {
+	/* scno * SUPPORTED_PERSONALITIES + personality + 1, 0 if unused */
+	unsigned int key;
+	struct timespec time;
+	uint64_t calls, errors;
+};
+
+struct count_task {
+	/* tgid or tid, 0 for comm */
+	int id;
+	/* the number of tcbs counted in this task */
+	unsigned int users;
+	char comm[PROC_COMM_LEN];
+	struct timespec time;
+	uint64_t calls, errors;
+	/* sc_size entries, NULL once folded */
+	struct task_sc_counts *sc;
+	unsigned int sc_size;
+	unsigned int sc_used;
+	/* the syscall that took the most time, set when folded */
+	unsigned int top_key;
+};
+
+#define TASK_SC_MIN_SIZE	16
+
+static enum count_summary_by summary_by;
+static unsigned int summary_top = 10;
+static struct count_task **tasks;
+static size_t tasks_count;
+static size_t tasks_size;
+/* the number of folded tasks in tasks */
+static size_t folded_tasks;
+/* the sums of the folded tasks that have been freed */
+static struct {
+	size_t count;
+	struct timespec time;
+	uint64_t calls, errors;
+} dropped_tasks;
+/* tgid or tid -> the task of live tcbs */
+static struct trie *task_by_id;
+
 
 enum count_summary_columns {
 	CSC_NONE,
@@ -46,6 +138,11 @@ enum count_summary_columns {
 	CSC_TIME_MIN,
 	CSC_TIME_MAX,
 	CSC_TIME_AVG,
+	CSC_TIME_P50,
+	CSC_TIME_P90,
+	CSC_TIME_P99,
+	CSC_TIME_P999,
+	CSC_TIME_STDDEV,
 	CSC_CALLS,
 	CSC_ERRORS,
 	CSC_SC_NAME,
@@ -87,6 +184,22 @@ static const struct {
 	{ "avg-time",     CSC_TIME_AVG   },
 	{ "time_avg",     CSC_TIME_AVG   },
 	{ "time-avg",     CSC_TIME_AVG   },
+	{ "p50",          CSC_TIME_P50   },
+	{ "median",       CSC_TIME_P50   },
+	{ "time_p50",     CSC_TIME_P50   },
+	{ "time-p50",     CSC_TIME_P50   },
+	{ "p90",          CSC_TIME_P90   },
+	{ "time_p90",     CSC_TIME_P90   },
+	{ "time-p90",     CSC_TIME_P90   },
+	{ "p99",          CSC_TIME_P99   },
+	{ "time_p99",     CSC_TIME_P99   },
+	{ "time-p99",     CSC_TIME_P99   },
+	{ "p999",         CSC_TIME_P999  },
+	{ "time_p999",    CSC_TIME_P999  },
+	{ "time-p999",    CSC_TIME_P999  },
+	{ "stddev",       CSC_TIME_STDDEV },
+	{ "time_stddev",  CSC_TIME_STDDEV },
+	{ "time-stddev",  CSC_TIME_STDDEV },
 	{ "calls",        CSC_CALLS      },
 	{ "count",        CSC_CALLS      },
 	{ "error",        CSC_ERRORS     },
@@ -99,6 +212,350 @@ static const struct {
 	{ "nothing",      CSC_NONE       },
 };
 
+static bool
+is_hist_column(uint8_t column)
+{
+	return column >= CSC_TIME_P50 && column <= CSC_TIME_P999;
+}
+
+static unsigned int
+hist_bucket(uint64_t ns)
+{
+	if (ns < HIST_SUB_COUNT)
+		return ns;
+
+	unsigned int msb = 63 - __builtin_clzll(ns);
+	if (msb >= HIST_MAX_BITS)
+		return HIST_BUCKETS - 1;
+
+	unsigned int shift = msb - HIST_SUB_BITS;
+
+	return (shift + 1) * HIST_SUB_COUNT
+	       + (unsigned int) (ns >> shift) - HIST_SUB_COUNT;
+}
+
+/* Returns the smallest duration that falls into the bucket.  */
+static uint64_t
+hist_bucket_start(unsigned int bucket)
+{
+	if (bucket < 2 * HIST_SUB_COUNT)
+		return bucket;
+
+	unsigned int shift = bucket / HIST_SUB_COUNT - 1;
+
+	return (uint64_t) (HIST_SUB_COUNT + bucket % HIST_SUB_COUNT) << shift;
+}
+
+static void
+ns_to_ts(struct timespec *ts, uint64_t ns)
+{
+	ts->tv_sec = ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+}
+
+/*
+ * Returns the duration the given share of the calls do not exceed,
+ * that is the middle of the bucket it falls into, clamped to the minimum
+ * and the maximum durations actually observed.
+ */
+static void
+hist_percentile(struct timespec *ts, const uint64_t *hist, uint64_t calls,
+		unsigned int permille,
+		const struct timespec *min, const struct timespec *max)
+{
+	uint64_t rank = (calls * permille + 999) / 1000;
+	uint64_t seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < HIST_BUCKETS - 1; ++i) {
+		seen += hist[i];
+		if (seen >= rank)
+			break;
+	}
+
+	uint64_t start = hist_bucket_start(i);
+	uint64_t end = hist_bucket_start(i + 1);
+	ns_to_ts(ts, start + (end - start) / 2);
+	*ts = *ts_max(ts_min(ts, max), min);
+}
+
+/* Newton's method, to avoid linking with libm.  */
+static double
+sqrt_nonneg(double x)
+{
+	if (!(x > 0))
+		return 0;
+
+	double r = x > 1 ? x : 1;
+	for (unsigned int i = 0; i < 64; ++i) {
+		double next = (r + x / r) / 2;
+		if (next >= r)
+			break;
+		r = next;
+	}
+
+	return r;
+}
+
+static void
+stddev_ts(struct timespec *ts, double sum, double sq_sum, uint64_t calls)
+{
+	double mean = sum / calls;
+	double sd = sqrt_nonneg(sq_sum / calls - mean * mean);
+
+	ts->tv_sec = (time_t) sd;
+	ts->tv_nsec = (long) ((sd - ts->tv_sec) * 1e9);
+}
+
+static struct task_sc_counts *
+task_sc_lookup(struct task_sc_counts *sc, unsigned int size, unsigned int key)
+{
+	for (unsigned int i = key & (size - 1);; i = (i + 1) & (size - 1)) {
+		if (sc[i].key == key || !sc[i].key)
+			return &sc[i];
+	}
+}
+
+static struct task_sc_counts *
+task_sc_get(struct count_task *task, unsigned int key)
+{
+	if (!task->sc) {
+		task->sc_size = TASK_SC_MIN_SIZE;
+		task->sc = xcalloc(task->sc_size, sizeof(*task->sc));
+	}
+
+	struct task_sc_counts *sc = task_sc_lookup(task->sc, task->sc_size,
+						   key);
+	if (sc->key)
+		return sc;
+
+	/* Keep the table at most half full.  */
+	if (2 * (task->sc_used + 1) > task->sc_size) {
+		const unsigned int new_size = task->sc_size * 2;
+		struct task_sc_counts *new_sc = xcalloc(new_size,
+							sizeof(*new_sc));
+
+		for (unsigned int i = 0; i < task->sc_size; ++i) {
+			if (task->sc[i].key)
+				*task_sc_lookup(new_sc, new_size,
+						task->sc[i].key) = task->sc[i];
+		}
+
+		free(task->sc);
+		task->sc = new_sc;
+		task->sc_size = new_size;
+		sc = task_sc_lookup(new_sc, new_size, key);
+	}
+
+	sc->key = key;
+	task->sc_used++;
+
+	return sc;
+}
+
+static unsigned int
+task_top_key(const struct count_task *task)
+{
+	const struct task_sc_counts *top = NULL;
+
+	if (!task->sc)
+		return task->top_key;
+
+	for (unsigned int i = 0; i < task->sc_size; ++i) {
+		const struct task_sc_counts *sc = &task->sc[i];
+
+		if (sc->key && (!top || ts_cmp(&sc->time, &top->time) > 0
+				|| (!ts_cmp(&sc->time, &top->time)
+				    && sc->calls > top->calls)))
+			top = sc;
+	}
+
+	return top ? top->key : 0;
+}
+
+static int
+task_time_cmp(const void *a, const void *b)
+{
+	const struct count_task *ta = *(const struct count_task *const *) a;
+	const struct count_task *tb = *(const struct count_task *const *) b;
+	int rc = ts_cmp(&tb->time, &ta->time);
+
+	if (rc)
+		return rc;
+
+	return (ta->calls < tb->calls) ? 1 : (ta->calls > tb->calls) ? -1 : 0;
+}
+
+/*
+ * Frees the folded tasks that are behind summary_top other folded
+ * tasks in the ranking: they can only fall further behind.
+ */
+static void
+drop_folded_tasks(void)
+{
+	size_t live = 0;
+
+	/* Move the folded tasks to the end of tasks.  */
+	for (size_t i = 0; i < tasks_count; ++i) {
+		if (tasks[i]->users) {
+			struct count_task *task = tasks[live];
+
+			tasks[live++] = tasks[i];
+			tasks[i] = task;
+		}
+	}
+
+	qsort(tasks + live, folded_tasks, sizeof(*tasks), task_time_cmp);
+
+	for (size_t i = live + summary_top; i < tasks_count; ++i) {
+		struct count_task *task = tasks[i];
+
+		dropped_tasks.count++;
+		ts_add(&dropped_tasks.time, &dropped_tasks.time, &task->time);
+		dropped_tasks.calls += task->calls;
+		dropped_tasks.errors += task->errors;
+		free(task);
+	}
+
+	tasks_count = live + summary_top;
+	folded_tasks = summary_top;
+}
+
+static int
+get_task_id(const struct tcb *tcp)
+{
+	switch (summary_by) {
+	case COUNT_BY_PROCESS: {
+		int tgid;
+
+		if (proc_status_get_id_list(get_proc_pid(tcp->pid), &tgid, 1,
+					    "Tgid:", 0) && tgid > 0)
+			return tgid;
+		return tcp->pid;
+	}
+	case COUNT_BY_THREAD:
+		return tcp->pid;
+	default:
+		return 0;
+	}
+}
+
+static struct count_task *
+find_comm_task(const char *comm)
+{
+	for (size_t i = 0; i < tasks_count; ++i) {
+		if (!strcmp(tasks[i]->comm, comm))
+			return tasks[i];
+	}
+
+	return NULL;
+}
+
+static struct count_task *
+attach_count_task(struct tcb *tcp)
+{
+	const int id = get_task_id(tcp);
+	struct count_task *task;
+
+	if (summary_by == COUNT_BY_COMM) {
+		task = find_comm_task(get_tcb_cold(tcp)->comm);
+	} else {
+		if (!task_by_id) {
+			task_by_id = trie_create(32, sizeof(void *) == 8 ? 6 : 5,
+						 4, 4, 0);
+			if (!task_by_id)
+				error_msg_and_die("creating trie failed");
+		}
+		task = (struct count_task *) (uintptr_t)
+			trie_get(task_by_id, (unsigned int) id);
+	}
+
+	if (!task) {
+		task = xzalloc(sizeof(*task));
+		task->id = id;
+		strcpy(task->comm, get_tcb_cold(tcp)->comm);
+
+		if (tasks_count == tasks_size)
+			tasks = xgrowarray(tasks, &tasks_size,
+					   sizeof(*tasks));
+		tasks[tasks_count++] = task;
+
+		if (summary_by != COUNT_BY_COMM)
+			trie_set(task_by_id, (unsigned int) id,
+				 (uintptr_t) task);
+	}
+
+	task->users++;
+	tcp->count_task = task;
+
+	return task;
+}
+
+static void
+detach_count_task(struct tcb *tcp)
+{
+	struct count_task *task = tcp->count_task;
+
+	tcp->count_task = NULL;
+
+	if (--task->users || summary_by == COUNT_BY_COMM)
+		return;
+
+	task->top_key = task_top_key(task);
+	free(task->sc);
+	task->sc = NULL;
+	task->sc_size = task->sc_used = 0;
+
+	trie_set(task_by_id, (unsigned int) task->id, 0);
+
+	/*
+	 * Wait for at least half of the tasks to be folded,
+	 * so that moving the live ones around does not add up.
+	 */
+	if (summary_top && ++folded_tasks >= 2 * summary_top
+	    && 2 * folded_tasks >= tasks_count)
+		drop_folded_tasks();
+}
+
+void
+count_drop_tcb(struct tcb *tcp)
+{
+	if (tcp->count_task)
+		detach_count_task(tcp);
+}
+
+static void
+count_task_syscall(struct tcb *tcp, const struct timespec *wts)
+{
+	struct count_task *task = tcp->count_task;
+	const char *const comm = get_tcb_cold(tcp)->comm;
+
+	if (task && strcmp(task->comm, comm)) {
+		if (summary_by == COUNT_BY_COMM) {
+			detach_count_task(tcp);
+			task = NULL;
+		} else if (task->id == tcp->pid) {
+			strcpy(task->comm, comm);
+		}
+	}
+
+	if (!task)
+		task = attach_count_task(tcp);
+
+	struct task_sc_counts *sc =
+		task_sc_get(task, tcp->scno * SUPPORTED_PERSONALITIES
+				  + current_personality + 1);
+
+	ts_add(&task->time, &task->time, wts);
+	ts_add(&sc->time, &sc->time, wts);
+	task->calls++;
+	sc->calls++;
+	if (syserror(tcp)) {
+		task->errors++;
+		sc->errors++;
+	}
+}
+
 void
 count_syscall(struct tcb *tcp, const struct timespec *syscall_exiting_ts)
 {
@@ -117,13 +574,14 @@ count_syscall(struct tcb *tcp, const struct timespec *syscall_exiting_ts)
 	if (syserror(tcp))
 		cc->errors++;
 
+	const struct tcb_cold *const cold = get_tcb_cold(tcp);
 	struct timespec wts;
 	if (count_wallclock) {
 		/* wall clock time spent while in syscall */
-		ts_sub(&wts, syscall_exiting_ts, &tcp->etime);
+		ts_sub(&wts, syscall_exiting_ts, &cold->etime);
 	} else {
 		/* system CPU time spent while in syscall */
-		ts_sub(&wts, &tcp->stime, &tcp->ltime);
+		ts_sub(&wts, &cold->stime, &cold->ltime);
 	}
 
 	ts_sub(&wts, &wts, &overhead);
@@ -133,6 +591,19 @@ count_syscall(struct tcb *tcp, const struct timespec *syscall_exiting_ts)
 	ts_add(&cc->time, &cc->time, wts_nonneg);
 	cc->time_min = *ts_min(&cc->time_min, wts_nonneg);
 	cc->time_max = *ts_max(&cc->time_max, wts_nonneg);
+
+	double wts_float = ts_float(wts_nonneg);
+	cc->time_sq_sum += wts_float * wts_float;
+
+	if (summary_by)
+		count_task_syscall(tcp, wts_nonneg);
+
+	if (hist_enabled) {
+		if (!cc->hist)
+			cc->hist = xcalloc(HIST_BUCKETS, sizeof(*cc->hist));
+		cc->hist[hist_bucket(wts_nonneg->tv_sec * 1000000000ULL
+				     + wts_nonneg->tv_nsec)]++;
+	}
 }
 
 static int
@@ -164,6 +635,28 @@ avg_time_cmp(const void *a, const void *b)
 		       &counts[*((unsigned int *) b)].time_avg);
 }
 
+#define PCT_TIME_CMP(name_, pct_)					\
+	static int							\
+	name_(const void *a, const void *b)				\
+	{								\
+		return -ts_cmp(&counts[*((unsigned int *) a)].time_pct[pct_], \
+			       &counts[*((unsigned int *) b)].time_pct[pct_]); \
+	}
+
+PCT_TIME_CMP(p50_time_cmp, HP_50)
+PCT_TIME_CMP(p90_time_cmp, HP_90)
+PCT_TIME_CMP(p99_time_cmp, HP_99)
+PCT_TIME_CMP(p999_time_cmp, HP_999)
+
+#undef PCT_TIME_CMP
+
+static int
+stddev_time_cmp(const void *a, const void *b)
+{
+	return -ts_cmp(&counts[*((unsigned int *) a)].time_stddev,
+		       &counts[*((unsigned int *) b)].time_stddev);
+}
+
 static int
 syscall_cmp(const void *a, const void *b)
 {
@@ -208,6 +701,11 @@ set_sortby(const char *sortby)
 		[CSC_TIME_MIN]   = min_time_cmp,
 		[CSC_TIME_MAX]   = max_time_cmp,
 		[CSC_TIME_AVG]   = avg_time_cmp,
+		[CSC_TIME_P50]   = p50_time_cmp,
+		[CSC_TIME_P90]   = p90_time_cmp,
+		[CSC_TIME_P99]   = p99_time_cmp,
+		[CSC_TIME_P999]  = p999_time_cmp,
+		[CSC_TIME_STDDEV] = stddev_time_cmp,
 		[CSC_CALLS]      = count_cmp,
 		[CSC_ERRORS]     = error_cmp,
 		[CSC_SC_NAME]    = syscall_cmp,
@@ -216,6 +714,8 @@ set_sortby(const char *sortby)
 	for (size_t i = 0; i < ARRAY_SIZE(column_aliases); ++i) {
 		if (!strcmp(column_aliases[i].name, sortby)) {
 			sortfun = sort_fns[column_aliases[i].column];
+			if (is_hist_column(column_aliases[i].column))
+				hist_enabled = true;
 			return;
 		}
 	}
@@ -255,6 +755,8 @@ set_count_summary_columns(const char *s)
 
 			columns[cur++] = column_aliases[i].column;
 			visible[column_aliases[i].column] = 1;
+			if (is_hist_column(column_aliases[i].column))
+				hist_enabled = true;
 			found = true;
 
 			break;
@@ -277,6 +779,50 @@ set_count_summary_columns(const char *s)
 		columns[cur++] = CSC_SC_NAME;
 }
 
+void
+set_count_summary_histograms(void)
+{
+	hist_enabled = true;
+	hist_print = true;
+}
+
+int
+set_count_summary_by(const char *str)
+{
+	static const char *const names[] = {
+		[COUNT_BY_PROCESS] = "process",
+		[COUNT_BY_THREAD] = "thread",
+		[COUNT_BY_COMM] = "comm",
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(names); ++i) {
+		if (names[i] && !strcmp(str, names[i])) {
+			summary_by = i;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+void
+set_count_summary_top(unsigned int n)
+{
+	summary_top = n;
+}
+
+bool
+count_summary_needs_comm(void)
+{
+	return summary_by != COUNT_BY_NONE;
+}
+
+void
+enable_count_percentiles(void)
+{
+	hist_enabled = true;
+}
+
 int
 set_overhead(const char *str)
 {
@@ -295,6 +841,50 @@ num_chars(const char *fmt, ...)
 	return (unsigned int) MAX(ret, 0);
 }
 
+/* Calculates the average, the standard deviation, and the percentiles.  */
+static void
+update_call_stats(struct call_counts *cc)
+{
+	ts_div(&cc->time_avg, &cc->time, cc->calls);
+	stddev_ts(&cc->time_stddev, ts_float(&cc->time), cc->time_sq_sum,
+		  cc->calls);
+
+	if (!cc->hist)
+		return;
+
+	for (size_t j = 0; j < HP_COUNT; ++j)
+		hist_percentile(&cc->time_pct[j], cc->hist, cc->calls,
+				hist_permille[j], &cc->time_min, &cc->time_max);
+}
+
+static void
+print_histograms(FILE *outf, const unsigned int *indices)
+{
+	for (size_t j = 0; j < nsyscalls; ++j) {
+		const struct call_counts *cc = &counts[indices[j]];
+
+		if (!cc->hist)
+			continue;
+
+		fprintf(outf, "\n%s latency histogram (usecs):\n",
+			sysent[indices[j]].sys_name);
+
+		for (unsigned int i = 0; i < HIST_BUCKETS; ++i) {
+			if (!cc->hist[i])
+				continue;
+
+			fprintf(outf, "%14.3f .. ",
+				hist_bucket_start(i) / 1e3);
+			if (i < HIST_BUCKETS - 1)
+				fprintf(outf, "%-14.3f",
+					hist_bucket_start(i + 1) / 1e3);
+			else
+				fprintf(outf, "%-14s", "inf");
+			fprintf(outf, " %" PRIu64 "\n", cc->hist[i]);
+		}
+	}
+}
+
 static void
 call_summary_pers(FILE *outf)
 {
@@ -308,6 +898,11 @@ call_summary_pers(FILE *outf)
 	const struct timespec *tv_avg_max = &zero_ts;
 	uint64_t call_cum = 0;
 	uint64_t error_cum = 0;
+	double sq_sum_cum = 0;
+	uint64_t *hist_cum = hist_enabled
+			     ? xcalloc(HIST_BUCKETS, sizeof(*hist_cum)) : NULL;
+	struct timespec tv_pct_cum[HP_COUNT] = { { 0 } };
+	struct timespec tv_stddev_cum = zero_ts;
 
 	double float_tv_cum;
 	double percent;
@@ -329,13 +924,27 @@ call_summary_pers(FILE *outf)
 		call_cum += counts[i].calls;
 		error_cum += counts[i].errors;
 
-		ts_div(&counts[i].time_avg, &counts[i].time, counts[i].calls);
+		update_call_stats(&counts[i]);
 		tv_avg_max = ts_max(tv_avg_max, &counts[i].time_avg);
 
+		sq_sum_cum += counts[i].time_sq_sum;
+		if (counts[i].hist) {
+			for (size_t j = 0; j < HIST_BUCKETS; ++j)
+				hist_cum[j] += counts[i].hist[j];
+		}
+
 		sc_name_max = MAX(sc_name_max, strlen(sysent[i].sys_name));
 	}
 	float_tv_cum = ts_float(&tv_cum);
 
+	if (call_cum) {
+		stddev_ts(&tv_stddev_cum, float_tv_cum, sq_sum_cum, call_cum);
+		for (size_t j = 0; hist_cum && j < HP_COUNT; ++j)
+			hist_percentile(&tv_pct_cum[j], hist_cum, call_cum,
+					hist_permille[j], tv_min, tv_max);
+	}
+	free(hist_cum);
+
 	if (sortfun)
 		qsort((void *) indices, nsyscalls, sizeof(indices[0]), sortfun);
 
@@ -352,6 +961,11 @@ call_summary_pers(FILE *outf)
 		[CSC_TIME_100S]  = { ARRSZ_PAIR("% time") - 1,   "%1$*2$.2f" },
 		[CSC_TIME_MIN]   = { ARRSZ_PAIR("shortest") - 1, "%1$*2$.6f" },
 		[CSC_TIME_MAX]   = { ARRSZ_PAIR("longest") - 1,  "%1$*2$.6f" },
+		[CSC_TIME_P50]   = { ARRSZ_PAIR("p50") - 1,      "%1$*2$.6f" },
+		[CSC_TIME_P90]   = { ARRSZ_PAIR("p90") - 1,      "%1$*2$.6f" },
+		[CSC_TIME_P99]   = { ARRSZ_PAIR("p99") - 1,      "%1$*2$.6f" },
+		[CSC_TIME_P999]  = { ARRSZ_PAIR("p99.9") - 1,    "%1$*2$.6f" },
+		[CSC_TIME_STDDEV] = { ARRSZ_PAIR("stddev") - 1,  "%1$*2$.6f" },
 		/* Historical field sizes are preserved */
 		[CSC_TIME_TOTAL] = { "seconds",    11, "%1$*2$.6f" },
 		[CSC_TIME_AVG]   = { "usecs/call", 11, "%1$*2$" PRIu64 },
@@ -369,6 +983,16 @@ call_summary_pers(FILE *outf)
 					     (int64_t) tv_min_max->tv_sec)),
 		W_(CSC_TIME_MAX,   num_chars("%" PRId64 ".000000",
 					     (int64_t) tv_max->tv_sec)),
+		W_(CSC_TIME_P50,   num_chars("%" PRId64 ".000000",
+					     (int64_t) tv_max->tv_sec)),
+		W_(CSC_TIME_P90,   num_chars("%" PRId64 ".000000",
+					     (int64_t) tv_max->tv_sec)),
+		W_(CSC_TIME_P99,   num_chars("%" PRId64 ".000000",
+					     (int64_t) tv_max->tv_sec)),
+		W_(CSC_TIME_P999,  num_chars("%" PRId64 ".000000",
+					     (int64_t) tv_max->tv_sec)),
+		W_(CSC_TIME_STDDEV, num_chars("%" PRId64 ".000000",
+					      (int64_t) tv_max->tv_sec)),
 		W_(CSC_TIME_AVG,   num_chars("%" PRId64 ,
 					     (uint64_t) (ts_float(tv_avg_max)
 							 * 1e6))),
@@ -424,6 +1048,11 @@ call_summary_pers(FILE *outf)
 		FC_(CSC_TIME_MIN);
 		FC_(CSC_TIME_MAX);
 		FC_(CSC_TIME_AVG);
+		FC_(CSC_TIME_P50);
+		FC_(CSC_TIME_P90);
+		FC_(CSC_TIME_P99);
+		FC_(CSC_TIME_P999);
+		FC_(CSC_TIME_STDDEV);
 		FC_(CSC_CALLS);
 		FC_(CSC_ERRORS);
 		FC_(CSC_SC_NAME);
@@ -457,6 +1086,11 @@ call_summary_pers(FILE *outf)
 			PC_(CSC_TIME_MAX,   ts_float(&cc->time_max));
 			PC_(CSC_TIME_AVG,
 			    (uint64_t) (ts_float(&cc->time_avg) * 1e6));
+			PC_(CSC_TIME_P50,   ts_float(&cc->time_pct[HP_50]));
+			PC_(CSC_TIME_P90,   ts_float(&cc->time_pct[HP_90]));
+			PC_(CSC_TIME_P99,   ts_float(&cc->time_pct[HP_99]));
+			PC_(CSC_TIME_P999,  ts_float(&cc->time_pct[HP_999]));
+			PC_(CSC_TIME_STDDEV, ts_float(&cc->time_stddev));
 			PC_(CSC_CALLS,      cc->calls);
 			PC_(CSC_ERRORS,     cc->errors);
 			PC_(CSC_SC_NAME,    sysent[idx].sys_name);
@@ -466,8 +1100,6 @@ call_summary_pers(FILE *outf)
 		fputc('\n', outf);
 	}
 
-	free(indices);
-
 	/* footer */
 	for (size_t i = 0; i <= last_column; ++i) {
 		if (i)
@@ -490,6 +1122,11 @@ call_summary_pers(FILE *outf)
 		PC_(CSC_TIME_MIN, ts_float(tv_min));
 		PC_(CSC_TIME_MAX, ts_float(tv_max));
 		PC_(CSC_TIME_AVG, (uint64_t) (float_tv_cum / call_cum * 1e6));
+		PC_(CSC_TIME_P50, ts_float(&tv_pct_cum[HP_50]));
+		PC_(CSC_TIME_P90, ts_float(&tv_pct_cum[HP_90]));
+		PC_(CSC_TIME_P99, ts_float(&tv_pct_cum[HP_99]));
+		PC_(CSC_TIME_P999, ts_float(&tv_pct_cum[HP_999]));
+		PC_(CSC_TIME_STDDEV, ts_float(&tv_stddev_cum));
 		PC_(CSC_CALLS, call_cum);
 		PC_(CSC_ERRORS, error_cum);
 		PC_(CSC_SC_NAME, "total");
@@ -499,15 +1136,31 @@ call_summary_pers(FILE *outf)
 
 #undef PC_
 #undef FC_
+
+	if (hist_print)
+		print_histograms(outf, indices);
+
+	free(indices);
 }
 
-void
-call_summary(FILE *outf)
+static bool
+has_calls(const struct call_counts *cv, unsigned int n)
+{
+	for (unsigned int i = 0; cv && i < n; ++i) {
+		if (cv[i].calls)
+			return true;
+	}
+
+	return false;
+}
+
+static void
+print_summary(FILE *outf)
 {
 	const unsigned int old_pers = current_personality;
 
 	for (unsigned int i = 0; i < SUPPORTED_PERSONALITIES; ++i) {
-		if (!countv[i])
+		if (!has_calls(countv[i], nsyscall_vec[i]))
 			continue;
 
 		if (current_personality != i)
@@ -522,3 +1175,233 @@ call_summary(FILE *outf)
 	if (old_pers != current_personality)
 		set_personality(old_pers);
 }
+
+/* Adds the counts of the last interval to the totals and resets them.  */
+static void
+merge_interval_counts(void)
+{
+	for (unsigned int p = 0; p < SUPPORTED_PERSONALITIES; ++p) {
+		if (!countv[p])
+			continue;
+
+		if (!total_countv[p]) {
+			total_countv[p] = xcalloc(nsyscall_vec[p],
+						  sizeof(*total_countv[p]));
+			for (size_t i = 0; i < nsyscall_vec[p]; ++i)
+				total_countv[p][i].time_min = max_ts;
+		}
+
+		for (size_t i = 0; i < nsyscall_vec[p]; ++i) {
+			struct call_counts *src = &countv[p][i];
+			struct call_counts *dst = &total_countv[p][i];
+
+			if (!src->calls)
+				continue;
+
+			ts_add(&dst->time, &dst->time, &src->time);
+			dst->time_min = *ts_min(&dst->time_min, &src->time_min);
+			dst->time_max = *ts_max(&dst->time_max, &src->time_max);
+			dst->time_sq_sum += src->time_sq_sum;
+			dst->calls += src->calls;
+			dst->errors += src->errors;
+
+			uint64_t *hist = src->hist;
+			if (hist) {
+				if (!dst->hist)
+					dst->hist = xcalloc(HIST_BUCKETS,
+							    sizeof(*dst->hist));
+				for (size_t j = 0; j < HIST_BUCKETS; ++j)
+					dst->hist[j] += hist[j];
+				memset(hist, 0, HIST_BUCKETS * sizeof(*hist));
+			}
+
+			memset(src, 0, sizeof(*src));
+			src->time_min = max_ts;
+			src->hist = hist;
+		}
+	}
+}
+
+static void
+swap_total_counts(void)
+{
+	for (unsigned int p = 0; p < SUPPORTED_PERSONALITIES; ++p) {
+		struct call_counts *cv = countv[p];
+		countv[p] = total_countv[p];
+		total_countv[p] = cv;
+	}
+}
+
+/* Writes a JSON object per syscall called during the interval.  */
+static void
+print_interval_data(FILE *fp, double start, double end)
+{
+	const unsigned int old_pers = current_personality;
+
+	for (unsigned int p = 0; p < SUPPORTED_PERSONALITIES; ++p) {
+		if (!has_calls(countv[p], nsyscall_vec[p]))
+			continue;
+
+		if (current_personality != p)
+			set_personality(p);
+
+		for (size_t i = 0; i < nsyscalls; ++i) {
+			struct call_counts *cc = &counts[i];
+
+			if (!cc->calls)
+				continue;
+
+			update_call_stats(cc);
+			fprintf(fp, "{\"interval\":%u,\"start\":%.6f"
+				",\"end\":%.6f,\"personality\":\"%s\""
+				",\"syscall\":\"%s\",\"calls\":%" PRIu64
+				",\"errors\":%" PRIu64 ",\"seconds\":%.9f"
+				",\"min\":%.9f,\"max\":%.9f,\"avg\":%.9f"
+				",\"stddev\":%.9f",
+				intervals, start, end, personality_names[p],
+				sysent[i].sys_name, cc->calls, cc->errors,
+				ts_float(&cc->time), ts_float(&cc->time_min),
+				ts_float(&cc->time_max),
+				ts_float(&cc->time_avg),
+				ts_float(&cc->time_stddev));
+			if (cc->hist)
+				fprintf(fp, ",\"p50\":%.9f,\"p90\":%.9f"
+					",\"p99\":%.9f,\"p999\":%.9f",
+					ts_float(&cc->time_pct[HP_50]),
+					ts_float(&cc->time_pct[HP_90]),
+					ts_float(&cc->time_pct[HP_99]),
+					ts_float(&cc->time_pct[HP_999]));
+			fputs("}\n", fp);
+		}
+	}
+
+	if (old_pers != current_personality)
+		set_personality(old_pers);
+}
+
+void
+call_summary_interval(FILE *outf, FILE *data_fp,
+		      const struct timespec *start, const struct timespec *end,
+		      bool cumulative)
+{
+	++intervals;
+
+	fprintf(outf, "System call usage summary for interval %u"
+		" (%.6f-%.6f seconds):\n",
+		intervals, ts_float(start), ts_float(end));
+	print_summary(outf);
+
+	if (data_fp) {
+		print_interval_data(data_fp, ts_float(start), ts_float(end));
+		fflush(data_fp);
+	}
+
+	merge_interval_counts();
+
+	if (cumulative) {
+		fprintf(outf, "System call usage summary since start"
+			" (%.6f seconds):\n", ts_float(end));
+		swap_total_counts();
+		print_summary(outf);
+		swap_total_counts();
+	}
+
+	fflush(outf);
+}
+
+static const char *
+task_sc_name(unsigned int key)
+{
+	if (!key--)
+		return "";
+
+	const unsigned int pers = key % SUPPORTED_PERSONALITIES;
+	const unsigned int scno = key / SUPPORTED_PERSONALITIES;
+
+	return sysent_vec[pers][scno].sys_name;
+}
+
+/* Prints the tasks that spent the most time in syscalls.  */
+static void
+print_task_ranking(FILE *outf)
+{
+	static const char *const titles[] = {
+		[COUNT_BY_PROCESS] = "processes",
+		[COUNT_BY_THREAD] = "threads",
+		[COUNT_BY_COMM] = "commands",
+	};
+	static const char *const id_names[] = {
+		[COUNT_BY_PROCESS] = "pid",
+		[COUNT_BY_THREAD] = "tid",
+	};
+	const char *const id_name = id_names[summary_by];
+	struct timespec tv_cum = dropped_tasks.time;
+	uint64_t call_cum = dropped_tasks.calls;
+	uint64_t error_cum = dropped_tasks.errors;
+
+	if (!tasks_count)
+		return;
+
+	qsort(tasks, tasks_count, sizeof(*tasks), task_time_cmp);
+
+	for (size_t i = 0; i < tasks_count; ++i) {
+		ts_add(&tv_cum, &tv_cum, &tasks[i]->time);
+		call_cum += tasks[i]->calls;
+		error_cum += tasks[i]->errors;
+	}
+
+	const double float_tv_cum = ts_float(&tv_cum);
+	const size_t n = summary_top && summary_top < tasks_count
+			 ? summary_top : tasks_count;
+
+	fprintf(outf, "\nTop %zu of %zu %s by system call time:\n",
+		n, tasks_count + dropped_tasks.count, titles[summary_by]);
+	fprintf(outf, "%6s %11s %9s %9s ", "% time", "seconds", "calls",
+		"errors");
+	if (id_name)
+		fprintf(outf, "%8s ", id_name);
+	fprintf(outf, "%-16s %s\n", "comm", "top syscall");
+	fprintf(outf, "------ ----------- --------- --------- %s"
+		"---------------- ----------------\n",
+		id_name ? "-------- " : "");
+
+	for (size_t i = 0; i < n; ++i) {
+		const struct count_task *task = tasks[i];
+		double percent = 100.0 * ts_float(&task->time);
+
+		/* float_tv_cum can be 0.0 too and we get 0/0 = NAN */
+		if (percent != 0.0)
+			percent /= float_tv_cum;
+
+		fprintf(outf, "%6.2f %11.6f %9" PRIu64 " %9.0" PRIu64 " ",
+			percent, ts_float(&task->time), task->calls,
+			task->errors);
+		if (id_name)
+			fprintf(outf, "%8d ", task->id);
+		fprintf(outf, "%-16s %s\n", task->comm,
+			task_sc_name(task_top_key(task)));
+	}
+
+	fprintf(outf, "------ ----------- --------- --------- %s"
+		"---------------- ----------------\n",
+		id_name ? "-------- " : "");
+	fprintf(outf, "%6.2f %11.6f %9" PRIu64 " %9.0" PRIu64 " ",
+		100.0, float_tv_cum, call_cum, error_cum);
+	if (id_name)
+		fprintf(outf, "%8s ", "");
+	fputs("total\n", outf);
+}
+
+void
+call_summary(FILE *outf)
+{
+	if (intervals) {
+		merge_interval_counts();
+		swap_total_counts();
+	}
+
+	print_summary(outf);
+
+	if (summary_by)
+		print_task_ranking(outf);
+}
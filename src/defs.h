@@ -262,6 +262,42 @@ struct inject_opts {
 # define MAX_ERRNO_VALUE			4095
 
 /* Trace Control Block */
+/*
+ * The fields of struct tcb used only by some features,
+ * allocated on the first use, see get_tcb_cold().
+ */
+struct tcb_cold {
+	struct inject_opts *inject_vec[SUPPORTED_PERSONALITIES];
+	struct staged_output_data *staged_output_data;
+
+	struct timespec stime;	/* System time usage as of last process wait */
+	struct timespec ltime;	/* System time usage as of last syscall entry */
+	struct timespec atime;	/* System time right after attach */
+	struct timespec etime;	/* Syscall entry time (CLOCK_MONOTONIC) */
+
+# define PROC_COMM_LEN 16
+	char comm[PROC_COMM_LEN];
+
+	struct timespec delay_expiration_time; /* When does the delay end */
+	/* 1 + position in the heap of delayed tcbs, 0 if not delayed */
+	size_t delay_heap_pos;
+	/** Wait data storage for a delayed process. */
+	struct tcb_wait_data *delayed_wait_data;
+
+# ifdef ENABLE_SECONTEXT
+	int last_dirfd; /* Use AT_FDCWD for 'not set' */
+# endif
+
+# ifdef HAVE_LINUX_KVM_H
+	struct vcpu_info *vcpu_info_list;
+# endif
+
+# ifdef ENABLE_STACKTRACE
+	void *unwind_ctx;
+	struct unwind_queue_t *unwind_queue;
+# endif
+};
+
 struct tcb {
 	int flags;		/* See below for TCB_ values */
 	int pid;		/* If 0, this tcb is free */
@@ -277,7 +313,6 @@ struct tcb {
 	int sys_func_rval;	/* Syscall entry parser's return value */
 	int curcol;		/* Output column for this process */
 	FILE *outf;		/* Output file for this process */
-	struct staged_output_data *staged_output_data;
 
 	const char *auxstr;	/* Auxiliary info from syscall (see RVAL_STR) */
 	void *_priv_data;	/* Private data for syscall decoding functions */
@@ -286,12 +321,6 @@ struct tcb {
 				     * scno.  Use tcp_sysent() macro for access.
 				     */
 	const struct_sysent *s_prev_ent; /* for "resuming interrupted SYSCALL" msg */
-	struct inject_opts *inject_vec[SUPPORTED_PERSONALITIES];
-	struct timespec stime;	/* System time usage as of last process wait */
-	struct timespec ltime;	/* System time usage as of last syscall entry */
-	struct timespec atime;	/* System time right after attach */
-	struct timespec etime;	/* Syscall entry time (CLOCK_MONOTONIC) */
-	struct timespec delay_expiration_time; /* When does the delay end */
 
 	/*
 	 * The ID of the PID namespace of this process
@@ -300,11 +329,16 @@ struct tcb {
 	 */
 	unsigned int pid_ns;
 
-# ifdef ENABLE_SECONTEXT
-	int last_dirfd; /* Use AT_FDCWD for 'not set' */
-# endif
-
 	struct mmap_cache_t *mmap_cache;
+	/* The generation of mmap_cache last seen by this tcb.  */
+	unsigned int mmap_cache_generation;
+
+	/* 1 + index of the first page cached by umove, 0 if none */
+	unsigned int umove_cache_pages;
+
+	/* Paths of file descriptors, see getfdpath_cached() */
+	struct fd_path_cache_entry *fd_path_cache;
+	size_t fd_path_cache_size;
 
 	/*
 	 * Data that is stored during process wait traversal.
@@ -312,22 +346,15 @@ struct tcb {
 	 * that is realloc'ed at runtime.
 	 */
 	size_t wait_data_idx;
-	/** Wait data storage for a delayed process. */
-	struct tcb_wait_data *delayed_wait_data;
 	struct list_item wait_list;
 
+	/* Kept across the reuse of this tcb, see get_tcb_cold() */
+	struct tcb_cold *cold;
+	/* The next tcb in the list of free tcbs, see alloctcb() */
+	struct tcb *next_free;
 
-# ifdef HAVE_LINUX_KVM_H
-	struct vcpu_info *vcpu_info_list;
-# endif
-
-# ifdef ENABLE_STACKTRACE
-	void *unwind_ctx;
-	struct unwind_queue_t *unwind_queue;
-# endif
-
-# define PROC_COMM_LEN 16
-	char comm[PROC_COMM_LEN];
+	/* Per-task stats for --summary-by, see count_syscall() */
+	struct count_task *count_task;
 };
 
 /* TCB flags */
@@ -369,6 +396,8 @@ struct tcb {
 # define TCB_SECCOMP_FILTER		0x40000	/* This process has a seccomp filter
 						 * attached.
 						 */
+# define TCB_STAGED_OUTPUT		0x80000	/* The output is being staged
+						   for status qualifier. */
 
 /* qualifier flags */
 # define QUAL_TRACE	0x001	/* this system call should be traced */
@@ -562,6 +591,18 @@ extern int read_int_from_file(const char *, int *);
 extern void set_sortby(const char *);
 extern int set_overhead(const char *);
 extern void set_count_summary_columns(const char *columns);
+extern void set_count_summary_histograms(void);
+extern void enable_count_percentiles(void);
+enum count_summary_by {
+	COUNT_BY_NONE,
+	COUNT_BY_PROCESS,
+	COUNT_BY_THREAD,
+	COUNT_BY_COMM,
+};
+extern int set_count_summary_by(const char *);
+extern void set_count_summary_top(unsigned int);
+extern bool count_summary_needs_comm(void);
+extern void count_drop_tcb(struct tcb *);
 
 extern bool get_instruction_pointer(struct tcb *, kernel_ulong_t *);
 extern bool get_stack_pointer(struct tcb *, kernel_ulong_t *);
@@ -579,8 +620,17 @@ extern int syscall_exiting_decode(struct tcb *, struct timespec *);
 extern int syscall_exiting_trace(struct tcb *, struct timespec *, int);
 extern void syscall_exiting_finish(struct tcb *);
 
+extern int syscall_entering_replay(struct tcb *, unsigned int personality,
+				   kernel_ulong_t scno, kernel_ulong_t true_scno,
+				   const uint64_t *args, int res);
+extern int syscall_exiting_replay(struct tcb *, kernel_long_t rval, int error,
+				  struct timespec *, int res);
+
 extern void count_syscall(struct tcb *, const struct timespec *);
 extern void call_summary(FILE *);
+extern void call_summary_interval(FILE *outf, FILE *data_fp,
+				  const struct timespec *start,
+				  const struct timespec *end, bool cumulative);
 
 extern void clear_regs(struct tcb *tcp);
 extern int get_scno(struct tcb *);
@@ -652,6 +702,9 @@ extern int set_tcb_priv_data(struct tcb *, void *priv_data,
 			     void (*free_priv_data)(void *));
 extern void free_tcb_priv_data(struct tcb *);
 
+/* Returns the cold fields of the tcb, allocating them on the first use.  */
+extern struct tcb_cold *get_tcb_cold(struct tcb *);
+
 static inline unsigned long get_tcb_priv_ulong(const struct tcb *tcp)
 {
 	return (unsigned long) get_tcb_priv_data(tcp);
@@ -767,8 +820,19 @@ umoven_or_printaddr_ignore_syserror(struct tcb *tcp, const kernel_ulong_t addr,
 extern int
 umovestr(struct tcb *, kernel_ulong_t addr, unsigned int len, char *laddr);
 
-/* Invalidate the cache used by umove* functions.  */
-extern void invalidate_umove_cache(void);
+/* Number of tracee memory pages cached by umove* functions.  */
+# define DEFAULT_UMOVE_CACHE_SIZE 16
+# define MAX_UMOVE_CACHE_SIZE 1024
+extern unsigned int umove_cache_size;
+
+/* Invalidate the pages of the tracee cached by umove* functions.  */
+extern void invalidate_umove_cache(struct tcb *);
+extern void print_umove_cache_stats(void);
+/* Load the tracee memory at the given addresses into the umove cache.  */
+extern void umove_prefetch(struct tcb *, const kernel_ulong_t *addrs,
+			   unsigned int count);
+/* Prefetch the memory referenced by pointer arguments of the syscall.  */
+extern void prefetch_syscall_args(struct tcb *);
 
 extern int upeek(struct tcb *tcp, unsigned long, kernel_ulong_t *);
 extern int upoke(struct tcb *tcp, unsigned long, kernel_ulong_t);
@@ -812,13 +876,27 @@ extern int get_proc_pid_fd_path(int proc_pid, int fd, char *buf,
 
 extern int getfdpath_pid(pid_t pid, int fd, char *buf, unsigned bufsize,
 			 bool *deleted);
+extern int getcwdpath_pid(pid_t pid, char *buf, unsigned bufsize);
+
+/**
+ * Like getfdpath_pid() for the process of the tcb, but use the cached path
+ * if it is still valid (see --fd-path-cache option).
+ */
+extern int getfdpath_cached(struct tcb *, int fd, char *buf, unsigned bufsize,
+			    bool *deleted);
 
 static inline int
 getfdpath(struct tcb *tcp, int fd, char *buf, unsigned bufsize)
 {
-	return getfdpath_pid(tcp->pid, fd, buf, bufsize, NULL);
+	return getfdpath_cached(tcp, fd, buf, bufsize, NULL);
 }
 
+extern bool fd_path_cache_enabled;
+/* Invalidate the cached paths affected by the current syscall.  */
+extern void update_fd_path_cache(struct tcb *);
+extern void free_fd_path_cache(struct tcb *);
+extern void print_fd_path_cache_stats(void);
+
 extern unsigned long getfdinode(struct tcb *, int);
 extern enum sock_proto getfdproto(struct tcb *, int);
 
@@ -1132,6 +1210,10 @@ extern kernel_ulong_t *
 fetch_indirect_syscall_args(struct tcb *, kernel_ulong_t addr, unsigned int n_args);
 
 extern void pidns_init(void);
+/* Keep the pidns translation cache up to date with tracees.  */
+extern void pidns_add_tracee(struct tcb *);
+extern void pidns_drop_tracee(struct tcb *);
+extern void print_pidns_stats(void);
 
 /**
  * Returns PID as present in /proc of the tracer (can be different from tracee
@@ -1274,9 +1356,12 @@ decode_inet_addr(struct tcb *, kernel_ulong_t addr,
 extern void print_ax25_addr(const void /* ax25_address */ *addr);
 extern void print_x25_addr(const void /* struct x25_address */ *addr);
 extern const char *get_sockaddr_by_inode(struct tcb *, int fd, unsigned long inode);
+/* Expires the cached details of sockets changed by the syscall.  */
+extern void update_sockaddr_cache(struct tcb *);
+extern void print_sockaddr_cache_stats(void);
 
 /**
- * Prints dirfd file descriptor and saves it in tcp->last_dirfd,
+ * Prints dirfd file descriptor and saves it as the last dirfd,
  * the latter is used when printing SELinux contexts.
  */
 extern void print_dirfd(struct tcb *, int);
@@ -1699,6 +1784,35 @@ extern void tprints_comment(const char *str);
  */
 extern FILE *strace_open_memstream(struct tcb *tcp);
 extern void strace_close_memstream(struct tcb *tcp, bool publish);
+extern void free_staged_output(struct tcb *tcp);
+
+/*
+ * Output through in-memory rings drained by writer threads.
+ */
+enum output_ring_policy {
+	OUTPUT_RING_BLOCK,	/* wait for the writer when the ring is full */
+	OUTPUT_RING_DROP,	/* discard the output that does not fit */
+};
+# define MIN_OUTPUT_RING_SIZE 4096
+# define MAX_OUTPUT_RING_SIZE (1U << 30)
+extern unsigned int output_ring_size;	/* 0 if output rings are not used */
+extern unsigned int output_ring_policy;
+extern FILE *output_ring_wrap(FILE *);
+extern void output_ring_finish(void);
+
+/*
+ * Flight recorder: the recent output kept in memory until a trigger.
+ */
+# define MIN_FLIGHT_RECORDER_SIZE 4096
+# define MAX_FLIGHT_RECORDER_SIZE (1U << 30)
+extern unsigned int flight_recorder_size; /* 0 if the recorder is not used */
+extern FILE *flight_recorder_wrap(FILE *);
+/* Writes out the output recorded so far, reason is used in debug messages.  */
+extern void flight_recorder_dump(const char *reason);
+extern void flight_recorder_syscall_exiting(struct tcb *);
+extern void flight_recorder_signalled(int sig);
+extern void qualify_flight_recorder_trigger(const char *);
+extern void print_flight_recorder_stats(void);
 
 static inline void
 printaddr_comment(const kernel_ulong_t addr)
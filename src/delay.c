@@ -7,6 +7,9 @@
 
 #include "defs.h"
 #include "delay.h"
+#ifdef HAVE_SYS_TIMERFD_H
+# include <sys/timerfd.h>
+#endif
 
 struct inject_delay_data {
 	struct timespec ts_enter;
@@ -17,9 +20,22 @@ static struct inject_delay_data *delay_data_vec;
 static size_t delay_data_vec_capacity; /* size of the arena */
 static size_t delay_data_vec_size;     /* size of the used arena */
 
+/* The delayed tcbs, a binary min-heap ordered by delay_expiration_time.  */
+static struct tcb **delay_heap;
+static size_t delay_heap_capacity;
+static size_t delay_heap_size;
+
 static timer_t delay_timer = (timer_t) -1;
+static int delay_timer_fd = -1;
 static bool delay_timer_is_armed;
 
+/*
+ * The SIGALRM handler only interrupts wait4, and the expiration can be
+ * delivered right before wait4 is called, so the delay timer that sends
+ * SIGALRM fires again every delay_timer_retry until it is re-armed.
+ */
+static const struct timespec delay_timer_retry = { 0, 10000000 };
+
 static void
 expand_delay_data_vec(void)
 {
@@ -79,21 +95,167 @@ delay_timer_expired(void)
 	delay_timer_is_armed = false;
 }
 
+/*
+ * Creates a timerfd to be used as the delay timer instead of a timer
+ * that sends SIGALRM, so that its expirations can be handled
+ * in the main loop.  Returns the file descriptor, or -1 if no delays
+ * are injected or timerfd is not available.
+ */
+int
+create_delay_timerfd(void)
+{
+#ifdef HAVE_SYS_TIMERFD_H
+	if (delay_timer_fd < 0 && delay_data_vec_size) {
+		delay_timer_fd = timerfd_create(CLOCK_MONOTONIC,
+						TFD_NONBLOCK | TFD_CLOEXEC);
+		if (delay_timer_fd < 0)
+			perror_msg_and_die("timerfd_create");
+	}
+#endif
+
+	return delay_timer_fd;
+}
+
+/* Returns true if the timerfd created by create_delay_timerfd expired.  */
+bool
+delay_timerfd_expired(void)
+{
+	uint64_t expirations;
+
+	if (delay_timer_fd < 0)
+		return false;
+
+	if (read(delay_timer_fd, &expirations, sizeof(expirations)) < 0) {
+		if (errno != EAGAIN && errno != EINTR)
+			perror_msg_and_die("read timerfd");
+		return false;
+	}
+
+	delay_timer_expired();
+	return true;
+}
+
+static const struct timespec *
+delay_heap_key(const size_t i)
+{
+	return &delay_heap[i]->cold->delay_expiration_time;
+}
+
+static void
+delay_heap_set(const size_t i, struct tcb *const tcp)
+{
+	delay_heap[i] = tcp;
+	tcp->cold->delay_heap_pos = i + 1;
+}
+
+static void
+delay_heap_sift_up(size_t i)
+{
+	struct tcb *const tcp = delay_heap[i];
+
+	while (i) {
+		const size_t parent = (i - 1) / 2;
+
+		if (ts_cmp(delay_heap_key(parent),
+			   &tcp->cold->delay_expiration_time) <= 0)
+			break;
+		delay_heap_set(i, delay_heap[parent]);
+		i = parent;
+	}
+	delay_heap_set(i, tcp);
+}
+
+static void
+delay_heap_sift_down(size_t i)
+{
+	struct tcb *const tcp = delay_heap[i];
+
+	for (;;) {
+		size_t child = 2 * i + 1;
+
+		if (child >= delay_heap_size)
+			break;
+		if (child + 1 < delay_heap_size &&
+		    ts_cmp(delay_heap_key(child + 1),
+			   delay_heap_key(child)) < 0)
+			++child;
+		if (ts_cmp(&tcp->cold->delay_expiration_time,
+			   delay_heap_key(child)) <= 0)
+			break;
+		delay_heap_set(i, delay_heap[child]);
+		i = child;
+	}
+	delay_heap_set(i, tcp);
+}
+
+static void
+delay_heap_push(struct tcb *const tcp)
+{
+	if (delay_heap_size == delay_heap_capacity)
+		delay_heap = xgrowarray(delay_heap, &delay_heap_capacity,
+					sizeof(*delay_heap));
+
+	delay_heap[delay_heap_size] = tcp;
+	delay_heap_sift_up(delay_heap_size++);
+}
+
+static void
+delay_heap_remove(const size_t i)
+{
+	delay_heap[i]->cold->delay_heap_pos = 0;
+
+	if (i == --delay_heap_size)
+		return;
+
+	delay_heap[i] = delay_heap[delay_heap_size];
+	delay_heap_sift_down(i);
+	delay_heap_sift_up(delay_heap[i]->cold->delay_heap_pos - 1);
+}
+
+/*
+ * Arms the delay timer for the delayed tcb that expires first,
+ * disarms it if there are no delayed tcbs.
+ */
 void
-arm_delay_timer(const struct tcb *const tcp)
+arm_delay_timer(void)
 {
-	const struct itimerspec its = {
-		.it_value = tcp->delay_expiration_time
+	if (!delay_heap_size) {
+		if (delay_timer_is_armed && is_delay_timer_created()) {
+			const struct itimerspec its = { 0 };
+
+			if (timer_settime(delay_timer, 0, &its, NULL))
+				perror_msg_and_die("timer_settime");
+		}
+		delay_timer_is_armed = false;
+		return;
+	}
+
+	const struct tcb *const tcp = delay_heap[0];
+	struct itimerspec its = {
+		.it_value = tcp->cold->delay_expiration_time
 	};
 
-	if (timer_settime(delay_timer, TIMER_ABSTIME, &its, NULL))
-		perror_msg_and_die("timer_settime");
+	if (delay_timer_fd >= 0) {
+#ifdef HAVE_SYS_TIMERFD_H
+		if (timerfd_settime(delay_timer_fd, TFD_TIMER_ABSTIME,
+				    &its, NULL))
+			perror_msg_and_die("timerfd_settime");
+#endif
+	} else {
+		if (!is_delay_timer_created() &&
+		    timer_create(CLOCK_MONOTONIC, NULL, &delay_timer))
+			perror_msg_and_die("timer_create");
+
+		its.it_interval = delay_timer_retry;
+		if (timer_settime(delay_timer, TIMER_ABSTIME, &its, NULL))
+			perror_msg_and_die("timer_settime");
+	}
 
 	delay_timer_is_armed = true;
 
 	debug_func_msg("timer set to %lld.%09ld for pid %d",
-		       (long long) tcp->delay_expiration_time.tv_sec,
-		       (long) tcp->delay_expiration_time.tv_nsec,
+		       (long long) tcp->cold->delay_expiration_time.tv_sec,
+		       (long) tcp->cold->delay_expiration_time.tv_nsec,
 		       tcp->pid);
 }
 
@@ -114,22 +276,52 @@ delay_tcb(struct tcb *tcp, uint16_t delay_idx, bool isenter)
 	else
 		ts_diff = &(delay_data_vec[delay_idx].ts_exit);
 
+	struct tcb_cold *const cold = get_tcb_cold(tcp);
 	struct timespec ts_now;
 	clock_gettime(CLOCK_MONOTONIC, &ts_now);
-	ts_add(&tcp->delay_expiration_time, &ts_now, ts_diff);
+	ts_add(&cold->delay_expiration_time, &ts_now, ts_diff);
 
-	if (is_delay_timer_created()) {
-		struct itimerspec its;
-		if (timer_gettime(delay_timer, &its))
-			perror_msg_and_die("timer_gettime");
+	undelay_tcb(tcp);
+	delay_heap_push(tcp);
 
-		const struct timespec *const ts_old = &its.it_value;
-		if (ts_nz(ts_old) && ts_cmp(ts_diff, ts_old) > 0)
-			return;
-	} else {
-		if (timer_create(CLOCK_MONOTONIC, NULL, &delay_timer))
-			perror_msg_and_die("timer_create");
-	}
+	/* The timer is already armed for an earlier expiration otherwise.  */
+	if (delay_heap[0] == tcp)
+		arm_delay_timer();
+}
+
+/*
+ * Removes the delayed tcb that expires first from the heap
+ * and returns it if it has expired by now, returns NULL otherwise.
+ */
+struct tcb *
+pop_expired_delayed_tcb(const struct timespec *const now)
+{
+	if (!delay_heap_size || ts_cmp(now, delay_heap_key(0)) <= 0)
+		return NULL;
+
+	struct tcb *const tcp = delay_heap[0];
+
+	delay_heap_remove(0);
+	return tcp;
+}
 
-	arm_delay_timer(tcp);
+/* Returns true if the delayed tcb that expires first has expired by now.  */
+bool
+delayed_tcb_expired(void)
+{
+	if (!delay_heap_size)
+		return false;
+
+	struct timespec ts_now;
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+
+	return ts_cmp(&ts_now, delay_heap_key(0)) > 0;
+}
+
+/* Removes the tcb from the heap of delayed tcbs if it is there.  */
+void
+undelay_tcb(struct tcb *tcp)
+{
+	if (tcp->cold && tcp->cold->delay_heap_pos)
+		delay_heap_remove(tcp->cold->delay_heap_pos - 1);
 }
@@ -12,7 +12,12 @@ uint16_t alloc_delay_data(void);
 void fill_delay_data(uint16_t delay_idx, struct timespec *val, bool isenter);
 bool is_delay_timer_armed(void);
 void delay_timer_expired(void);
-void arm_delay_timer(const struct tcb *);
+int create_delay_timerfd(void);
+bool delay_timerfd_expired(void);
+void arm_delay_timer(void);
 void delay_tcb(struct tcb *, uint16_t delay_idx, bool isenter);
+struct tcb *pop_expired_delayed_tcb(const struct timespec *now);
+bool delayed_tcb_expired(void);
+void undelay_tcb(struct tcb *);
 
 #endif /* !STRACE_DELAY_H */
@@ -18,6 +18,7 @@
 #include MPERS_DEFS
 
 #include "xgetdents.h"
+#include "secontext.h"
 
 #define D_NAME_LEN_MAX 256
 
@@ -106,9 +107,7 @@ SYS_FUNC(readdir)
 	if (entering(tcp)) {
 		/* fd */
 		printfd(tcp, tcp->u_arg[0]);
-#ifdef ENABLE_SECONTEXT
-		tcp->last_dirfd = (int) tcp->u_arg[0];
-#endif
+		selinux_set_last_dirfd(tcp, (int) tcp->u_arg[0]);
 		tprint_arg_next();
 	} else {
 		/* dirp */
@@ -0,0 +1,400 @@
+/*
+ * Symbol tables of ELF files on disk.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "defs.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "elf_symbols.h"
+#include "largefile_wrappers.h"
+
+/* The directory of separate debuginfo files looked up by build-id.  */
+#define DEBUG_BUILD_ID_DIR "/usr/lib/debug/.build-id"
+
+struct elf_load_segment {
+	uint64_t offset;
+	uint64_t filesz;
+	uint64_t vaddr;
+};
+
+struct elf_symbol {
+	uint64_t value;
+	uint64_t size;
+	const char *name;
+};
+
+struct elf_symbols {
+	char *build_id;
+	struct elf_load_segment *loads;
+	unsigned int nloads;
+	struct elf_symbol *syms;
+	size_t nsyms;
+	/* The names of symbols point into these mappings.  */
+	void *maps[2];
+	size_t map_sizes[2];
+};
+
+/* A mapped ELF file of the native byte order.  */
+struct elf_image {
+	const unsigned char *data;
+	size_t size;
+	bool is64;
+};
+
+#define ELF_FIELD(img_, p_, type_, field_)				\
+	((img_)->is64 ? ((const Elf64_ ## type_ *) (p_))->field_	\
+		      : ((const Elf32_ ## type_ *) (p_))->field_)
+
+/* Returns the pointer to size bytes at offset or NULL if out of bounds.  */
+static const void *
+image_ptr(const struct elf_image *img, const uint64_t offset,
+	  const uint64_t size)
+{
+	if (offset > img->size || size > img->size - offset)
+		return NULL;
+	return img->data + offset;
+}
+
+static bool
+map_image(const char *path, struct elf_image *img)
+{
+	int fd = open_file(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	strace_stat_t st;
+	if (fstat_fd(fd, &st) || !S_ISREG(st.st_mode)
+	    || (uint64_t) st.st_size < EI_NIDENT) {
+		close(fd);
+		return false;
+	}
+
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+
+	img->data = p;
+	img->size = st.st_size;
+
+	const unsigned char *ident = img->data;
+	const unsigned char native_data =
+#ifdef WORDS_BIGENDIAN
+		ELFDATA2MSB;
+#else
+		ELFDATA2LSB;
+#endif
+
+	if (memcmp(ident, ELFMAG, SELFMAG) || ident[EI_DATA] != native_data
+	    || (ident[EI_CLASS] != ELFCLASS32 && ident[EI_CLASS] != ELFCLASS64)
+	    || img->size < (ident[EI_CLASS] == ELFCLASS64
+			    ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr))) {
+		munmap(p, img->size);
+		return false;
+	}
+	img->is64 = ident[EI_CLASS] == ELFCLASS64;
+
+	return true;
+}
+
+static char *
+hex_string(const unsigned char *data, const size_t len)
+{
+	static const char digits[] = "0123456789abcdef";
+	char *str = xmalloc(len * 2 + 1);
+
+	for (size_t i = 0; i < len; ++i) {
+		str[i * 2] = digits[data[i] >> 4];
+		str[i * 2 + 1] = digits[data[i] & 0xf];
+	}
+	str[len * 2] = '\0';
+
+	return str;
+}
+
+/* Looks for NT_GNU_BUILD_ID in a PT_NOTE segment.  */
+static char *
+find_build_id(const struct elf_image *img, const void *phdr)
+{
+	const uint64_t offset = ELF_FIELD(img, phdr, Phdr, p_offset);
+	const uint64_t size = ELF_FIELD(img, phdr, Phdr, p_filesz);
+	const unsigned char *notes = image_ptr(img, offset, size);
+
+	if (!notes)
+		return NULL;
+
+	/* Elf32_Nhdr and Elf64_Nhdr are the same.  */
+	for (uint64_t pos = 0; pos + sizeof(Elf64_Nhdr) <= size; ) {
+		const Elf64_Nhdr *nhdr = (const void *) (notes + pos);
+		const uint64_t name_pos = pos + sizeof(*nhdr);
+		const uint64_t desc_pos = name_pos + ROUNDUP(nhdr->n_namesz, 4);
+		const uint64_t next = desc_pos + ROUNDUP(nhdr->n_descsz, 4);
+
+		if (next > size || next <= pos)
+			break;
+		if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4
+		    && !memcmp(notes + name_pos, "GNU", 4) && nhdr->n_descsz)
+			return hex_string(notes + desc_pos, nhdr->n_descsz);
+		pos = next;
+	}
+
+	return NULL;
+}
+
+static void
+read_program_headers(const struct elf_image *img, struct elf_symbols *es)
+{
+	const void *ehdr = img->data;
+	const uint64_t phoff = ELF_FIELD(img, ehdr, Ehdr, e_phoff);
+	const unsigned int phnum = ELF_FIELD(img, ehdr, Ehdr, e_phnum);
+	const unsigned int phentsize = ELF_FIELD(img, ehdr, Ehdr, e_phentsize);
+
+	if (phentsize < (img->is64 ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr)))
+		return;
+
+	for (unsigned int i = 0; i < phnum; ++i) {
+		const void *phdr = image_ptr(img, phoff + (uint64_t) i * phentsize,
+					     phentsize);
+		if (!phdr)
+			break;
+
+		switch (ELF_FIELD(img, phdr, Phdr, p_type)) {
+		case PT_LOAD:
+			es->loads = xreallocarray(es->loads, es->nloads + 1,
+						  sizeof(*es->loads));
+			es->loads[es->nloads++] = (struct elf_load_segment) {
+				.offset = ELF_FIELD(img, phdr, Phdr, p_offset),
+				.filesz = ELF_FIELD(img, phdr, Phdr, p_filesz),
+				.vaddr = ELF_FIELD(img, phdr, Phdr, p_vaddr),
+			};
+			break;
+		case PT_NOTE:
+			if (!es->build_id)
+				es->build_id = find_build_id(img, phdr);
+			break;
+		}
+	}
+}
+
+static int
+compare_symbols(const void *a, const void *b)
+{
+	const struct elf_symbol *sa = a;
+	const struct elf_symbol *sb = b;
+
+	return sa->value < sb->value ? -1 : sa->value > sb->value;
+}
+
+/*
+ * Reads the function symbols of SHT_SYMTAB, or of SHT_DYNSYM
+ * if there is no SHT_SYMTAB; returns false if there are none.
+ */
+static bool
+read_symbols(const struct elf_image *img, struct elf_symbols *es)
+{
+	const void *ehdr = img->data;
+	const uint64_t shoff = ELF_FIELD(img, ehdr, Ehdr, e_shoff);
+	const unsigned int shnum = ELF_FIELD(img, ehdr, Ehdr, e_shnum);
+	const unsigned int shentsize = ELF_FIELD(img, ehdr, Ehdr, e_shentsize);
+	const void *symtab = NULL;
+
+	if (!shoff
+	    || shentsize < (img->is64 ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr)))
+		return false;
+
+	for (unsigned int i = 0; i < shnum; ++i) {
+		const void *shdr = image_ptr(img, shoff + (uint64_t) i * shentsize,
+					     shentsize);
+		if (!shdr)
+			return false;
+
+		const unsigned int type = ELF_FIELD(img, shdr, Shdr, sh_type);
+		if (type == SHT_SYMTAB) {
+			symtab = shdr;
+			break;
+		}
+		if (type == SHT_DYNSYM)
+			symtab = shdr;
+	}
+	if (!symtab)
+		return false;
+
+	const unsigned int link = ELF_FIELD(img, symtab, Shdr, sh_link);
+	const void *strtab = link < shnum
+		? image_ptr(img, shoff + (uint64_t) link * shentsize, shentsize)
+		: NULL;
+	if (!strtab)
+		return false;
+
+	const uint64_t str_size = ELF_FIELD(img, strtab, Shdr, sh_size);
+	const char *strs = image_ptr(img, ELF_FIELD(img, strtab, Shdr, sh_offset),
+				     str_size);
+	const uint64_t sym_size = ELF_FIELD(img, symtab, Shdr, sh_size);
+	const unsigned char *syms =
+		image_ptr(img, ELF_FIELD(img, symtab, Shdr, sh_offset), sym_size);
+	const size_t entsize =
+		img->is64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+	if (!strs || !syms)
+		return false;
+
+	size_t n = 0;
+	size_t allocated = 0;
+	struct elf_symbol *res = NULL;
+
+	for (uint64_t pos = 0; pos + entsize <= sym_size; pos += entsize) {
+		const void *sym = syms + pos;
+		const unsigned int info = ELF_FIELD(img, sym, Sym, st_info);
+		const unsigned int type = img->is64 ? ELF64_ST_TYPE(info)
+						    : ELF32_ST_TYPE(info);
+		const uint64_t name = ELF_FIELD(img, sym, Sym, st_name);
+		const uint64_t value = ELF_FIELD(img, sym, Sym, st_value);
+
+		if ((type != STT_FUNC && type != STT_GNU_IFUNC)
+		    || ELF_FIELD(img, sym, Sym, st_shndx) == SHN_UNDEF
+		    || !value || !name || name >= str_size
+		    || !memchr(strs + name, '\0', str_size - name))
+			continue;
+
+		if (n >= allocated)
+			res = xgrowarray(res, &allocated, sizeof(*res));
+		res[n++] = (struct elf_symbol) {
+			.value = value,
+			.size = ELF_FIELD(img, sym, Sym, st_size),
+			.name = strs + name,
+		};
+	}
+
+	if (!n) {
+		free(res);
+		return false;
+	}
+
+	qsort(res, n, sizeof(*res), compare_symbols);
+	es->syms = res;
+	es->nsyms = n;
+
+	return true;
+}
+
+static struct elf_symbols *
+load(const char *path, const bool want_symbols)
+{
+	struct elf_image img;
+
+	if (!map_image(path, &img))
+		return NULL;
+
+	struct elf_symbols *es = xzalloc(sizeof(*es));
+	es->maps[0] = (void *) img.data;
+	es->map_sizes[0] = img.size;
+
+	read_program_headers(&img, es);
+	if (!want_symbols || read_symbols(&img, es) || !es->build_id)
+		return es;
+
+	/* Try the separate debuginfo file of a stripped binary.  */
+	char *debug_path = xasprintf(DEBUG_BUILD_ID_DIR "/%.2s/%s.debug",
+				     es->build_id, es->build_id + 2);
+	struct elf_image debug_img;
+
+	if (strlen(es->build_id) > 2 && map_image(debug_path, &debug_img)) {
+		es->maps[1] = (void *) debug_img.data;
+		es->map_sizes[1] = debug_img.size;
+		read_symbols(&debug_img, es);
+	}
+	free(debug_path);
+
+	return es;
+}
+
+struct elf_symbols *
+elf_symbols_load(const char *path)
+{
+	return load(path, true);
+}
+
+void
+elf_symbols_free(struct elf_symbols *es)
+{
+	if (!es)
+		return;
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(es->maps); ++i) {
+		if (es->maps[i])
+			munmap(es->maps[i], es->map_sizes[i]);
+	}
+	free(es->syms);
+	free(es->loads);
+	free(es->build_id);
+	free(es);
+}
+
+const char *
+elf_symbols_build_id(const struct elf_symbols *es)
+{
+	return es->build_id;
+}
+
+const char *
+elf_symbols_lookup(const struct elf_symbols *es, const uint64_t file_offset,
+		   uint64_t *function_offset)
+{
+	const struct elf_load_segment *load = NULL;
+
+	for (unsigned int i = 0; i < es->nloads; ++i) {
+		if (file_offset >= es->loads[i].offset
+		    && file_offset - es->loads[i].offset < es->loads[i].filesz) {
+			load = &es->loads[i];
+			break;
+		}
+	}
+	if (!load || !es->nsyms)
+		return NULL;
+
+	const uint64_t addr = file_offset - load->offset + load->vaddr;
+
+	/* The last symbol that starts at or before addr.  */
+	size_t lower = 0;
+	size_t upper = es->nsyms;
+
+	while (lower < upper) {
+		size_t mid = lower + (upper - lower) / 2;
+
+		if (es->syms[mid].value <= addr)
+			lower = mid + 1;
+		else
+			upper = mid;
+	}
+	if (!lower)
+		return NULL;
+
+	const struct elf_symbol *sym = &es->syms[lower - 1];
+	if (sym->size && addr - sym->value >= sym->size)
+		return NULL;
+
+	*function_offset = addr - sym->value;
+	return sym->name;
+}
+
+char *
+elf_file_build_id(const char *path)
+{
+	struct elf_symbols *es = load(path, false);
+
+	if (!es)
+		return NULL;
+
+	char *build_id = es->build_id;
+	es->build_id = NULL;
+	elf_symbols_free(es);
+
+	return build_id;
+}
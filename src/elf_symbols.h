@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef STRACE_ELF_SYMBOLS_H
+# define STRACE_ELF_SYMBOLS_H
+
+/*
+ * Symbol tables of ELF files on disk, for symbolizing the file offsets
+ * of stack frames without access to the process they were taken from.
+ *
+ * --symbolize is available in every build of strace, including those
+ * that use libunwind or have no stack tracing support at all, and is
+ * meant to be run on a host other than the traced one, so it cannot
+ * rely on libdw being linked in.  Only .symtab and .dynsym are read,
+ * from the file itself or from its separate debuginfo file found
+ * by build-id.
+ */
+
+struct elf_symbols;
+
+/* Returns NULL if the file cannot be read or is not an ELF file.  */
+extern struct elf_symbols *elf_symbols_load(const char *path);
+extern void elf_symbols_free(struct elf_symbols *);
+
+/* Returns the GNU build-id in hex or NULL if the file has none.  */
+extern const char *elf_symbols_build_id(const struct elf_symbols *);
+
+/*
+ * Finds the function that contains the given offset in the file,
+ * returns its name or NULL if there is no such function.
+ */
+extern const char *elf_symbols_lookup(const struct elf_symbols *,
+				      uint64_t file_offset,
+				      uint64_t *function_offset);
+
+/* Returns the GNU build-id of the file in hex or NULL.  */
+extern char *elf_file_build_id(const char *path);
+
+#endif /* !STRACE_ELF_SYMBOLS_H */
@@ -0,0 +1,226 @@
+/*
+ * Cache of paths associated with file descriptors of tracees.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "defs.h"
+#include "bintrace.h"
+#include "filter_seccomp.h"
+#include "sen.h"
+
+/*
+ * Descriptors with larger numbers are not cached
+ * to keep the per-tcb arrays reasonably small.
+ */
+#define FD_PATH_CACHE_MAX_FD	65536
+
+bool fd_path_cache_enabled;
+
+struct fd_path_cache_entry {
+	char *path;
+	unsigned int len;	/* strlen(path) + 1 */
+	int rc;			/* return value of getfdpath_pid */
+	bool deleted;
+	uint64_t stamp;		/* value of fd_path_clock at the time of fill */
+};
+
+/*
+ * Invalidation does not touch the entries: it records the time of the
+ * invalidation instead, either for the particular descriptor number
+ * in all processes (as processes may share their descriptor tables),
+ * or for all the descriptors.  An entry is valid if it has been filled
+ * after the last invalidation that applies to it.
+ */
+static uint64_t fd_path_clock;
+static uint64_t fd_path_invalidated_all;
+static uint64_t *fd_path_invalidated;
+static size_t fd_path_invalidated_size;
+
+static struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t invalidations;
+} fd_path_cache_stats;
+
+static bool
+fd_path_cache_usable(void)
+{
+	/*
+	 * With seccomp filtering, syscalls that close or replace descriptors
+	 * might be executed without stopping the tracee.
+	 * When replaying, the paths come from the binary trace.
+	 */
+	return fd_path_cache_enabled && !seccomp_filtering &&
+	       !bintrace_replaying;
+}
+
+static void
+invalidate_fd_path(const kernel_ulong_t fd)
+{
+	if (fd < fd_path_invalidated_size) {
+		fd_path_invalidated[fd] = ++fd_path_clock;
+		fd_path_cache_stats.invalidations++;
+	}
+}
+
+static void
+invalidate_fd_path_range(const kernel_ulong_t first, const kernel_ulong_t last)
+{
+	if (first > last || first >= fd_path_invalidated_size)
+		return;
+
+	const kernel_ulong_t end = MIN(last, fd_path_invalidated_size - 1);
+
+	for (kernel_ulong_t fd = first; fd <= end; ++fd)
+		fd_path_invalidated[fd] = ++fd_path_clock;
+	fd_path_cache_stats.invalidations++;
+}
+
+static void
+invalidate_all_fd_paths(void)
+{
+	fd_path_invalidated_all = ++fd_path_clock;
+	fd_path_cache_stats.invalidations++;
+}
+
+void
+update_fd_path_cache(struct tcb *tcp)
+{
+	if (!fd_path_cache_usable())
+		return;
+
+	switch (tcp_sysent(tcp)->sen) {
+	/* descriptors are closed or replaced */
+	case SEN_close:
+		invalidate_fd_path((unsigned int) tcp->u_arg[0]);
+		break;
+	case SEN_dup2:
+	case SEN_dup3:
+		invalidate_fd_path((unsigned int) tcp->u_arg[1]);
+		break;
+	case SEN_close_range:
+		invalidate_fd_path_range((unsigned int) tcp->u_arg[0],
+					 (unsigned int) tcp->u_arg[1]);
+		break;
+	case SEN_execve:
+	case SEN_execveat:
+	case SEN_io_uring_enter:
+	/* paths of open files change */
+	case SEN_rename:
+	case SEN_renameat:
+	case SEN_renameat2:
+	case SEN_rmdir:
+	case SEN_unlink:
+	case SEN_unlinkat:
+	case SEN_mount:
+	case SEN_move_mount:
+	case SEN_umount2:
+	case SEN_pivotroot:
+		invalidate_all_fd_paths();
+		break;
+	}
+}
+
+static void *
+grow_zeroed_array(void *ptr, size_t *const nmemb, const size_t min_nmemb,
+		  const size_t memb_size)
+{
+	const size_t old_nmemb = *nmemb;
+
+	if (old_nmemb >= min_nmemb)
+		return ptr;
+
+	while (*nmemb < min_nmemb)
+		ptr = xgrowarray(ptr, nmemb, memb_size);
+	memset((char *) ptr + old_nmemb * memb_size, 0,
+	       (*nmemb - old_nmemb) * memb_size);
+
+	return ptr;
+}
+
+int
+getfdpath_cached(struct tcb *tcp, int fd, char *buf, unsigned bufsize,
+		 bool *deleted)
+{
+	if (fd < 0 || fd >= FD_PATH_CACHE_MAX_FD || !fd_path_cache_usable())
+		return getfdpath_pid(tcp->pid, fd, buf, bufsize, deleted);
+
+	if ((unsigned int) fd < tcp->fd_path_cache_size) {
+		const struct fd_path_cache_entry *const e =
+			&tcp->fd_path_cache[fd];
+
+		if (e->path && e->len <= bufsize &&
+		    e->stamp > fd_path_invalidated_all &&
+		    e->stamp > fd_path_invalidated[fd]) {
+			fd_path_cache_stats.hits++;
+			memcpy(buf, e->path, e->len);
+			if (deleted)
+				*deleted = e->deleted;
+			if (bintrace_recording)
+				bintrace_record_fd_path(tcp->pid, fd, buf,
+							e->rc, e->deleted);
+			return e->rc;
+		}
+	}
+
+	fd_path_cache_stats.misses++;
+
+	bool is_deleted = false;
+	const int n = getfdpath_pid(tcp->pid, fd, buf, bufsize, &is_deleted);
+
+	if (deleted)
+		*deleted = is_deleted;
+
+	/* Do not cache failures and truncated paths.  */
+	if (n < 0 || (unsigned int) n + 1 >= bufsize)
+		return n;
+
+	tcp->fd_path_cache = grow_zeroed_array(tcp->fd_path_cache,
+					       &tcp->fd_path_cache_size, fd + 1,
+					       sizeof(*tcp->fd_path_cache));
+	fd_path_invalidated = grow_zeroed_array(fd_path_invalidated,
+						&fd_path_invalidated_size,
+						fd + 1,
+						sizeof(*fd_path_invalidated));
+
+	struct fd_path_cache_entry *const e = &tcp->fd_path_cache[fd];
+
+	free(e->path);
+	e->len = strlen(buf) + 1;
+	e->path = xmemdup(buf, e->len);
+	e->rc = n;
+	e->deleted = is_deleted;
+	e->stamp = ++fd_path_clock;
+
+	return n;
+}
+
+void
+free_fd_path_cache(struct tcb *tcp)
+{
+	for (size_t i = 0; i < tcp->fd_path_cache_size; ++i)
+		free(tcp->fd_path_cache[i].path);
+	free(tcp->fd_path_cache);
+	tcp->fd_path_cache = NULL;
+	tcp->fd_path_cache_size = 0;
+}
+
+void
+print_fd_path_cache_stats(void)
+{
+	if (!fd_path_cache_enabled)
+		return;
+
+	const uint64_t lookups =
+		fd_path_cache_stats.hits + fd_path_cache_stats.misses;
+
+	debug_msg("fd path cache: %" PRIu64 " hits, %" PRIu64 " misses"
+		  " (%.1f%% hit rate), %" PRIu64 " invalidations",
+		  fd_path_cache_stats.hits, fd_path_cache_stats.misses,
+		  lookups ? 100.0 * fd_path_cache_stats.hits / lookups : 0.0,
+		  fd_path_cache_stats.invalidations);
+}
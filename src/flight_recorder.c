@@ -0,0 +1,278 @@
+/*
+ * Flight recorder: keeping the recent output in memory until a trigger.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * Every output stream opened with -o is replaced with a stream created
+ * by fopencookie, so that flushing it appends the formatted data
+ * to a ring buffer instead of writing it out.  When the ring is full,
+ * the oldest lines are discarded.  The contents of all rings are written
+ * to the underlying streams on SIGUSR1, when a tracee is killed
+ * by a signal that dumps core, when a syscall matching the trigger
+ * expression exits, and when the stream is closed.
+ */
+
+#include "defs.h"
+#include <signal.h>
+#include "filter.h"
+#include "number_set.h"
+
+unsigned int flight_recorder_size;
+
+/* See --flight-recorder-trigger, NULL if there is no trigger.  */
+static struct number_set *trigger_syscall_set;
+/* The errors that fire the trigger, NULL if any result does.  */
+static struct number_set *trigger_error_set;
+
+#ifdef HAVE_FOPENCOOKIE
+
+struct flight_recorder {
+	FILE *fp;		/* the underlying stream */
+	FILE *rfp;		/* the stream the output is written to */
+	char *buf;
+	size_t size;
+	size_t head;		/* total number of bytes appended */
+	size_t tail;		/* total number of bytes discarded or dumped */
+	struct flight_recorder *next;
+};
+
+static struct flight_recorder *recorders;
+static uint64_t dumps_count;
+static uint64_t discarded_bytes;
+
+/* Discards the oldest data until there are at least len bytes of space.  */
+static void
+make_room(struct flight_recorder *fr, const size_t len)
+{
+	if (fr->head - fr->tail + len <= fr->size)
+		return;
+
+	size_t tail = fr->head + len - fr->size;
+
+	/* Keep the ring starting at the beginning of a line.  */
+	while (tail < fr->head && fr->buf[(tail - 1) % fr->size] != '\n')
+		++tail;
+
+	discarded_bytes += tail - fr->tail;
+	fr->tail = tail;
+}
+
+static ssize_t
+flight_recorder_write(void *cookie, const char *data, size_t size)
+{
+	struct flight_recorder *fr = cookie;
+	const size_t total = size;
+
+	/* Only the end of the data fits.  */
+	if (size > fr->size) {
+		discarded_bytes += size - fr->size;
+		data += size - fr->size;
+		size = fr->size;
+	}
+
+	make_room(fr, size);
+
+	const size_t off = fr->head % fr->size;
+	const size_t first = MIN(size, fr->size - off);
+
+	memcpy(fr->buf + off, data, first);
+	memcpy(fr->buf, data + first, size - first);
+	fr->head += size;
+
+	return total;
+}
+
+/* Writes the contents of the ring to the underlying stream.  */
+static void
+write_ring(struct flight_recorder *fr)
+{
+	const size_t len = fr->head - fr->tail;
+	const size_t off = fr->tail % fr->size;
+	const size_t first = MIN(len, fr->size - off);
+
+	if (fwrite(fr->buf + off, 1, first, fr->fp) != first ||
+	    fwrite(fr->buf, 1, len - first, fr->fp) != len - first ||
+	    fflush(fr->fp))
+		perror_msg("flight recorder output");
+
+	fr->tail = fr->head;
+}
+
+static void
+dump_ring(struct flight_recorder *fr)
+{
+	fflush(fr->rfp);
+	write_ring(fr);
+}
+
+static int
+flight_recorder_close(void *cookie)
+{
+	struct flight_recorder *fr = cookie;
+
+	/* The stream is already flushed.  */
+	write_ring(fr);
+
+	for (struct flight_recorder **p = &recorders; *p; p = &(*p)->next) {
+		if (*p == fr) {
+			*p = fr->next;
+			break;
+		}
+	}
+
+	int rc = fclose(fr->fp);
+	free(fr->buf);
+	free(fr);
+
+	return rc;
+}
+
+FILE *
+flight_recorder_wrap(FILE *fp)
+{
+	struct flight_recorder *fr = xcalloc(1, sizeof(*fr));
+
+	fr->fp = fp;
+	fr->size = flight_recorder_size;
+	fr->buf = xmalloc(fr->size);
+
+	static const cookie_io_functions_t funcs = {
+		.write = flight_recorder_write,
+		.close = flight_recorder_close,
+	};
+
+	fr->rfp = fopencookie(fr, "w", funcs);
+	if (!fr->rfp)
+		perror_msg_and_die("fopencookie");
+
+	fr->next = recorders;
+	recorders = fr;
+
+	return fr->rfp;
+}
+
+void
+flight_recorder_dump(const char *const reason)
+{
+	debug_msg("flight recorder dump: %s", reason);
+	++dumps_count;
+
+	for (struct flight_recorder *fr = recorders; fr; fr = fr->next)
+		dump_ring(fr);
+}
+
+void
+print_flight_recorder_stats(void)
+{
+	if (!flight_recorder_size)
+		return;
+
+	debug_msg("flight recorder: %" PRIu64 " dumps, %" PRIu64
+		  " bytes of output discarded", dumps_count, discarded_bytes);
+}
+
+#else /* !HAVE_FOPENCOOKIE */
+
+FILE *
+flight_recorder_wrap(FILE *fp)
+{
+	return fp;
+}
+
+void
+flight_recorder_dump(const char *const reason)
+{
+}
+
+void
+print_flight_recorder_stats(void)
+{
+}
+
+#endif /* HAVE_FOPENCOOKIE */
+
+static int
+errnostr_to_uint(const char *const str)
+{
+	int err = string_to_uint_upto(str, MAX_ERRNO_VALUE);
+
+	if (err >= 0)
+		return err;
+
+	for (unsigned int i = 1; i < nerrnos; ++i) {
+		if (errnoent[i] && !strcasecmp(str, errnoent[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Parses the trigger expression: a set of syscalls in the -e trace= syntax
+ * optionally followed by ":error=" and a set of errors.
+ */
+void
+qualify_flight_recorder_trigger(const char *const str)
+{
+	char *copy = xstrdup(str);
+	char *errors = strstr(copy, ":error=");
+
+	if (errors) {
+		*errors = '\0';
+		errors += sizeof(":error=") - 1;
+
+		if (!trigger_error_set)
+			trigger_error_set = alloc_number_set_array(1);
+		qualify_tokens(errors, trigger_error_set, errnostr_to_uint,
+			       "error");
+	}
+
+	if (!trigger_syscall_set)
+		trigger_syscall_set =
+			alloc_number_set_array(SUPPORTED_PERSONALITIES);
+	qualify_syscall_tokens(copy, trigger_syscall_set);
+
+	free(copy);
+}
+
+void
+flight_recorder_syscall_exiting(struct tcb *tcp)
+{
+	if (!trigger_syscall_set ||
+	    !is_number_in_set_array(tcp->scno, trigger_syscall_set,
+				    current_personality))
+		return;
+
+	if (trigger_error_set &&
+	    (!syserror(tcp) ||
+	     !is_number_in_set(tcp->u_error, trigger_error_set)))
+		return;
+
+	flight_recorder_dump(tcp_sysent(tcp)->sys_name);
+}
+
+void
+flight_recorder_signalled(const int sig)
+{
+	switch (sig) {
+	case SIGQUIT:
+	case SIGILL:
+	case SIGTRAP:
+	case SIGABRT:
+	case SIGBUS:
+	case SIGFPE:
+	case SIGSEGV:
+	case SIGXCPU:
+	case SIGXFSZ:
+#ifdef SIGSYS
+	case SIGSYS:
+#endif
+		flight_recorder_dump(signame(sig));
+		break;
+	}
+}
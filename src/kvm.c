@@ -31,7 +31,10 @@ static bool dump_kvm_run_structure;
 static struct vcpu_info *
 vcpu_find(struct tcb *const tcp, int fd)
 {
-	for (struct vcpu_info *vcpu_info = tcp->vcpu_info_list;
+	if (!tcp->cold)
+		return NULL;
+
+	for (struct vcpu_info *vcpu_info = tcp->cold->vcpu_info_list;
 	     vcpu_info;
 	     vcpu_info = vcpu_info->next)
 		if (vcpu_info->fd == fd)
@@ -48,8 +51,10 @@ vcpu_alloc(struct tcb *const tcp, int fd, int cpuid)
 	vcpu_info->fd = fd;
 	vcpu_info->cpuid = cpuid;
 
-	vcpu_info->next = tcp->vcpu_info_list;
-	tcp->vcpu_info_list = vcpu_info;
+	struct tcb_cold *const cold = get_tcb_cold(tcp);
+
+	vcpu_info->next = cold->vcpu_info_list;
+	cold->vcpu_info_list = vcpu_info;
 
 	return vcpu_info;
 }
@@ -59,12 +64,16 @@ kvm_vcpu_info_free(struct tcb *tcp)
 {
 	struct vcpu_info *next;
 
-	for (struct vcpu_info *head = tcp->vcpu_info_list; head; head = next) {
+	if (!tcp->cold)
+		return;
+
+	for (struct vcpu_info *head = tcp->cold->vcpu_info_list; head;
+	     head = next) {
 		next = head->next;
 		free(head);
 	}
 
-	tcp->vcpu_info_list = NULL;
+	tcp->cold->vcpu_info_list = NULL;
 }
 
 static void
@@ -7,33 +7,553 @@
 
 #include "defs.h"
 #include <limits.h>
+#include <linux/kcmp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 
 #include "largefile_wrappers.h"
 #include "mmap_cache.h"
 #include "mmap_notify.h"
+#include "scno.h"
+#include "sen.h"
 #include "xstring.h"
 
+#define XLAT_MACROS_ONLY
+# include "xlat/mremap_flags.h"
+#undef XLAT_MACROS_ONLY
+
+/*
+ * Without kcmp(KCMP_VM) there is no way to tell which tracees share
+ * the address space, so every tracee gets a cache of its own
+ * and a change of memory mappings invalidates the caches of all the others.
+ */
 static unsigned int mmap_cache_generation;
+static bool use_mmap_cache;
+static bool share_caches = true;
+
+/* All the caches, for looking up the cache of an address space.  */
+static struct mmap_cache_t *caches;
+
+static struct {
+	uint64_t updates;
+	uint64_t invalidations;
+	uint64_t rebuilds;
+	uint64_t shared;
+} mmap_cache_stats;
+
+/*
+ * Binary filenames are interned, so that the entries that refer
+ * to the same file share the string, and splitting an entry
+ * does not have to copy it.
+ */
+struct mmap_cache_name {
+	struct mmap_cache_name *next;
+	unsigned int refcount;
+	unsigned int hash;
+	char str[];
+};
+
+static struct mmap_cache_name **names;
+static unsigned int names_size;
+static unsigned int names_count;
+
+static unsigned int
+hash_name(const char *str, const size_t len)
+{
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (unsigned char) str[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
 
 static void
-mmap_cache_invalidate(struct tcb *tcp, void *unused)
+grow_names(void)
 {
-	mmap_cache_generation++;
-	debug_func_msg("tgen=%u, ggen=%u, tcp=%p, cache=%p",
-		       tcp->mmap_cache ? tcp->mmap_cache->generation : 0,
-		       mmap_cache_generation, tcp,
-		       tcp->mmap_cache ? tcp->mmap_cache->entry : 0);
+	const unsigned int new_size = names_size ? names_size * 2 : 256;
+	struct mmap_cache_name **new_names =
+		xcalloc(new_size, sizeof(*new_names));
+
+	for (unsigned int i = 0; i < names_size; ++i) {
+		for (struct mmap_cache_name *n = names[i], *next; n; n = next) {
+			next = n->next;
+			n->next = new_names[n->hash & (new_size - 1)];
+			new_names[n->hash & (new_size - 1)] = n;
+		}
+	}
+
+	free(names);
+	names = new_names;
+	names_size = new_size;
 }
 
-void
-mmap_cache_enable(void)
+static char *
+intern_name(const char *str, const size_t len)
 {
-	static bool use_mmap_cache;
+	const unsigned int hash = hash_name(str, len);
+
+	for (struct mmap_cache_name *n =
+		names_size ? names[hash & (names_size - 1)] : NULL;
+	     n; n = n->next) {
+		if (n->hash == hash && !strncmp(n->str, str, len)
+		    && !n->str[len]) {
+			n->refcount++;
+			return n->str;
+		}
+	}
 
-	if (!use_mmap_cache) {
-		mmap_notify_register_client(mmap_cache_invalidate, NULL);
-		use_mmap_cache = true;
+	if (names_count >= names_size)
+		grow_names();
+
+	struct mmap_cache_name *n = xmalloc(sizeof(*n) + len + 1);
+	n->refcount = 1;
+	n->hash = hash;
+	memcpy(n->str, str, len);
+	n->str[len] = '\0';
+	n->next = names[hash & (names_size - 1)];
+	names[hash & (names_size - 1)] = n;
+	names_count++;
+
+	return n->str;
+}
+
+static struct mmap_cache_name *
+name_of(char *str)
+{
+	return (struct mmap_cache_name *)
+		(str - offsetof(struct mmap_cache_name, str));
+}
+
+static char *
+ref_name(char *str)
+{
+	name_of(str)->refcount++;
+	return str;
+}
+
+static void
+release_name(char *str)
+{
+	struct mmap_cache_name *n = name_of(str);
+
+	if (--n->refcount)
+		return;
+
+	struct mmap_cache_name **p = &names[n->hash & (names_size - 1)];
+	while (*p != n)
+		p = &(*p)->next;
+	*p = n->next;
+	names_count--;
+	free(n);
+}
+
+static void
+clear_entries(struct mmap_cache_t *cache)
+{
+	while (cache->size) {
+		unsigned int i = --cache->size;
+		release_name(cache->entry[i].binary_filename);
+		cache->entry[i].binary_filename = NULL;
+	}
+	cache->heap_start = 0;
+}
+
+/* Returns the index of the first entry that ends after addr.  */
+static unsigned int
+lower_bound(const struct mmap_cache_t *cache, const unsigned long addr)
+{
+	unsigned int lower = 0;
+	unsigned int upper = cache->size;
+
+	while (lower < upper) {
+		unsigned int mid = lower + (upper - lower) / 2;
+
+		if (cache->entry[mid].end_addr <= addr)
+			lower = mid + 1;
+		else
+			upper = mid;
+	}
+
+	return lower;
+}
+
+static void
+insert_entry(struct mmap_cache_t *cache, const unsigned int i,
+	     const struct mmap_cache_entry_t *entry)
+{
+	if (cache->size >= cache->allocated) {
+		size_t allocated = cache->allocated;
+		cache->entry = xgrowarray(cache->entry, &allocated,
+					  sizeof(*cache->entry));
+		cache->allocated = allocated;
+	}
+
+	memmove(&cache->entry[i + 1], &cache->entry[i],
+		(cache->size - i) * sizeof(*cache->entry));
+	cache->entry[i] = *entry;
+	cache->size++;
+}
+
+static void
+remove_entries(struct mmap_cache_t *cache, const unsigned int i,
+	       const unsigned int n)
+{
+	for (unsigned int j = i; j < i + n; ++j)
+		release_name(cache->entry[j].binary_filename);
+
+	memmove(&cache->entry[i], &cache->entry[i + n],
+		(cache->size - i - n) * sizeof(*cache->entry));
+	cache->size -= n;
+}
+
+/*
+ * Splits the entry that contains addr (if any) in two at addr,
+ * returns the index of the first entry that starts at or after addr.
+ */
+static unsigned int
+split_at(struct mmap_cache_t *cache, const unsigned long addr)
+{
+	unsigned int i = lower_bound(cache, addr);
+
+	if (i >= cache->size || cache->entry[i].start_addr >= addr)
+		return i;
+
+	struct mmap_cache_entry_t tail = cache->entry[i];
+	tail.mmap_offset += addr - tail.start_addr;
+	tail.start_addr = addr;
+	tail.binary_filename = ref_name(tail.binary_filename);
+	cache->entry[i].end_addr = addr;
+	insert_entry(cache, i + 1, &tail);
+
+	return i + 1;
+}
+
+static void
+remove_range(struct mmap_cache_t *cache, const unsigned long start,
+	     const unsigned long end)
+{
+	const unsigned int i = split_at(cache, start);
+	const unsigned int j = split_at(cache, end);
+
+	remove_entries(cache, i, j - i);
+}
+
+/* Returns true if the kernel would merge the adjacent mappings.  */
+static bool
+can_merge(const struct mmap_cache_entry_t *a,
+	  const struct mmap_cache_entry_t *b)
+{
+	return a->end_addr == b->start_addr
+	       && a->mmap_offset + (a->end_addr - a->start_addr)
+		  == b->mmap_offset
+	       && a->protections == b->protections
+	       && a->major == b->major && a->minor == b->minor
+	       && !strcmp(a->binary_filename, b->binary_filename);
+}
+
+/* Merges the entry i into the previous one if they can be merged.  */
+static void
+merge_with_previous(struct mmap_cache_t *cache, const unsigned int i)
+{
+	if (i == 0 || i >= cache->size
+	    || !can_merge(&cache->entry[i - 1], &cache->entry[i]))
+		return;
+
+	cache->entry[i - 1].end_addr = cache->entry[i].end_addr;
+	remove_entries(cache, i, 1);
+}
+
+/* Adds the mapping of [entry->start_addr, entry->end_addr).  */
+static void
+map_range(struct mmap_cache_t *cache, const struct mmap_cache_entry_t *entry)
+{
+	remove_range(cache, entry->start_addr, entry->end_addr);
+
+	const unsigned int i = lower_bound(cache, entry->start_addr);
+
+	insert_entry(cache, i, entry);
+	merge_with_previous(cache, i + 1);
+	merge_with_previous(cache, i);
+}
+
+static unsigned char
+prot_to_protections(const kernel_ulong_t prot)
+{
+	return ((prot & PROT_READ) ? MMAP_CACHE_PROT_READABLE : 0)
+	       | ((prot & PROT_WRITE) ? MMAP_CACHE_PROT_WRITABLE : 0)
+	       | ((prot & PROT_EXEC) ? MMAP_CACHE_PROT_EXECUTABLE : 0);
+}
+
+static unsigned long
+page_align(const kernel_ulong_t len)
+{
+	const unsigned long mask = get_pagesize() - 1;
+
+	return (len + mask) & ~mask;
+}
+
+/*
+ * The functions below update the cache from the arguments and the result
+ * of a syscall.  They return 1 if the cache has been changed, 0 if it has
+ * not, and -1 if the change cannot be reproduced and the cache has to be
+ * rebuilt from /proc/pid/maps.
+ */
+
+static int
+update_mmap(struct tcb *tcp, struct mmap_cache_t *cache,
+	    const unsigned long long offset)
+{
+	const kernel_ulong_t flags = tcp->u_arg[3];
+
+	if (syserror(tcp)) {
+		/* A failed MAP_FIXED mmap might have unmapped the range.  */
+		return (flags & MAP_FIXED) ? -1 : 0;
+	}
+
+	struct mmap_cache_entry_t entry = {
+		.start_addr = (kernel_ulong_t) tcp->u_rval,
+		.end_addr = (kernel_ulong_t) tcp->u_rval
+			    + page_align(tcp->u_arg[1]),
+		.mmap_offset = offset,
+		.protections = prot_to_protections(tcp->u_arg[2]),
+	};
+
+	if (entry.end_addr <= entry.start_addr)
+		return -1;
+
+	if (flags & MAP_ANONYMOUS) {
+		/*
+		 * Private anonymous mappings are not cached,
+		 * shared ones are shown as "/dev/zero (deleted)".
+		 */
+		if ((flags & MAP_TYPE) != MAP_PRIVATE)
+			return -1;
+		remove_range(cache, entry.start_addr, entry.end_addr);
+		return 1;
+	}
+
+	const int fd = tcp->u_arg[4];
+	char path[PATH_MAX + sizeof(" (deleted)")];
+	bool deleted;
+
+	if (getfdpath_cached(tcp, fd, path, PATH_MAX + 1, &deleted) < 0)
+		return -1;
+
+	char fdpath[sizeof("/proc/%u/fd/%d") + 2 * sizeof(int) * 3];
+	strace_stat_t st;
+
+	xsprintf(fdpath, "/proc/%u/fd/%d", get_proc_pid(tcp->pid), fd);
+	/* The names of special files in maps differ from their fd paths.  */
+	if (stat_file(fdpath, &st) || !S_ISREG(st.st_mode))
+		return -1;
+
+	if (deleted)
+		strcat(path, " (deleted)");
+
+	if ((flags & MAP_TYPE) != MAP_PRIVATE)
+		entry.protections |= MMAP_CACHE_PROT_SHARED;
+	entry.major = major(st.st_dev);
+	entry.minor = minor(st.st_dev);
+	entry.binary_filename = intern_name(path, strlen(path));
+	map_range(cache, &entry);
+
+	return 1;
+}
+
+static int
+update_munmap(struct tcb *tcp, struct mmap_cache_t *cache)
+{
+	if (syserror(tcp))
+		return 0;
+
+	const unsigned long start = tcp->u_arg[0];
+
+	remove_range(cache, start, start + page_align(tcp->u_arg[1]));
+	return 1;
+}
+
+static int
+update_mprotect(struct tcb *tcp, struct mmap_cache_t *cache)
+{
+	/*
+	 * The arguments are checked before any change,
+	 * other errors might leave a part of the range changed.
+	 */
+	if (syserror(tcp))
+		return tcp->u_error == EINVAL ? 0 : -1;
+	if (tcp->u_arg[2] & (PROT_GROWSDOWN | PROT_GROWSUP))
+		return -1;
+
+	const unsigned long start = tcp->u_arg[0];
+	const unsigned long end = start + page_align(tcp->u_arg[1]);
+	const unsigned char protections = prot_to_protections(tcp->u_arg[2]);
+
+	const unsigned int i = split_at(cache, start);
+	const unsigned int j = split_at(cache, end);
+
+	for (unsigned int k = i; k < j; ++k) {
+		cache->entry[k].protections &= MMAP_CACHE_PROT_SHARED;
+		cache->entry[k].protections |= protections;
+	}
+	merge_with_previous(cache, j);
+	merge_with_previous(cache, i);
+
+	return 1;
+}
+
+static int
+update_mremap(struct tcb *tcp, struct mmap_cache_t *cache)
+{
+	const unsigned long old_start = tcp->u_arg[0];
+	const unsigned long old_end = old_start + page_align(tcp->u_arg[1]);
+	const kernel_ulong_t flags = tcp->u_arg[3];
+
+	if (syserror(tcp)) {
+		/* A failed MREMAP_FIXED might have unmapped the new range.  */
+		return (flags & MREMAP_FIXED) ? -1 : 0;
 	}
+
+	/*
+	 * With MREMAP_DONTUNMAP the old range stays mapped,
+	 * old_size of 0 means duplication of a shared mapping.
+	 */
+	if ((flags & MREMAP_DONTUNMAP) || old_end <= old_start)
+		return -1;
+
+	const unsigned long new_start = (kernel_ulong_t) tcp->u_rval;
+	const unsigned long new_end = new_start + page_align(tcp->u_arg[2]);
+	const unsigned int i = lower_bound(cache, old_start);
+	const struct mmap_cache_entry_t *old = &cache->entry[i];
+
+	if (i >= cache->size || old->start_addr >= old_end) {
+		/* The old range is not cached.  */
+		remove_range(cache, new_start, new_end);
+		return 1;
+	}
+
+	/* The old range is always covered by a single mapping.  */
+	if (old->start_addr > old_start || old->end_addr < old_end)
+		return -1;
+
+	struct mmap_cache_entry_t entry = *old;
+	entry.start_addr = new_start;
+	entry.end_addr = new_end;
+	entry.mmap_offset += old_start - old->start_addr;
+	entry.binary_filename = ref_name(entry.binary_filename);
+
+	remove_range(cache, old_start, old_end);
+	map_range(cache, &entry);
+
+	return 1;
+}
+
+static int
+update_brk(struct tcb *tcp, struct mmap_cache_t *cache)
+{
+	/* brk returns the current break even if it fails.  */
+	const unsigned long end = page_align((kernel_ulong_t) tcp->u_rval);
+
+	if (!cache->heap_start) {
+		/*
+		 * There has been no heap since the cache was read,
+		 * so the break that has not been changed is its start.
+		 */
+		if (tcp->u_arg[0])
+			return -1;
+		cache->heap_start = end;
+		return 0;
+	}
+
+	unsigned int i = lower_bound(cache, cache->heap_start);
+	struct mmap_cache_entry_t *heap = &cache->entry[i];
+
+	if (i < cache->size && heap->start_addr == cache->heap_start) {
+		if (strcmp(heap->binary_filename, "[heap]"))
+			return -1;
+		if (heap->end_addr == end)
+			return 0;
+		if (end <= heap->start_addr) {
+			remove_entries(cache, i, 1);
+			return 1;
+		}
+	} else {
+		if (end <= cache->heap_start)
+			return 0;
+
+		/* The heap has been empty, re-create its entry.  */
+		const struct mmap_cache_entry_t entry = {
+			.start_addr = cache->heap_start,
+			.end_addr = cache->heap_start,
+			.protections = MMAP_CACHE_PROT_READABLE
+				       | MMAP_CACHE_PROT_WRITABLE,
+			.binary_filename = intern_name("[heap]", 6),
+		};
+		insert_entry(cache, i, &entry);
+		heap = &cache->entry[i];
+	}
+
+	if (i + 1 < cache->size && cache->entry[i + 1].start_addr < end)
+		return -1;
+
+	heap->end_addr = end;
+	return 1;
+}
+
+static int
+update_entries(struct tcb *tcp, struct mmap_cache_t *cache)
+{
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_mmap:
+		return update_mmap(tcp, cache, tcp->u_arg[5]);
+	case SEN_mmap_4koff:
+		return update_mmap(tcp, cache,
+				   (unsigned long long) tcp->u_arg[5] << 12);
+	case SEN_mmap_pgoff:
+		return update_mmap(tcp, cache,
+				   (unsigned long long) tcp->u_arg[5]
+				   * get_pagesize());
+	case SEN_munmap:
+		return update_munmap(tcp, cache);
+	case SEN_mprotect:
+	case SEN_pkey_mprotect:
+		return update_mprotect(tcp, cache);
+	case SEN_mremap:
+		return update_mremap(tcp, cache);
+	case SEN_brk:
+		return update_brk(tcp, cache);
+	case SEN_execve:
+	case SEN_execveat:
+		/* A successful exec is handled by the caller.  */
+		return 0;
+	default:
+		/* old_mmap, shmat, shmdt, remap_file_pages, etc.  */
+		return -1;
+	}
+}
+
+static void
+release_cache(struct tcb *tcp)
+{
+	struct mmap_cache_t *cache = tcp->mmap_cache;
+
+	tcp->mmap_cache = NULL;
+	if (cache->pid == tcp->pid)
+		cache->pid = 0;
+	if (--cache->refcount)
+		return;
+
+	clear_entries(cache);
+	free(cache->entry);
+
+	struct mmap_cache_t **p = &caches;
+	while (*p != cache)
+		p = &(*p)->next;
+	*p = cache->next;
+	free(cache);
 }
 
 /* deleting the cache */
@@ -48,139 +568,415 @@ delete_mmap_cache(struct tcb *tcp, const char *caller)
 	if (!tcp->mmap_cache)
 		return;
 
-	while (tcp->mmap_cache->size) {
-		unsigned int i = --tcp->mmap_cache->size;
-		free(tcp->mmap_cache->entry[i].binary_filename);
-		tcp->mmap_cache->entry[i].binary_filename = NULL;
+	release_cache(tcp);
+}
+
+/* Returns the cache of the address space of the tracee, if there is one.  */
+static struct mmap_cache_t *
+find_cache(struct tcb *tcp)
+{
+	if (tcp->mmap_cache) {
+		if (!tcp->mmap_cache->pid)
+			tcp->mmap_cache->pid = tcp->pid;
+		return tcp->mmap_cache;
 	}
 
-	free(tcp->mmap_cache->entry);
-	tcp->mmap_cache->entry = NULL;
+	if (!share_caches)
+		return NULL;
 
-	free(tcp->mmap_cache);
-	tcp->mmap_cache = NULL;
+	for (struct mmap_cache_t *cache = caches; cache; cache = cache->next) {
+		if (!cache->pid)
+			continue;
+
+		long rc = syscall(__NR_kcmp, (long) tcp->pid,
+				  (long) cache->pid, KCMP_VM, 0L, 0L);
+		if (rc < 0 && errno != ESRCH) {
+			debug_perror_msg("kcmp(KCMP_VM)");
+			share_caches = false;
+			return NULL;
+		}
+		if (rc)
+			continue;
+
+		cache->refcount++;
+		tcp->mmap_cache = cache;
+		tcp->mmap_cache_generation = 0;
+		mmap_cache_stats.shared++;
+		return cache;
+	}
+
+	return NULL;
 }
 
+static bool
+is_cache_valid(const struct mmap_cache_t *cache)
+{
+	return !cache->invalid
+	       && (share_caches
+		   || cache->global_generation == mmap_cache_generation);
+}
+
+static bool parse_maps(struct tcb *, struct mmap_cache_t *);
+
 /*
- * caching of /proc/ID/maps for each process to speed up stack tracing
- *
- * The cache must be refreshed after syscalls that affect memory mappings,
- * e.g. mmap, mprotect, munmap, execve.
+ * Fetches the next entry starting from *i, merged with the entries
+ * that follow it the way the kernel merges adjacent mappings.
+ * [stack] grows on page faults rather than on syscalls and is skipped.
  */
-extern enum mmap_cache_rebuild_result
-mmap_cache_rebuild_if_invalid(struct tcb *tcp, const char *caller)
+static bool
+next_merged_entry(const struct mmap_cache_t *cache, unsigned int *i,
+		  struct mmap_cache_entry_t *merged)
 {
-	if (tcp->mmap_cache
-	    && tcp->mmap_cache->generation != mmap_cache_generation)
-		delete_mmap_cache(tcp, caller);
+	while (*i < cache->size
+	       && !strcmp(cache->entry[*i].binary_filename, "[stack]"))
+		++*i;
+	if (*i >= cache->size)
+		return false;
 
-	if (tcp->mmap_cache)
-		return MMAP_CACHE_REBUILD_READY;
+	*merged = cache->entry[(*i)++];
+	for (; *i < cache->size; ++*i) {
+		const struct mmap_cache_entry_t *e = &cache->entry[*i];
+
+		if (!can_merge(merged, e))
+			break;
+		merged->end_addr = e->end_addr;
+	}
 
+	return true;
+}
+
+static bool
+same_entries(const struct mmap_cache_entry_t *a,
+	     const struct mmap_cache_entry_t *b)
+{
+	return a->start_addr == b->start_addr && a->end_addr == b->end_addr
+	       && a->mmap_offset == b->mmap_offset
+	       && a->protections == b->protections
+	       && a->major == b->major && a->minor == b->minor
+	       && !strcmp(a->binary_filename, b->binary_filename);
+}
+
+static const char *
+sprint_entry(char *buf, const size_t size,
+	     const struct mmap_cache_entry_t *entry)
+{
+	if (!entry)
+		return "none";
+
+	snprintf(buf, size, "%lx-%lx %c%c%c%c %lx %lx:%lx %s",
+		 entry->start_addr, entry->end_addr,
+		 entry->protections & MMAP_CACHE_PROT_READABLE ? 'r' : '-',
+		 entry->protections & MMAP_CACHE_PROT_WRITABLE ? 'w' : '-',
+		 entry->protections & MMAP_CACHE_PROT_EXECUTABLE ? 'x' : '-',
+		 entry->protections & MMAP_CACHE_PROT_SHARED ? 's' : 'p',
+		 entry->mmap_offset, entry->major, entry->minor,
+		 entry->binary_filename);
+	return buf;
+}
+
+/*
+ * Compares the incrementally updated cache with /proc/pid/maps,
+ * reports the first difference and invalidates the cache if they differ.
+ * This costs a read of maps per syscall and is done under -d only.
+ * Besides the bugs of the updates, the differences are caused by changes
+ * that are not made by the syscalls that change mappings, e.g. renames
+ * of mapped files, and by the changes made by other threads.
+ */
+static void
+check_cache(struct tcb *tcp, struct mmap_cache_t *cache)
+{
+	struct mmap_cache_t maps = { .pid = tcp->pid };
+
+	if (!parse_maps(tcp, &maps))
+		return;
+
+	struct mmap_cache_entry_t a, b;
+	bool have_a, have_b;
+	unsigned int i = 0, j = 0;
+
+	do {
+		have_a = next_merged_entry(cache, &i, &a);
+		have_b = next_merged_entry(&maps, &j, &b);
+	} while (have_a && have_b && same_entries(&a, &b));
+
+	if (have_a || have_b) {
+		char buf_a[PATH_MAX + 80];
+		char buf_b[PATH_MAX + 80];
+
+		debug_msg("mmap cache of pid %d differs from /proc/pid/maps"
+			  " after %s: cached %s, maps %s",
+			  tcp->pid, tcp_sysent(tcp)->sys_name,
+			  sprint_entry(buf_a, sizeof(buf_a),
+				       have_a ? &a : NULL),
+			  sprint_entry(buf_b, sizeof(buf_b),
+				       have_b ? &b : NULL));
+		cache->invalid = true;
+		mmap_cache_stats.invalidations++;
+	}
+
+	clear_entries(&maps);
+	free(maps.entry);
+}
+
+static void
+mmap_cache_update(struct tcb *tcp, const bool have_result, void *unused)
+{
+	if (have_result && !syserror(tcp)
+	    && (tcp_sysent(tcp)->sen == SEN_execve
+		|| tcp_sysent(tcp)->sen == SEN_execveat)) {
+		/* The tracee has got a new address space.  */
+		if (tcp->mmap_cache)
+			release_cache(tcp);
+		if (!share_caches)
+			mmap_cache_generation++;
+		return;
+	}
+
+	struct mmap_cache_t *cache = find_cache(tcp);
+	const bool valid = cache && is_cache_valid(cache);
+
+	if (!share_caches)
+		mmap_cache_generation++;
+
+	if (!valid)
+		return;
+
+	int rc = have_result ? update_entries(tcp, cache) : -1;
+
+	debug_func_msg("tgen=%u, ggen=%u, tcp=%p, cache=%p, rc=%d",
+		       cache->generation, mmap_cache_generation, tcp,
+		       cache->entry, rc);
+
+	if (rc < 0) {
+		cache->invalid = true;
+		mmap_cache_stats.invalidations++;
+		return;
+	}
+
+	if (rc > 0) {
+		cache->generation++;
+		mmap_cache_stats.updates++;
+	}
+	/* The update does not invalidate the cache of the tracee itself.  */
+	cache->global_generation = mmap_cache_generation;
+
+	if (debug_flag)
+		check_cache(tcp, cache);
+}
+
+void
+mmap_cache_enable(void)
+{
+	if (!use_mmap_cache) {
+		mmap_notify_register_client(mmap_cache_update, NULL);
+		use_mmap_cache = true;
+	}
+}
+
+static bool
+parse_hex(const char **p, unsigned long *val)
+{
+	const char *s = *p;
+	unsigned long v = 0;
+
+	for (;; ++s) {
+		unsigned int digit;
+
+		if (*s >= '0' && *s <= '9')
+			digit = *s - '0';
+		else if (*s >= 'a' && *s <= 'f')
+			digit = *s - 'a' + 10;
+		else
+			break;
+		v = (v << 4) | digit;
+	}
+
+	if (s == *p)
+		return false;
+
+	*p = s;
+	*val = v;
+	return true;
+}
+
+static bool
+skip_char(const char **p, const char c)
+{
+	if (**p != c)
+		return false;
+	++*p;
+	return true;
+}
+
+/*
+ * Parses a line of /proc/pid/maps into the entry,
+ * except for the binary filename; returns the pointer to the filename
+ * or NULL if the line cannot be parsed or has no filename.
+ */
+static const char *
+parse_maps_line(const char *s, struct mmap_cache_entry_t *entry)
+{
+	if (!parse_hex(&s, &entry->start_addr) || !skip_char(&s, '-')
+	    || !parse_hex(&s, &entry->end_addr) || !skip_char(&s, ' '))
+		return NULL;
+
+	/* skip mappings that have unknown protection */
+	if ((s[0] != '-' && s[0] != 'r') || (s[1] != '-' && s[1] != 'w')
+	    || (s[2] != '-' && s[2] != 'x') || (s[3] != 'p' && s[3] != 's'))
+		return NULL;
+	entry->protections = (
+		0
+		| ((s[0] == 'r')? MMAP_CACHE_PROT_READABLE  : 0)
+		| ((s[1] == 'w')? MMAP_CACHE_PROT_WRITABLE  : 0)
+		| ((s[2] == 'x')? MMAP_CACHE_PROT_EXECUTABLE: 0)
+		| ((s[3] == 's')? MMAP_CACHE_PROT_SHARED    : 0)
+		);
+	s += 4;
+
+	if (!skip_char(&s, ' ') || !parse_hex(&s, &entry->mmap_offset)
+	    || !skip_char(&s, ' ') || !parse_hex(&s, &entry->major)
+	    || !skip_char(&s, ':') || !parse_hex(&s, &entry->minor)
+	    || !skip_char(&s, ' '))
+		return NULL;
+
+	/* inode */
+	if (*s < '0' || *s > '9')
+		return NULL;
+	while (*s >= '0' && *s <= '9')
+		++s;
+
+	while (*s == ' ')
+		++s;
+	if (*s == '\n' || *s == '\0')
+		return NULL;
+
+	return s;
+}
+
+/* Replaces the entries of the cache with the contents of /proc/pid/maps.  */
+static bool
+parse_maps(struct tcb *tcp, struct mmap_cache_t *cache)
+{
 	char filename[sizeof("/proc/4294967296/maps")];
 	xsprintf(filename, "/proc/%u/maps", get_proc_pid(tcp->pid));
 
 	FILE *fp = fopen_stream(filename, "r");
 	if (!fp) {
 		perror_msg("fopen: %s", filename);
-		return MMAP_CACHE_REBUILD_NOCACHE;
+		return false;
 	}
 
-	struct mmap_cache_t cache = {
-		.free_fn = delete_mmap_cache,
-		.generation = mmap_cache_generation
-	};
+	clear_entries(cache);
 
-	/* start with a small dynamically-allocated array and then expand it */
-	size_t allocated = 0;
 	char buffer[PATH_MAX + 80];
 
 	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-		unsigned long start_addr, end_addr, mmap_offset;
-		char read_bit;
-		char write_bit;
-		char exec_bit;
-		char shared_bit;
-		unsigned long major, minor;
-		char binary_path[sizeof(buffer)];
-
-		if (sscanf(buffer, "%lx-%lx %c%c%c%c %lx %lx:%lx %*d %[^\n]",
-			   &start_addr, &end_addr,
-			   &read_bit, &write_bit, &exec_bit, &shared_bit,
-			   &mmap_offset,
-			   &major, &minor,
-			   binary_path) != 10)
-			continue;
+		struct mmap_cache_entry_t new_entry;
+		const char *binary_path = parse_maps_line(buffer, &new_entry);
 
-		/* skip mappings that have unknown protection */
-		if (!(read_bit == '-' || read_bit == 'r'))
-			continue;
-		if (!(write_bit == '-' || write_bit == 'w'))
-			continue;
-		if (!(exec_bit == '-' || exec_bit == 'x'))
-			continue;
-		if (!(shared_bit == 'p' || shared_bit == 's'))
+		if (!binary_path)
 			continue;
 
-		if (end_addr < start_addr) {
+		if (new_entry.end_addr < new_entry.start_addr) {
 			error_msg("%s: unrecognized file format", filename);
 			break;
 		}
 
+		size_t len = strcspn(binary_path, "\n");
+
 		struct mmap_cache_entry_t *entry;
 		/*
 		 * sanity check to make sure that we're storing
 		 * non-overlapping regions in ascending order
 		 */
-		if (cache.size > 0) {
-			entry = &cache.entry[cache.size - 1];
-			if (entry->start_addr == start_addr &&
-			    entry->end_addr == end_addr) {
+		if (cache->size > 0) {
+			entry = &cache->entry[cache->size - 1];
+			if (entry->start_addr == new_entry.start_addr &&
+			    entry->end_addr == new_entry.end_addr) {
 				/* duplicate entry, e.g. [vsyscall] */
 				continue;
 			}
-			if (start_addr <= entry->start_addr ||
-			    start_addr < entry->end_addr) {
+			if (new_entry.start_addr <= entry->start_addr ||
+			    new_entry.start_addr < entry->end_addr) {
 				debug_msg("%s: overlapping memory region: "
-					  "\"%s\" [%08lx-%08lx] overlaps with "
+					  "\"%.*s\" [%08lx-%08lx] overlaps with "
 					  "\"%s\" [%08lx-%08lx]",
-					  filename, binary_path, start_addr,
-					  end_addr, entry->binary_filename,
+					  filename, (int) len, binary_path,
+					  new_entry.start_addr,
+					  new_entry.end_addr,
+					  entry->binary_filename,
 					  entry->start_addr, entry->end_addr);
 				continue;
 			}
 		}
 
-		if (cache.size >= allocated)
-			cache.entry = xgrowarray(cache.entry, &allocated,
-						 sizeof(*cache.entry));
-
-		entry = &cache.entry[cache.size];
-		entry->start_addr = start_addr;
-		entry->end_addr = end_addr;
-		entry->mmap_offset = mmap_offset;
-		entry->protections = (
-			0
-			| ((read_bit   == 'r')? MMAP_CACHE_PROT_READABLE  : 0)
-			| ((write_bit  == 'w')? MMAP_CACHE_PROT_WRITABLE  : 0)
-			| ((exec_bit   == 'x')? MMAP_CACHE_PROT_EXECUTABLE: 0)
-			| ((shared_bit == 's')? MMAP_CACHE_PROT_SHARED    : 0)
-			);
-		entry->major = major;
-		entry->minor = minor;
-		entry->binary_filename = xstrdup(binary_path);
-		cache.size++;
+		new_entry.binary_filename = intern_name(binary_path, len);
+		if (!strcmp(new_entry.binary_filename, "[heap]"))
+			cache->heap_start = new_entry.start_addr;
+		insert_entry(cache, cache->size, &new_entry);
 	}
 	fclose(fp);
 
-	if (!cache.size)
+	return true;
+}
+
+static bool
+read_maps(struct tcb *tcp, struct mmap_cache_t *cache)
+{
+	if (!parse_maps(tcp, cache))
+		return false;
+
+	mmap_cache_stats.rebuilds++;
+	cache->invalid = false;
+	cache->generation++;
+	cache->global_generation = mmap_cache_generation;
+
+	return true;
+}
+
+/*
+ * caching of /proc/ID/maps for each address space to speed up stack tracing
+ *
+ * The cache is updated after syscalls that affect memory mappings,
+ * e.g. mmap, mprotect, munmap, and is re-read after execve
+ * or when the change cannot be reproduced.
+ */
+extern enum mmap_cache_rebuild_result
+mmap_cache_rebuild_if_invalid(struct tcb *tcp, const char *caller)
+{
+	struct mmap_cache_t *cache = find_cache(tcp);
+
+	if (cache && !is_cache_valid(cache) && !read_maps(tcp, cache))
 		return MMAP_CACHE_REBUILD_NOCACHE;
 
-	tcp->mmap_cache = xobjdup(&cache);
+	if (!cache) {
+		cache = xzalloc(sizeof(*cache));
+		cache->free_fn = delete_mmap_cache;
+		cache->refcount = 1;
+		cache->pid = tcp->pid;
+
+		if (!read_maps(tcp, cache)) {
+			free(cache);
+			return MMAP_CACHE_REBUILD_NOCACHE;
+		}
+
+		cache->next = caches;
+		caches = cache;
+		tcp->mmap_cache = cache;
+		tcp->mmap_cache_generation = 0;
+	}
+
+	if (!cache->size)
+		return MMAP_CACHE_REBUILD_NOCACHE;
+
+	if (tcp->mmap_cache_generation == cache->generation)
+		return MMAP_CACHE_REBUILD_READY;
+
+	tcp->mmap_cache_generation = cache->generation;
 
 	debug_func_msg("tgen=%u, ggen=%u, tcp=%p, cache=%p, caller=%s",
-		       tcp->mmap_cache->generation, mmap_cache_generation,
-		       tcp, tcp->mmap_cache->entry, caller);
+		       cache->generation, mmap_cache_generation,
+		       tcp, cache->entry, caller);
 
 	return MMAP_CACHE_REBUILD_RENEWED;
 }
@@ -191,21 +987,11 @@ mmap_cache_search(struct tcb *tcp, unsigned long ip)
 	if (!tcp->mmap_cache)
 		return NULL;
 
-	int lower = 0;
-	int upper = (int) tcp->mmap_cache->size - 1;
-
-	while (lower <= upper) {
-		int mid = (upper + lower) / 2;
-		struct mmap_cache_entry_t *entry = &tcp->mmap_cache->entry[mid];
+	const unsigned int i = lower_bound(tcp->mmap_cache, ip);
 
-		if (ip >= entry->start_addr &&
-		    ip < entry->end_addr)
-			return entry;
-		else if (ip < entry->start_addr)
-			upper = mid - 1;
-		else
-			lower = mid + 1;
-	}
+	if (i < tcp->mmap_cache->size
+	    && ip >= tcp->mmap_cache->entry[i].start_addr)
+		return &tcp->mmap_cache->entry[i];
 	return NULL;
 }
 
@@ -218,3 +1004,17 @@ mmap_cache_search_custom(struct tcb *tcp, mmap_cache_search_fn fn, void *data)
 	}
 	return NULL;
 }
+
+void
+print_mmap_cache_stats(void)
+{
+	if (!use_mmap_cache)
+		return;
+
+	debug_msg("mmap cache: %" PRIu64 " incremental updates, %" PRIu64
+		  " invalidations, %" PRIu64 " rebuilds from /proc/pid/maps,"
+		  " %" PRIu64 " attaches to shared caches%s",
+		  mmap_cache_stats.updates, mmap_cache_stats.invalidations,
+		  mmap_cache_stats.rebuilds, mmap_cache_stats.shared,
+		  share_caches ? "" : " (sharing disabled)");
+}
@@ -10,13 +10,30 @@
 /*
  * Keep a sorted array of cache entries,
  * so that we can binary search through it.
+ *
+ * The cache is shared by all the tracees that share the address space
+ * and is updated in place from the results of the syscalls that change
+ * memory mappings.
  */
 
 struct mmap_cache_t {
 	struct mmap_cache_entry_t *entry;
 	void (*free_fn)(struct tcb *, const char *caller);
 	unsigned int size;
+	unsigned int allocated;
+	/* Bumped on every change of the entries.  */
 	unsigned int generation;
+	/* The value of the global generation the entries correspond to.  */
+	unsigned int global_generation;
+	/* The number of tcbs that use this cache.  */
+	unsigned int refcount;
+	/* A tracee that uses this cache (0: not known).  */
+	pid_t pid;
+	/* The entries have to be re-read from /proc/pid/maps.  */
+	bool invalid;
+	/* The start address of the [heap] mapping (0: not known).  */
+	unsigned long heap_start;
+	struct mmap_cache_t *next;
 };
 
 struct mmap_cache_entry_t {
@@ -31,6 +48,8 @@ struct mmap_cache_entry_t {
 	 * major       is 0xfc
 	 * minor       is 0x00
 	 * binary_filename is "/lib/libc-2.11.1.so"
+	 *
+	 * binary_filename is interned and must not be modified or freed.
 	 */
 	unsigned long start_addr;
 	unsigned long end_addr;
@@ -67,4 +86,7 @@ mmap_cache_search(struct tcb *, unsigned long ip);
 extern struct mmap_cache_entry_t *
 mmap_cache_search_custom(struct tcb *, mmap_cache_search_fn, void *);
 
+extern void
+print_mmap_cache_stats(void);
+
 #endif /* !STRACE_MMAP_CACHE_H */
@@ -9,12 +9,16 @@
 
 # include "defs.h"
 
-typedef void (*mmap_notify_fn)(struct tcb *, void *);
+/*
+ * The callback is invoked on exiting a syscall that changes memory mappings,
+ * have_result tells whether the result of the syscall has been fetched.
+ */
+typedef void (*mmap_notify_fn)(struct tcb *, bool have_result, void *);
 
 extern void
 mmap_notify_register_client(mmap_notify_fn, void *);
 
 extern void
-mmap_notify_report (struct tcb *);
+mmap_notify_report(struct tcb *, bool have_result);
 
 #endif /* !STRACE_MMAP_NOTIFY_H */
@@ -17,6 +17,7 @@
 #include "xstring.h"
 #include "kernel_fcntl.h"
 #include "number_set.h"
+#include "secontext.h"
 #include <linux/openat2.h>
 #include <linux/fcntl.h>
 
@@ -36,17 +37,9 @@ print_dirfd(struct tcb *tcp, int fd)
 		if (!is_number_in_set(DECODE_FD_PATH, decode_fd_set))
 			goto done;
 
-		int proc_pid = get_proc_pid(tcp->pid);
-		if (!proc_pid)
-			goto done;
-
-		static const char cwd_path[] = "/proc/%u/cwd";
-		char linkpath[sizeof(cwd_path) + sizeof(int) * 3];
-		xsprintf(linkpath, cwd_path, proc_pid);
-
 		char buf[PATH_MAX];
-		ssize_t n = readlink(linkpath, buf, sizeof(buf));
-		if ((size_t) n >= sizeof(buf))
+		int n = getcwdpath_pid(tcp->pid, buf, sizeof(buf));
+		if (n < 0)
 			goto done;
 
 		tprints("<");
@@ -58,9 +51,7 @@ done:		;
 	} else {
 		printfd(tcp, fd);
 	}
-#ifdef ENABLE_SECONTEXT
-	tcp->last_dirfd = fd;
-#endif
+	selinux_set_last_dirfd(tcp, fd);
 }
 
 /*
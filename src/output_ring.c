@@ -0,0 +1,319 @@
+/*
+ * Output of trace logs through in-memory rings drained by writer threads.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * Every output stream opened with -o is replaced with a stream created
+ * by fopencookie, so that flushing it just appends the formatted data
+ * to a ring buffer.  The ring has a single producer (the tracer) and
+ * a single consumer (the writer thread of the stream), so head and tail
+ * are updated without locking; the mutex is used only for sleeping
+ * when the ring is empty (the writer) or full (the tracer, if the policy
+ * is to block).  With -ff, there would be a ring and a writer thread
+ * per process, so --output-ring cannot be used with -ff.
+ */
+
+#include "defs.h"
+
+unsigned int output_ring_size;
+unsigned int output_ring_policy = OUTPUT_RING_BLOCK;
+
+#ifdef HAVE_FOPENCOOKIE
+
+# include <pthread.h>
+# include <signal.h>
+# include <sys/uio.h>
+
+struct output_ring {
+	FILE *fp;		/* the underlying stream */
+	int fd;
+	char *buf;
+	size_t size;
+	size_t head;		/* total number of bytes appended */
+	size_t tail;		/* total number of bytes written out */
+	bool closing;
+	bool writer_sleeping;
+	bool tracer_sleeping;
+	bool failed;
+	uint64_t dropped;
+	pthread_mutex_t lock;
+	pthread_cond_t data_cond;
+	pthread_cond_t space_cond;
+	pthread_t writer;
+	bool writer_started;
+};
+
+/* Accounting of writer threads, for output_ring_finish.  */
+static pthread_mutex_t writers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writers_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int writers_running;
+static uint64_t total_dropped;
+static pid_t rings_owner;
+
+static size_t
+load_acquire(const size_t *p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void
+store_release(size_t *p, const size_t v)
+{
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+/*
+ * A sleeper sets its flag and re-checks the condition under the lock,
+ * the other side publishes its update and then checks the flag,
+ * both with sequentially consistent ordering, so wakeups are not lost.
+ */
+static void
+set_sleeping(bool *flag, const bool v)
+{
+	__atomic_store_n(flag, v, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void
+wake(struct output_ring *r, bool *flag, pthread_cond_t *cond)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(flag, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&r->lock);
+		pthread_cond_signal(cond);
+		pthread_mutex_unlock(&r->lock);
+	}
+}
+
+static bool
+ring_is_closing(struct output_ring *r)
+{
+	return __atomic_load_n(&r->closing, __ATOMIC_SEQ_CST);
+}
+
+static void *
+output_ring_writer(void *arg)
+{
+	struct output_ring *r = arg;
+
+	for (;;) {
+		const size_t head = load_acquire(&r->head);
+		size_t tail = r->tail;
+
+		if (head == tail) {
+			if (ring_is_closing(r) && load_acquire(&r->head) == tail)
+				break;
+
+			pthread_mutex_lock(&r->lock);
+			set_sleeping(&r->writer_sleeping, true);
+			while (load_acquire(&r->head) == r->tail &&
+			       !ring_is_closing(r))
+				pthread_cond_wait(&r->data_cond, &r->lock);
+			set_sleeping(&r->writer_sleeping, false);
+			pthread_mutex_unlock(&r->lock);
+			continue;
+		}
+
+		/* The pending data wraps around at most once.  */
+		const size_t off = tail % r->size;
+		const size_t len = head - tail;
+		const size_t first = MIN(len, r->size - off);
+		struct iovec iov[2] = {
+			{ .iov_base = r->buf + off, .iov_len = first },
+			{ .iov_base = r->buf, .iov_len = len - first },
+		};
+		ssize_t n = len;
+
+		if (!r->failed) {
+			n = writev(r->fd, iov, len > first ? 2 : 1);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				perror_msg("output ring writer");
+				r->failed = true;
+				n = len;
+			}
+		}
+
+		tail += n;
+		store_release(&r->tail, tail);
+		wake(r, &r->tracer_sleeping, &r->space_cond);
+	}
+
+	fclose(r->fp);
+	free(r->buf);
+
+	pthread_mutex_lock(&writers_lock);
+	total_dropped += r->dropped;
+	--writers_running;
+	pthread_cond_broadcast(&writers_cond);
+	pthread_mutex_unlock(&writers_lock);
+
+	pthread_cond_destroy(&r->space_cond);
+	pthread_cond_destroy(&r->data_cond);
+	pthread_mutex_destroy(&r->lock);
+	free(r);
+
+	return NULL;
+}
+
+/*
+ * The writer thread is started on the first write rather than on open,
+ * as the tracer might fork (e.g. with -D) after opening the output.
+ * It is started with all signals blocked, so that the signals the tracer
+ * handles are never delivered to the writer.
+ */
+static void
+start_writer(struct output_ring *r)
+{
+	pthread_attr_t attr;
+	sigset_t all, orig;
+
+	pthread_mutex_lock(&writers_lock);
+	++writers_running;
+	pthread_mutex_unlock(&writers_lock);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &orig);
+	errno = pthread_create(&r->writer, &attr, output_ring_writer, r);
+	if (errno)
+		perror_msg_and_die("pthread_create");
+	pthread_sigmask(SIG_SETMASK, &orig, NULL);
+	pthread_attr_destroy(&attr);
+
+	r->writer_started = true;
+	rings_owner = getpid();
+}
+
+static ssize_t
+output_ring_write(void *cookie, const char *data, size_t size)
+{
+	struct output_ring *r = cookie;
+	const size_t total = size;
+
+	if (!r->writer_started)
+		start_writer(r);
+
+	while (size) {
+		const size_t head = r->head;
+		size_t space = r->size - (head - load_acquire(&r->tail));
+
+		if (space < MIN(size, r->size)) {
+			if (output_ring_policy == OUTPUT_RING_DROP) {
+				r->dropped += size;
+				break;
+			}
+
+			pthread_mutex_lock(&r->lock);
+			set_sleeping(&r->tracer_sleeping, true);
+			while ((space = r->size - (head - load_acquire(&r->tail)))
+			       < MIN(size, r->size))
+				pthread_cond_wait(&r->space_cond, &r->lock);
+			set_sleeping(&r->tracer_sleeping, false);
+			pthread_mutex_unlock(&r->lock);
+		}
+
+		const size_t len = MIN(size, space);
+		const size_t off = head % r->size;
+		const size_t first = MIN(len, r->size - off);
+
+		memcpy(r->buf + off, data, first);
+		memcpy(r->buf, data + first, len - first);
+		store_release(&r->head, head + len);
+		wake(r, &r->writer_sleeping, &r->data_cond);
+
+		data += len;
+		size -= len;
+	}
+
+	return total;
+}
+
+static int
+output_ring_close(void *cookie)
+{
+	struct output_ring *r = cookie;
+
+	if (!r->writer_started) {
+		fclose(r->fp);
+		free(r->buf);
+		free(r);
+		return 0;
+	}
+
+	__atomic_store_n(&r->closing, true, __ATOMIC_SEQ_CST);
+	wake(r, &r->writer_sleeping, &r->data_cond);
+
+	return 0;
+}
+
+FILE *
+output_ring_wrap(FILE *fp)
+{
+	struct output_ring *r = xcalloc(1, sizeof(*r));
+
+	r->fp = fp;
+	r->fd = fileno(fp);
+	r->size = output_ring_size;
+	r->buf = xmalloc(r->size);
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->data_cond, NULL);
+	pthread_cond_init(&r->space_cond, NULL);
+
+	static const cookie_io_functions_t funcs = {
+		.write = output_ring_write,
+		.close = output_ring_close,
+	};
+
+	FILE *rfp = fopencookie(r, "w", funcs);
+	if (!rfp)
+		perror_msg_and_die("fopencookie");
+
+	static bool registered;
+	if (!registered) {
+		atexit(output_ring_finish);
+		registered = true;
+	}
+
+	return rfp;
+}
+
+void
+output_ring_finish(void)
+{
+	/* Writer threads do not survive fork.  */
+	if (rings_owner != getpid())
+		return;
+
+	pthread_mutex_lock(&writers_lock);
+	while (writers_running)
+		pthread_cond_wait(&writers_cond, &writers_lock);
+	pthread_mutex_unlock(&writers_lock);
+
+	if (total_dropped)
+		error_msg("%" PRIu64 " bytes of output dropped because"
+			  " the output ring was full", total_dropped);
+	total_dropped = 0;
+}
+
+#else /* !HAVE_FOPENCOOKIE */
+
+FILE *
+output_ring_wrap(FILE *fp)
+{
+	return fp;
+}
+
+void
+output_ring_finish(void)
+{
+}
+
+#endif /* HAVE_FOPENCOOKIE */
@@ -8,12 +8,14 @@
  */
 
 #include "defs.h"
+#include <fcntl.h>
 #include <limits.h>
 #include <poll.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "bintrace.h"
 #include "largefile_wrappers.h"
 #include "number_set.h"
 #include "sen.h"
@@ -145,11 +147,48 @@ getfdpath_pid(pid_t pid, int fd, char *buf, unsigned bufsize, bool *deleted)
 	if (fd < 0)
 		return -1;
 
+	if (bintrace_replaying)
+		return bintrace_replay_fd_path(pid, fd, buf, bufsize, deleted);
+
+	int proc_pid = get_proc_pid(pid);
+	int rc = proc_pid
+		 ? get_proc_pid_fd_path(proc_pid, fd, buf, bufsize, deleted)
+		 : -1;
+
+	if (bintrace_recording)
+		bintrace_record_fd_path(pid, fd, buf, rc,
+					rc >= 0 && deleted && *deleted);
+
+	return rc;
+}
+
+/*
+ * Get the current working directory of a process with pid.
+ */
+int
+getcwdpath_pid(pid_t pid, char *buf, unsigned bufsize)
+{
+	if (bintrace_replaying)
+		return bintrace_replay_fd_path(pid, AT_FDCWD, buf, bufsize,
+					       NULL);
+
 	int proc_pid = get_proc_pid(pid);
 	if (!proc_pid)
 		return -1;
 
-	return get_proc_pid_fd_path(proc_pid, fd, buf, bufsize, deleted);
+	static const char cwd_path[] = "/proc/%u/cwd";
+	char linkpath[sizeof(cwd_path) + sizeof(int) * 3];
+	xsprintf(linkpath, cwd_path, proc_pid);
+
+	ssize_t n = readlink(linkpath, buf, bufsize);
+	if (n < 0 || (size_t) n >= bufsize)
+		return -1;
+	buf[n] = '\0';
+
+	if (bintrace_recording)
+		bintrace_record_fd_path(pid, AT_FDCWD, buf, n, false);
+
+	return n;
 }
 
 /*
@@ -78,8 +78,33 @@ struct proc_data {
 	unsigned int ns_hierarchy[MAX_NS_DEPTH];
 	int id_count[PT_COUNT];
 	int id_hierarchy[PT_COUNT][MAX_NS_DEPTH];
+	/* Inode number of the /proc entry, 0 if not read from a /proc scan */
+	unsigned long proc_ino;
+	/* Value of proc_scan_count when the entry was last seen in /proc */
+	unsigned int scan;
 };
 
+/**
+ * Number of /proc scans done.  The first scan reads all processes, the later
+ * ones read only processes that have not been seen in /proc before.
+ */
+static unsigned int proc_scan_count;
+
+/**
+ * Value of /proc/sys/kernel/ns_last_pid read before the last /proc scan,
+ * -1 if it is not known.  Every new process or thread gets an id in our
+ * namespace too, so while it stays the same, ids of processes and threads
+ * that have not been found in the last scan are still absent.
+ */
+static int proc_scan_last_pid = -1;
+
+static struct {
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t skipped_scans;
+	uint64_t status_reads;
+} pidns_stats;
+
 /**
  * Helper function for creating a trie.
  *
@@ -286,23 +311,140 @@ get_or_create_proc_data(int proc_pid)
 	return pd;
 }
 
+/**
+ * Parses a tab-separated list of ids of a NS* proc status record.
+ *
+ * @return Number of items stored in id_buf.
+ */
+static int
+parse_id_list(char *p, int *id_buf)
+{
+	int n = 0;
+
+	while (p && n < MAX_NS_DEPTH) {
+		errno = 0;
+		long id = strtol(p, NULL, 10);
+
+		if (id < 0 || id > INT_MAX || errno) {
+			debug_func_perror_msg("converting \"%s\" to int", p);
+			break;
+		}
+
+		id_buf[n++] = (int) id;
+		strsep(&p, "\t");
+	}
+
+	return n;
+}
+
+/**
+ * Reads the id lists of all types from the proc status record at once.
+ *
+ * @return Whether the id list of the PT_TID type has been read.
+ */
+static bool
+read_id_lists(struct proc_data *pd)
+{
+	char status_path[PATH_MAX + 1];
+	xsprintf(status_path, "/proc/%s/status", pid_to_str(pd->proc_pid));
+	FILE *f = fopen_stream(status_path, "r");
+	if (!f)
+		return false;
+
+	pidns_stats.status_reads++;
+
+	char *line = NULL;
+	size_t linesize = 0;
+	int found = 0;
+
+	for (int type = 0; type < PT_COUNT; type++)
+		pd->id_count[type] = 0;
+
+	while (found < PT_COUNT && getline(&line, &linesize, f) > 0) {
+		for (int type = 0; type < PT_COUNT; type++) {
+			if (strncmp(line, id_strs[type].str,
+				    id_strs[type].size))
+				continue;
+
+			pd->id_count[type] =
+				parse_id_list(line + id_strs[type].size,
+					      pd->id_hierarchy[type]);
+			found++;
+			break;
+		}
+	}
+
+	free(line);
+	fclose(f);
+
+	return pd->id_count[PT_TID] > 0;
+}
+
+/**
+ * Puts the ids of the process in all its namespaces to ns_pid_to_proc_pid.
+ */
+static void
+index_proc_data(struct proc_data *pd)
+{
+	for (int type = 0; type < PT_COUNT; type++) {
+		int *id_hierarchy = pd->id_hierarchy[type];
+		int id_count = pd->id_count[type];
+
+		if (id_count < pd->ns_count)
+			continue;
+
+		for (int i = 0; i < pd->ns_count; i++)
+			put_proc_pid(pd->ns_hierarchy[i],
+				     id_hierarchy[id_count - i - 1], type,
+				     pd->proc_pid);
+	}
+}
+
+/**
+ * Removes the proc_data from the cache, along with the ids in
+ * ns_pid_to_proc_pid that point to the process.
+ */
+static void
+drop_proc_data(struct proc_data *pd)
+{
+	for (int type = 0; type < PT_COUNT; type++) {
+		int *id_hierarchy = pd->id_hierarchy[type];
+		int id_count = pd->id_count[type];
+
+		if (id_count < pd->ns_count)
+			continue;
+
+		for (int i = 0; i < pd->ns_count; i++) {
+			unsigned int ns = pd->ns_hierarchy[i];
+			int ns_id = id_hierarchy[id_count - i - 1];
+
+			if (get_cached_proc_pid(ns, ns_id, type) ==
+			    pd->proc_pid)
+				put_proc_pid(ns, ns_id, type, 0);
+		}
+	}
+
+	trie_set(proc_data_cache, pd->proc_pid, (uint64_t) (uintptr_t) NULL);
+	free(pd);
+}
+
 /**
  * Updates the proc_data from /proc
  * If the process does not exists, returns false, and frees the proc_data
  */
 static bool
-update_proc_data(struct proc_data *pd, enum pid_type type)
+update_proc_data(struct proc_data *pd)
 {
 	pd->ns_count = get_ns_hierarchy(pd->proc_pid,
 		pd->ns_hierarchy, MAX_NS_DEPTH);
 	if (!pd->ns_count)
 		goto fail;
 
-	pd->id_count[type] = get_id_list(pd->proc_pid,
-		pd->id_hierarchy[type], type);
-	if (!pd->id_count[type])
+	if (!read_id_lists(pd))
 		goto fail;
 
+	index_proc_data(pd);
+
 	return true;
 
 fail:
@@ -349,7 +491,7 @@ translate_id_proc_pid(struct translate_id_params *tip, int proc_pid)
 	if (!pd)
 		return;
 
-	if (proc_pid && !update_proc_data(pd, tip->type))
+	if (proc_pid && !update_proc_data(pd))
 		return;
 
 	if (!pd->ns_count || pd->id_count[tip->type] < pd->ns_count)
@@ -376,17 +518,35 @@ translate_id_proc_pid(struct translate_id_params *tip, int proc_pid)
 }
 
 /**
- * Translates an id to our namespace by reading all proc entries in a directory.
- * The directory is either /proc or /proc/<pid>/task.
- *
+ * Reads the process into the cache, unless it has been read from the same
+ * /proc entry before.
+ */
+static void
+scan_proc_entry(int proc_pid, unsigned long ino)
+{
+	struct proc_data *pd = get_or_create_proc_data(proc_pid);
+	if (!pd)
+		return;
+
+	if (!ino || pd->proc_ino != ino) {
+		if (!update_proc_data(pd))
+			return;
+
+		pd->proc_ino = ino;
+	}
+
+	pd->scan = proc_scan_count;
+}
+
+/**
+ * Reads all proc entries in a directory into the cache.
+ * The directory is either /proc or /proc/<tgid>/task.
  *
- * @param tip            The parameters
- * @param path           The path of the directory to be read.
- * @param read_task_dir  Whether recurse to "task" subdirectory.
+ * @param path The path of the directory to be read.
+ * @param tgid 0 for /proc, the id of the thread group for its task directory.
  */
 static void
-translate_id_dir(struct translate_id_params *tip, const char *path,
-                 bool read_task_dir)
+scan_proc_dir(const char *path, int tgid)
 {
 	DIR *dir = opendir(path);
 	if (!dir) {
@@ -394,7 +554,7 @@ translate_id_dir(struct translate_id_params *tip, const char *path,
 		return;
 	}
 
-	while (!tip->result_id) {
+	for (;;) {
 		errno = 0;
 		struct_dirent *entry = read_dir(dir);
 		if (!entry) {
@@ -412,47 +572,58 @@ translate_id_dir(struct translate_id_params *tip, const char *path,
 		if (proc_pid < 1 || proc_pid > INT_MAX || errno)
 			continue;
 
-		if (read_task_dir) {
+		/* The thread group leader has been read from /proc/<tgid> */
+		if (proc_pid == tgid)
+			continue;
+
+		scan_proc_entry(proc_pid, entry->d_ino);
+
+		if (!tgid) {
 			char task_dir_path[PATH_MAX + 1];
 			xsprintf(task_dir_path, "/proc/%ld/task", proc_pid);
-			translate_id_dir(tip, task_dir_path, false);
+			scan_proc_dir(task_dir_path, proc_pid);
 		}
-
-		if (tip->result_id)
-			break;
-
-		translate_id_proc_pid(tip, proc_pid);
 	}
 
 	closedir(dir);
 }
 
 /**
- * Iterator function of the proc_data_cache for id translation.
- * If the cache contains the id we are looking for, reads the corresponding
- * directory in /proc, and if cache is valid, saves the result.
+ * Iterator function of the proc_data_cache that drops processes
+ * that have not been seen in the last /proc scan.
  */
 static void
-proc_data_cache_iterator_fn(void* fn_data, uint64_t key, uint64_t val)
+proc_data_cache_sweep_fn(void *fn_data, uint64_t key, uint64_t val)
 {
-	struct translate_id_params *tip = (struct translate_id_params *)fn_data;
 	struct proc_data *pd = (struct proc_data *) (uintptr_t) val;
 
-	if (!pd)
-		return;
+	if (pd && pd->scan != proc_scan_count)
+		drop_proc_data(pd);
+}
 
-	/* Result already found in an earlier iteration */
-	if (tip->result_id)
-		return;
+static int
+read_ns_last_pid(void)
+{
+	int last_pid;
 
-	/* Translate from cache */
-	tip->pd = pd;
-	translate_id_proc_pid(tip, 0);
-	if (!tip->result_id)
-		return;
+	if (read_int_from_file("/proc/sys/kernel/ns_last_pid", &last_pid) < 0)
+		return -1;
 
-	/* Now translate from actual data in /proc, to check cache validity */
-	translate_id_proc_pid(tip, pd->proc_pid);
+	return last_pid;
+}
+
+/**
+ * Brings the cache up to date with /proc in a single pass over all processes
+ * and threads, reading only those that have not been seen before.
+ */
+static void
+scan_proc(void)
+{
+	proc_scan_last_pid = is_proc_ours() ? read_ns_last_pid() : -1;
+	proc_scan_count++;
+	scan_proc_dir("/proc", 0);
+	trie_iterate_keys(proc_data_cache, 0, pid_max - 1,
+		proc_data_cache_sweep_fn, NULL);
 }
 
 int
@@ -485,24 +656,42 @@ translate_pid(struct tcb *tcp, int from_id, enum pid_type type,
 	if (ns_get_parent_enotty)
 		return 0;
 
-	/* Look for a cached proc_pid for this (from_ns, from_id) pair */
+	pidns_stats.lookups++;
+
+	/*
+	 * Look for a cached proc_pid for this (from_ns, from_id) pair,
+	 * the proc data is re-read to check the cache validity.
+	 */
 	int cached_proc_pid = get_cached_proc_pid(tip.from_ns, tip.from_id,
 		tip.type);
 	if (cached_proc_pid) {
 		translate_id_proc_pid(&tip, cached_proc_pid);
-		if (tip.result_id)
+		if (tip.result_id) {
+			pidns_stats.hits++;
 			goto exit;
+		}
 	}
 
-	/* Iterate through the cache, find potential proc_data */
-	trie_iterate_keys(proc_data_cache, 0, pid_max - 1,
-		proc_data_cache_iterator_fn, &tip);
-	/* (proc_data_cache_iterator_fn takes care about updating proc_data) */
-	if (tip.result_id)
+	/*
+	 * Ids of processes and threads never change, so unless a new one
+	 * has been created since the last scan, a new scan would not find
+	 * the id either.  Process groups and sessions can change without
+	 * that, though.
+	 */
+	if ((tip.type == PT_TID || tip.type == PT_TGID) &&
+	    proc_scan_last_pid >= 0 &&
+	    read_ns_last_pid() == proc_scan_last_pid) {
+		pidns_stats.skipped_scans++;
 		goto exit;
+	}
 
-	/* No cache helped, read all entries in /proc */
-	translate_id_dir(&tip, "/proc", true);
+	/* Bring the cache up to date with /proc and try again */
+	scan_proc();
+
+	cached_proc_pid = get_cached_proc_pid(tip.from_ns, tip.from_id,
+		tip.type);
+	if (cached_proc_pid)
+		translate_id_proc_pid(&tip, cached_proc_pid);
 
 exit:
 	if (tip.pd) {
@@ -517,6 +706,43 @@ exit:
 	return tip.result_id;
 }
 
+void
+pidns_add_tracee(struct tcb *tcp)
+{
+	/* Nothing to keep up to date before the first /proc scan */
+	if (!proc_scan_count || !is_proc_ours())
+		return;
+
+	struct proc_data *pd = get_or_create_proc_data(tcp->pid);
+	if (pd)
+		update_proc_data(pd);
+}
+
+void
+pidns_drop_tracee(struct tcb *tcp)
+{
+	if (!proc_scan_count || !is_proc_ours())
+		return;
+
+	struct proc_data *pd = (struct proc_data *) (uintptr_t)
+		trie_get(proc_data_cache, tcp->pid);
+	if (pd)
+		drop_proc_data(pd);
+}
+
+void
+print_pidns_stats(void)
+{
+	if (!pidns_stats.lookups)
+		return;
+
+	debug_msg("pidns translation: %" PRIu64 " lookups, %" PRIu64
+		  " cache hits, %u /proc scans, %" PRIu64 " scans skipped,"
+		  " %" PRIu64 " status reads",
+		  pidns_stats.lookups, pidns_stats.hits, proc_scan_count,
+		  pidns_stats.skipped_scans, pidns_stats.status_reads);
+}
+
 int
 get_proc_pid(int pid)
 {
@@ -0,0 +1,134 @@
+/*
+ * Prefetching of tracee memory referenced by syscall arguments.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "defs.h"
+#include "sen.h"
+
+struct prefetch_args {
+	uint8_t entering;	/* pointer arguments decoded on entering */
+	uint8_t exiting;	/* pointer arguments decoded on exiting */
+};
+
+#define A(n_)	(1U << (n_))
+#define PF(sen_, entering_, exiting_)					\
+	case SEN_ ## sen_:						\
+		return (struct prefetch_args) { (entering_), (exiting_) }
+
+/*
+ * Which arguments of the syscall point to the data that is going
+ * to be fetched by its decoder.  Syscalls that are not listed here
+ * are decoded using on-demand reads only.
+ */
+static struct prefetch_args
+get_prefetch_args(const unsigned int sen)
+{
+	switch (sen) {
+	/* network */
+	PF(sendmsg,		A(1),			0);
+	PF(sendmmsg,		A(1),			0);
+	PF(recvmsg,		0,			A(1));
+	PF(recvmmsg,		0,			A(1));
+	PF(recvmmsg_time32,	0,			A(1));
+	PF(recvmmsg_time64,	0,			A(1));
+	PF(sendto,		A(1) | A(4),		0);
+	PF(recvfrom,		0,			A(1) | A(4) | A(5));
+	PF(connect,		A(1),			0);
+	PF(bind,		A(1),			0);
+	PF(accept,		0,			A(1) | A(2));
+	PF(accept4,		0,			A(1) | A(2));
+	PF(getsockname,		0,			A(1) | A(2));
+	PF(getpeername,		0,			A(1) | A(2));
+	PF(setsockopt,		A(3),			0);
+	PF(getsockopt,		0,			A(3) | A(4));
+	PF(socketpair,		0,			A(3));
+
+	/* I/O */
+	PF(writev,		A(1),			0);
+	PF(pwritev,		A(1),			0);
+	PF(pwritev2,		A(1),			0);
+	PF(readv,		0,			A(1));
+	PF(preadv,		0,			A(1));
+	PF(preadv2,		0,			A(1));
+	PF(io_uring_setup,	A(1),			A(1));
+	PF(io_uring_register,	A(2),			0);
+	PF(epoll_ctl,		A(3),			0);
+	PF(epoll_wait,		0,			A(1));
+	PF(epoll_pwait,		0,			A(1));
+	PF(poll_time32,		A(0),			A(0));
+	PF(poll_time64,		A(0),			A(0));
+	PF(ppoll_time32,	A(0) | A(2) | A(3),	A(0) | A(2));
+	PF(ppoll_time64,	A(0) | A(2) | A(3),	A(0) | A(2));
+	PF(pipe,		0,			A(0));
+	PF(pipe2,		0,			A(0));
+
+	/* files */
+	PF(open,		A(0),			0);
+	PF(openat,		A(1),			0);
+	PF(openat2,		A(1) | A(2),		0);
+	PF(access,		A(0),			0);
+	PF(faccessat,		A(1),			0);
+	PF(faccessat2,		A(1),			0);
+	PF(chdir,		A(0),			0);
+	PF(mkdir,		A(0),			0);
+	PF(mkdirat,		A(1),			0);
+	PF(unlink,		A(0),			0);
+	PF(unlinkat,		A(1),			0);
+	PF(rename,		A(0) | A(1),		0);
+	PF(renameat,		A(1) | A(3),		0);
+	PF(renameat2,		A(1) | A(3),		0);
+	PF(readlink,		A(0),			A(1));
+	PF(readlinkat,		A(1),			A(2));
+	PF(stat,		A(0),			A(1));
+	PF(lstat,		A(0),			A(1));
+	PF(fstat,		0,			A(1));
+	PF(newfstatat,		A(1),			A(2));
+	PF(statx,		A(1),			A(4));
+
+	/* processes and signals */
+	PF(execve,		A(0) | A(1) | A(2),	0);
+	PF(execveat,		A(1) | A(2) | A(3),	0);
+	PF(clone3,		A(0),			0);
+	PF(wait4,		0,			A(1) | A(3));
+	PF(rt_sigaction,	A(1),			A(2));
+	PF(rt_sigprocmask,	A(1),			A(2));
+	PF(nanosleep_time32,	A(0),			0);
+	PF(nanosleep_time64,	A(0),			0);
+	PF(clock_nanosleep_time32, A(2),		0);
+	PF(clock_nanosleep_time64, A(2),		0);
+
+	/* misc */
+	PF(bpf,			A(1),			A(1));
+	}
+
+	return (struct prefetch_args) { 0, 0 };
+}
+
+#undef PF
+#undef A
+
+void
+prefetch_syscall_args(struct tcb *tcp)
+{
+	const struct prefetch_args pa = get_prefetch_args(tcp_sysent(tcp)->sen);
+	const unsigned int mask = entering(tcp) ? pa.entering : pa.exiting;
+
+	if (!mask || raw(tcp))
+		return;
+
+	kernel_ulong_t addrs[MAX_ARGS];
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < MAX_ARGS; ++i) {
+		if ((mask & (1U << i)) && tcp->u_arg[i])
+			addrs[count++] = tcp->u_arg[i];
+	}
+
+	if (count)
+		umove_prefetch(tcp, addrs, count);
+}
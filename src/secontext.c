@@ -163,16 +163,17 @@ selinux_getfilecon(struct tcb *tcp, const char *path, char **secontext,
 
 	int rc = -1;
 	char fname[PATH_MAX];
+	const int last_dirfd = tcp->cold ? tcp->cold->last_dirfd : AT_FDCWD;
 
 	if (path[0] == '/')
 		rc = snprintf(fname, sizeof(fname), "/proc/%u/root%s",
 			       proc_pid, path);
-	else if (tcp->last_dirfd == AT_FDCWD)
+	else if (last_dirfd == AT_FDCWD)
 		rc = snprintf(fname, sizeof(fname), "/proc/%u/cwd/%s",
 			       proc_pid, path);
-	else if (tcp->last_dirfd >= 0 )
+	else if (last_dirfd >= 0 )
 		rc = snprintf(fname, sizeof(fname), "/proc/%u/fd/%u/%s",
-			       proc_pid, tcp->last_dirfd, path);
+			       proc_pid, last_dirfd, path);
 
 	if ((unsigned int) rc >= sizeof(fname))
 		return -1;
@@ -276,3 +277,18 @@ selinux_printpidcon(struct tcb *tcp)
 	print_context(ctx, NULL);
 	tprints("] ");
 }
+
+/*
+ * Records the directory file descriptor the paths of the current syscall
+ * are relative to, AT_FDCWD when there is none.
+ */
+void
+selinux_set_last_dirfd(struct tcb *tcp, int fd)
+{
+	if (number_set_array_is_empty(secontext_set, 0))
+		return;
+	if (fd == AT_FDCWD && !tcp->cold)
+		return;
+
+	get_tcb_cold(tcp)->last_dirfd = fd;
+}
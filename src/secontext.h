@@ -29,12 +29,14 @@ extern struct number_set *secontext_set;
 void selinux_printfdcon(pid_t pid, int fd);
 void selinux_printfilecon(struct tcb *tcp, const char *path);
 void selinux_printpidcon(struct tcb *tcp);
+void selinux_set_last_dirfd(struct tcb *tcp, int fd);
 
 # else
 
 static inline void selinux_printfdcon(pid_t pid, int fd) {}
 static inline void selinux_printfilecon(struct tcb *tcp, const char *path) {}
 static inline void selinux_printpidcon(struct tcb *tcp) {}
+static inline void selinux_set_last_dirfd(struct tcb *tcp, int fd) {}
 
 # endif /* ENABLE_SECONTEXT */
 
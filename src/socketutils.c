@@ -24,37 +24,236 @@
 # define UNIX_PATH_MAX sizeof_field(struct sockaddr_un, sun_path)
 #endif
 
+#include "bintrace.h"
+#include "sen.h"
 #include "xstring.h"
 
 #define XLAT_MACROS_ONLY
 #include "xlat/inet_protocols.h"
 #undef XLAT_MACROS_ONLY
 
-typedef struct {
-	unsigned long inode;
-	char *details;
-} cache_entry;
+/*
+ * Details of sockets are looked up by their inode numbers in a hash table
+ * with open addressing.  A miss for an inet or netlink socket results in
+ * a dump of all sockets of the protocol, and all of them are indexed,
+ * so that the subsequent lookups of other sockets need no round-trips.
+ *
+ * Entries are stamped with the value of sockaddr_clock at the time
+ * of fill.  An entry is valid if it has not been invalidated (the stamp
+ * is reset when the socket is connected or bound by a tracee)
+ * and it has been filled not earlier than the last complete dump
+ * of its protocol (otherwise the socket was missing from that dump).
+ * Invalid entries are dropped when the table is rehashed.
+ */
+struct sockaddr_cache_entry {
+	unsigned long inode;		/* 0 for unused slots */
+	uint64_t stamp;
+	char *details;			/* formatted lazily for inet sockets */
+	const char *proto_name;
+	enum sock_proto proto;
+	uint8_t family;
+	bool has_id;			/* id is known, see inet_query_by_id */
+	struct inet_diag_sockid id;
+};
 
-#define CACHE_SIZE 1024U
-static cache_entry cache[CACHE_SIZE];
-#define CACHE_MASK (CACHE_SIZE - 1)
+static struct sockaddr_cache_entry *cache;
+static unsigned int cache_bits;
+static size_t cache_used;
+static uint64_t sockaddr_clock;
+static uint64_t proto_dump_stamp[SOCK_PROTO_NETLINK + 1];
+
+static struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t dumps;
+	uint64_t targeted;
+	uint64_t round_trips;
+	uint64_t syscalls;		/* that needed round-trips */
+	uint64_t max_round_trips;	/* per syscall */
+} sockaddr_cache_stats;
+
+/* Round-trips of the current syscall, see update_sockaddr_cache.  */
+static uint64_t syscall_round_trips;
+
+static size_t
+cache_slot(const unsigned long inode)
+{
+	return (size_t) (((uint64_t) inode * 0x9e3779b97f4a7c15ULL)
+			 >> (64 - cache_bits));
+}
 
-static int
-cache_inode_details(const unsigned long inode, char *const details)
+static bool
+is_entry_valid(const struct sockaddr_cache_entry *const e)
 {
-	cache_entry *e = &cache[inode & CACHE_MASK];
-	free(e->details);
+	return e->stamp && e->stamp >= proto_dump_stamp[e->proto];
+}
+
+static struct sockaddr_cache_entry *
+find_entry(const unsigned long inode)
+{
+	if (!cache)
+		return NULL;
+
+	const size_t mask = ((size_t) 1 << cache_bits) - 1;
+
+	for (size_t i = cache_slot(inode); cache[i].inode; i = (i + 1) & mask) {
+		if (cache[i].inode == inode)
+			return &cache[i];
+	}
+
+	return NULL;
+}
+
+static void
+rehash_cache(void)
+{
+	struct sockaddr_cache_entry *const old = cache;
+	const size_t old_size = old ? (size_t) 1 << cache_bits : 0;
+	size_t live = 0;
+
+	for (size_t i = 0; i < old_size; ++i) {
+		if (old[i].inode && is_entry_valid(&old[i]))
+			++live;
+	}
+
+	/* Keep the load factor of the new table under 3/8.  */
+	unsigned int bits = 10;
+	while (((size_t) 3 << bits) / 8 <= live)
+		++bits;
+
+	cache = xcalloc((size_t) 1 << bits, sizeof(*cache));
+	cache_bits = bits;
+	cache_used = 0;
+
+	const size_t mask = ((size_t) 1 << bits) - 1;
+
+	for (size_t i = 0; i < old_size; ++i) {
+		if (!old[i].inode)
+			continue;
+		if (!is_entry_valid(&old[i])) {
+			free(old[i].details);
+			continue;
+		}
+
+		size_t j = cache_slot(old[i].inode);
+		while (cache[j].inode)
+			j = (j + 1) & mask;
+		cache[j] = old[i];
+		++cache_used;
+	}
+
+	free(old);
+}
+
+/*
+ * Returns the entry of the inode, either the existing one or a new one,
+ * with the details freed.
+ */
+static struct sockaddr_cache_entry *
+get_entry(const unsigned long inode)
+{
+	struct sockaddr_cache_entry *e = find_entry(inode);
+
+	if (e) {
+		free(e->details);
+		e->details = NULL;
+		return e;
+	}
+
+	/* Keep the load factor of the table under 3/4.  */
+	if (!cache || (cache_used + 1) * 4 > ((size_t) 3 << cache_bits))
+		rehash_cache();
+
+	const size_t mask = ((size_t) 1 << cache_bits) - 1;
+	size_t i = cache_slot(inode);
+
+	while (cache[i].inode)
+		i = (i + 1) & mask;
+
+	e = &cache[i];
 	e->inode = inode;
+	++cache_used;
+
+	return e;
+}
+
+static int
+cache_inode_details(const unsigned long inode, const enum sock_proto proto,
+		    const uint64_t stamp, char *const details)
+{
+	struct sockaddr_cache_entry *const e = get_entry(inode);
+
+	e->stamp = stamp;
 	e->details = details;
+	e->proto = proto;
+	e->has_id = false;
 
 	return 1;
 }
 
+static char *
+format_inet_details(const struct sockaddr_cache_entry *const e)
+{
+	static const char zero_addr[sizeof(struct in6_addr)];
+	socklen_t addr_size, text_size;
+
+	switch (e->family) {
+		case AF_INET:
+			addr_size = sizeof(struct in_addr);
+			text_size = INET_ADDRSTRLEN;
+			break;
+		case AF_INET6:
+			addr_size = sizeof(struct in6_addr);
+			text_size = INET6_ADDRSTRLEN;
+			break;
+		default:
+			return NULL;
+	}
+
+	char src_buf[text_size];
+	char *details;
+
+	/* open/closing brackets for IPv6 addresses */
+	const char *ob = e->family == AF_INET6 ? "[" : "";
+	const char *cb = e->family == AF_INET6 ? "]" : "";
+
+	if (!inet_ntop(e->family, e->id.idiag_src, src_buf, text_size))
+		return NULL;
+
+	if (e->id.idiag_dport ||
+	    memcmp(zero_addr, e->id.idiag_dst, addr_size)) {
+		char dst_buf[text_size];
+
+		if (!inet_ntop(e->family, e->id.idiag_dst, dst_buf, text_size))
+			return NULL;
+
+		if (asprintf(&details, "%s:[%s%s%s:%u->%s%s%s:%u]",
+			     e->proto_name,
+			     ob, src_buf, cb, ntohs(e->id.idiag_sport),
+			     ob, dst_buf, cb, ntohs(e->id.idiag_dport)) < 0)
+			return NULL;
+	} else {
+		if (asprintf(&details, "%s:[%s%s%s:%u]",
+			     e->proto_name, ob, src_buf, cb,
+			     ntohs(e->id.idiag_sport)) < 0)
+			return NULL;
+	}
+
+	return details;
+}
+
 static const char *
 get_sockaddr_by_inode_cached(const unsigned long inode)
 {
-	const cache_entry *const e = &cache[inode & CACHE_MASK];
-	return (e && inode == e->inode) ? e->details : NULL;
+	struct sockaddr_cache_entry *const e = find_entry(inode);
+
+	if (!e || !is_entry_valid(e))
+		return NULL;
+
+	if (!e->details && e->has_id)
+		e->details = format_inet_details(e);
+
+	return e->details;
 }
 
 static bool
@@ -74,6 +273,9 @@ send_query(struct tcb *tcp, const int fd, void *req, size_t req_size)
 		.msg_iovlen = 1
 	};
 
+	sockaddr_cache_stats.round_trips++;
+	syscall_round_trips++;
+
 	for (;;) {
 		if (sendmsg(fd, &msg, 0) < 0) {
 			if (errno == EINTR)
@@ -84,18 +286,29 @@ send_query(struct tcb *tcp, const int fd, void *req, size_t req_size)
 	}
 }
 
+struct diag_query {
+	enum sock_proto proto;
+	const char *proto_name;
+	uint64_t stamp;
+};
+
+/*
+ * Without the id, it is a dump of all sockets of the family and protocol.
+ * With the id, the kernel looks up the socket the id belongs to.
+ */
 static bool
 inet_send_query(struct tcb *tcp, const int fd, const int family,
-		const int proto)
+		const int proto, const struct inet_diag_sockid *const id)
 {
 	struct {
 		const struct nlmsghdr nlh;
-		const struct inet_diag_req_v2 idr;
+		struct inet_diag_req_v2 idr;
 	} req = {
 		.nlh = {
 			.nlmsg_len = sizeof(req),
 			.nlmsg_type = SOCK_DIAG_BY_FAMILY,
-			.nlmsg_flags = NLM_F_DUMP | NLM_F_REQUEST
+			.nlmsg_flags = id ? NLM_F_REQUEST
+					  : NLM_F_DUMP | NLM_F_REQUEST
 		},
 		.idr = {
 			.sdiag_family = family,
@@ -103,6 +316,8 @@ inet_send_query(struct tcb *tcp, const int fd, const int family,
 			.idiag_states = -1
 		}
 	};
+	if (id)
+		req.idr.id = *id;
 	return send_query(tcp, fd, &req, sizeof(req));
 }
 
@@ -110,61 +325,34 @@ static int
 inet_parse_response(const void *const data, const int data_len,
 		    const unsigned long inode, void *opaque_data)
 {
-	const char *const proto_name = opaque_data;
+	const struct diag_query *const q = opaque_data;
 	const struct inet_diag_msg *const diag_msg = data;
-	static const char zero_addr[sizeof(struct in6_addr)];
-	socklen_t addr_size, text_size;
 
 	if (data_len < (int) NLMSG_LENGTH(sizeof(*diag_msg)))
 		return -1;
-	if (diag_msg->idiag_inode != inode)
-		return 0;
 
 	switch (diag_msg->idiag_family) {
 		case AF_INET:
-			addr_size = sizeof(struct in_addr);
-			text_size = INET_ADDRSTRLEN;
-			break;
 		case AF_INET6:
-			addr_size = sizeof(struct in6_addr);
-			text_size = INET6_ADDRSTRLEN;
 			break;
 		default:
 			return -1;
 	}
 
-	char src_buf[text_size];
-	char *details;
-
-	/* open/closing brackets for IPv6 addresses */
-	const char *ob = diag_msg->idiag_family == AF_INET6 ? "[" : "";
-	const char *cb = diag_msg->idiag_family == AF_INET6 ? "]" : "";
-
-	if (!inet_ntop(diag_msg->idiag_family, diag_msg->id.idiag_src,
-		       src_buf, text_size))
-		return -1;
-
-	if (diag_msg->id.idiag_dport ||
-	    memcmp(zero_addr, diag_msg->id.idiag_dst, addr_size)) {
-		char dst_buf[text_size];
-
-		if (!inet_ntop(diag_msg->idiag_family, diag_msg->id.idiag_dst,
-			       dst_buf, text_size))
-			return -1;
-
-		if (asprintf(&details, "%s:[%s%s%s:%u->%s%s%s:%u]", proto_name,
-			     ob, src_buf, cb, ntohs(diag_msg->id.idiag_sport),
-			     ob, dst_buf, cb, ntohs(diag_msg->id.idiag_dport))
-		    < 0)
-			return false;
-	} else {
-		if (asprintf(&details, "%s:[%s%s%s:%u]",
-			     proto_name, ob, src_buf, cb,
-			     ntohs(diag_msg->id.idiag_sport)) < 0)
-			return false;
+	/* Index all sockets, the details are formatted on lookup.  */
+	if (diag_msg->idiag_inode) {
+		struct sockaddr_cache_entry *const e =
+			get_entry(diag_msg->idiag_inode);
+
+		e->stamp = q->stamp;
+		e->proto_name = q->proto_name;
+		e->proto = q->proto;
+		e->family = diag_msg->idiag_family;
+		e->has_id = true;
+		e->id = diag_msg->id;
 	}
 
-	return cache_inode_details(inode, details);
+	return 0;
 }
 
 static bool
@@ -207,6 +395,9 @@ receive_responses(struct tcb *tcp, const int fd, const unsigned long inode,
 		if (!is_nlmsg_ok(h, ret))
 			return false;
 		for (; is_nlmsg_ok(h, ret); h = NLMSG_NEXT(h, ret)) {
+			/* The dump is complete.  */
+			if (h->nlmsg_type == NLMSG_DONE)
+				return true;
 			if (h->nlmsg_type != expected_msg_type)
 				return false;
 			const int rc = parser(NLMSG_DATA(h),
@@ -254,7 +445,7 @@ static int
 unix_parse_response(const void *data, const int data_len,
 		    const unsigned long inode, void *opaque_data)
 {
-	const char *proto_name = opaque_data;
+	const struct diag_query *const q = opaque_data;
 	const struct unix_diag_msg *diag_msg = data;
 	int rta_len = data_len - NLMSG_LENGTH(sizeof(*diag_msg));
 	uint32_t peer = 0;
@@ -320,11 +511,11 @@ unix_parse_response(const void *data, const int data_len,
 	}
 
 	char *details;
-	if (asprintf(&details, "%s:[%lu%s%s]", proto_name, inode,
+	if (asprintf(&details, "%s:[%lu%s%s]", q->proto_name, inode,
 		     peer_str, path_str) < 0)
 		return -1;
 
-	return cache_inode_details(inode, details);
+	return cache_inode_details(inode, q->proto, q->stamp, details);
 }
 
 static bool
@@ -351,72 +542,100 @@ static int
 netlink_parse_response(const void *data, const int data_len,
 		       const unsigned long inode, void *opaque_data)
 {
-	const char *proto_name = opaque_data;
+	const struct diag_query *const q = opaque_data;
 	const struct netlink_diag_msg *const diag_msg = data;
 	const char *netlink_proto;
 	char *details;
 
 	if (data_len < (int) NLMSG_LENGTH(sizeof(*diag_msg)))
 		return -1;
-	if (diag_msg->ndiag_ino != inode)
-		return 0;
-
 	if (diag_msg->ndiag_family != AF_NETLINK)
 		return -1;
+	/* Index all sockets.  */
+	if (!diag_msg->ndiag_ino)
+		return 0;
 
 	netlink_proto = xlookup(netlink_protocols,
 				diag_msg->ndiag_protocol);
 
 	if (netlink_proto) {
 		netlink_proto = STR_STRIP_PREFIX(netlink_proto, "NETLINK_");
-		if (asprintf(&details, "%s:[%s:%u]", proto_name,
+		if (asprintf(&details, "%s:[%s:%u]", q->proto_name,
 			     netlink_proto, diag_msg->ndiag_portid) < 0)
 			return -1;
 	} else {
-		if (asprintf(&details, "%s:[%u]", proto_name,
+		if (asprintf(&details, "%s:[%u]", q->proto_name,
 			     (unsigned) diag_msg->ndiag_protocol) < 0)
 			return -1;
 	}
 
-	return cache_inode_details(inode, details);
+	cache_inode_details(diag_msg->ndiag_ino, q->proto, q->stamp, details);
+	return 0;
 }
 
 static const char *
 unix_get(struct tcb *tcp, const int fd, const int family, const int proto,
-	 const unsigned long inode, const char *name)
+	 const unsigned long inode, const struct diag_query *const q)
 {
 	return unix_send_query(tcp, fd, inode)
 		&& receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
-				     unix_parse_response, (void *) name)
+				     unix_parse_response, (void *) q)
 		? get_sockaddr_by_inode_cached(inode) : NULL;
 }
 
 static const char *
 inet_get(struct tcb *tcp, const int fd, const int family, const int protocol,
-	 const unsigned long inode, const char *proto_name)
+	 const unsigned long inode, const struct diag_query *const q)
 {
-	return inet_send_query(tcp, fd, family, protocol)
-		&& receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
-				     inet_parse_response, (void *) proto_name)
-		? get_sockaddr_by_inode_cached(inode) : NULL;
+	const struct sockaddr_cache_entry *const e = find_entry(inode);
+
+	/*
+	 * The id of a socket that has been seen before is enough
+	 * for the kernel to find it without dumping all sockets;
+	 * it is forgotten when the socket is bound or connected,
+	 * see update_sockaddr_cache.
+	 */
+	if (e && e->has_id && e->proto == q->proto) {
+		const struct inet_diag_sockid id = e->id;
+
+		sockaddr_cache_stats.targeted++;
+		if (inet_send_query(tcp, fd, family, protocol, &id)) {
+			receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
+					  inet_parse_response, (void *) q);
+			const char *const details =
+				get_sockaddr_by_inode_cached(inode);
+			if (details)
+				return details;
+		}
+	}
+
+	sockaddr_cache_stats.dumps++;
+	if (!inet_send_query(tcp, fd, family, protocol, NULL))
+		return NULL;
+	if (receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
+			      inet_parse_response, (void *) q))
+		proto_dump_stamp[q->proto] = q->stamp;
+	return get_sockaddr_by_inode_cached(inode);
 }
 
 static const char *
 netlink_get(struct tcb *tcp, const int fd, const int family, const int protocol,
-	    const unsigned long inode, const char *proto_name)
+	    const unsigned long inode, const struct diag_query *const q)
 {
-	return netlink_send_query(tcp, fd, inode)
-		&& receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
-				     netlink_parse_response,
-				     (void *) proto_name)
-		? get_sockaddr_by_inode_cached(inode) : NULL;
+	sockaddr_cache_stats.dumps++;
+	if (!netlink_send_query(tcp, fd, inode))
+		return NULL;
+	if (receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
+			      netlink_parse_response, (void *) q))
+		proto_dump_stamp[q->proto] = q->stamp;
+	return get_sockaddr_by_inode_cached(inode);
 }
 
 static const struct {
 	const char *const name;
 	const char * (*const get)(struct tcb *, int fd, int family,
 				  int protocol, unsigned long inode,
-				  const char *proto_name);
+				  const struct diag_query *);
 	int family;
 	int proto;
 } protocols[] = {
@@ -496,19 +715,28 @@ get_sockaddr_by_inode_lookup(struct tcb *tcp, const unsigned long inode,
 	const char *details = NULL;
 
 	if (proto != SOCK_PROTO_UNKNOWN) {
+		const struct diag_query q = {
+			.proto = proto,
+			.proto_name = protocols[proto].name,
+			.stamp = ++sockaddr_clock
+		};
 		details = protocols[proto].get(tcp, fd, protocols[proto].family,
 					       protocols[proto].proto, inode,
-					       protocols[proto].name);
+					       &q);
 	} else {
 		for (unsigned int i = (unsigned int) SOCK_PROTO_UNKNOWN + 1;
 		     i < ARRAY_SIZE(protocols); ++i) {
 			if (!protocols[i].get)
 				continue;
+			const struct diag_query q = {
+				.proto = i,
+				.proto_name = protocols[i].name,
+				.stamp = ++sockaddr_clock
+			};
 			details = protocols[i].get(tcp, fd,
 						   protocols[i].family,
 						   protocols[i].proto,
-						   inode,
-						   protocols[i].name);
+						   inode, &q);
 			if (details)
 				break;
 		}
@@ -545,8 +773,67 @@ get_sockaddr_by_inode(struct tcb *const tcp, const int fd,
 		      const unsigned long inode)
 {
 	const char *details = get_sockaddr_by_inode_cached(inode);
-	return details ? details :
-		get_sockaddr_by_inode_uncached(tcp, inode, getfdproto(tcp, fd));
+
+	if (details) {
+		sockaddr_cache_stats.hits++;
+		return details;
+	}
+
+	sockaddr_cache_stats.misses++;
+	return get_sockaddr_by_inode_uncached(tcp, inode, getfdproto(tcp, fd));
+}
+
+void
+update_sockaddr_cache(struct tcb *tcp)
+{
+	if (syscall_round_trips) {
+		sockaddr_cache_stats.syscalls++;
+		if (sockaddr_cache_stats.max_round_trips < syscall_round_trips)
+			sockaddr_cache_stats.max_round_trips =
+				syscall_round_trips;
+		syscall_round_trips = 0;
+	}
+
+	if (!cache_used || bintrace_replaying)
+		return;
+
+	switch (tcp_sysent(tcp)->sen) {
+	/* addresses of the socket change */
+	case SEN_bind:
+	case SEN_connect: {
+		const unsigned long inode =
+			getfdinode(tcp, (int) tcp->u_arg[0]);
+		struct sockaddr_cache_entry *const e =
+			inode ? find_entry(inode) : NULL;
+
+		/*
+		 * Neither the details nor the id are valid anymore,
+		 * the next lookup has to dump all sockets.
+		 */
+		if (e) {
+			e->stamp = 0;
+			e->has_id = false;
+		}
+		break;
+	}
+	}
+}
+
+void
+print_sockaddr_cache_stats(void)
+{
+	if (!sockaddr_cache_stats.hits && !sockaddr_cache_stats.misses)
+		return;
+
+	debug_msg("socket details cache: %" PRIu64 " hits, %" PRIu64
+		  " misses, %" PRIu64 " dumps, %" PRIu64 " targeted queries,"
+		  " %" PRIu64 " netlink round-trips in %" PRIu64 " syscalls"
+		  " (max %" PRIu64 " per syscall)",
+		  sockaddr_cache_stats.hits, sockaddr_cache_stats.misses,
+		  sockaddr_cache_stats.dumps, sockaddr_cache_stats.targeted,
+		  sockaddr_cache_stats.round_trips,
+		  sockaddr_cache_stats.syscalls,
+		  sockaddr_cache_stats.max_round_trips);
 }
 
 /*
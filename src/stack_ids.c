@@ -0,0 +1,491 @@
+/*
+ * Deduplicated stack traces.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * The stacks file is a text file that starts with STACK_IDS_HEADER line,
+ * every mapped file and every unique stack is recorded there once,
+ * before the first stack that refers to it:
+ *
+ * M <id> <build-id or -> <path>
+ * S <id> <file id>+0x<offset> ...
+ *
+ * Frames that are not in any mapped file have file id 0
+ * and the address instead of the offset.
+ */
+
+#include "defs.h"
+#include "elf_symbols.h"
+#include "largefile_wrappers.h"
+#include "stack_ids.h"
+
+#if defined ENABLE_STACKTRACE && defined USE_DEMANGLE
+/* Avoids including libiberty.h that has several undesirable definitions */
+# define LIBIBERTY_H
+
+# if defined HAVE_DEMANGLE_H
+#  include <demangle.h>
+# elif defined HAVE_LIBIBERTY_DEMANGLE_H
+#  include <libiberty/demangle.h>
+# endif /* HAVE_DEMANGLE_H */
+#endif
+
+#define STACK_IDS_HEADER "# strace stack ids 1"
+
+bool stack_trace_ids;
+
+struct stack_module {
+	char *path;
+	char *build_id;
+	struct elf_symbols *syms;
+	bool syms_loaded;
+	unsigned int id;
+	unsigned int hash;
+	struct stack_module *next;
+};
+
+struct stack {
+	struct stack_ids_frame *frames;
+	unsigned int nframes;
+	unsigned int id;
+	unsigned int hash;
+	struct stack *next;
+};
+
+/* Indexed by id - 1.  */
+static struct stack_module **modules;
+static size_t modules_allocated;
+static unsigned int nmodules;
+static struct stack **stacks;
+static size_t stacks_allocated;
+static unsigned int nstacks;
+
+/* Hash tables of chains, their sizes are powers of 2.  */
+static struct stack_module **module_hash;
+static unsigned int module_hash_size;
+static struct stack **stack_hash;
+static unsigned int stack_hash_size;
+
+static FILE *stacks_fp;
+static const char *stacks_fname;
+static uint64_t stack_lookups;
+
+static unsigned int
+hash_bytes(unsigned int hash, const void *data, const size_t len)
+{
+	const unsigned char *p = data;
+
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= p[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static unsigned int
+hash_frames(const struct stack_ids_frame *frames, const unsigned int nframes)
+{
+	unsigned int hash = 2166136261U;
+
+	for (unsigned int i = 0; i < nframes; ++i) {
+		hash = hash_bytes(hash, &frames[i].module,
+				  sizeof(frames[i].module));
+		hash = hash_bytes(hash, &frames[i].offset,
+				  sizeof(frames[i].offset));
+	}
+
+	return hash;
+}
+
+static void
+grow_module_hash(void)
+{
+	const unsigned int new_size =
+		module_hash_size ? module_hash_size * 2 : 64;
+	struct stack_module **new_hash = xcalloc(new_size, sizeof(*new_hash));
+
+	for (unsigned int i = 0; i < nmodules; ++i) {
+		struct stack_module *m = modules[i];
+		m->next = new_hash[m->hash & (new_size - 1)];
+		new_hash[m->hash & (new_size - 1)] = m;
+	}
+
+	free(module_hash);
+	module_hash = new_hash;
+	module_hash_size = new_size;
+}
+
+static void
+grow_stack_hash(void)
+{
+	const unsigned int new_size =
+		stack_hash_size ? stack_hash_size * 2 : 1024;
+	struct stack **new_hash = xcalloc(new_size, sizeof(*new_hash));
+
+	for (unsigned int i = 0; i < nstacks; ++i) {
+		struct stack *s = stacks[i];
+		s->next = new_hash[s->hash & (new_size - 1)];
+		new_hash[s->hash & (new_size - 1)] = s;
+	}
+
+	free(stack_hash);
+	stack_hash = new_hash;
+	stack_hash_size = new_size;
+}
+
+static struct stack_module *
+add_module(const char *path, char *build_id, const unsigned int hash)
+{
+	struct stack_module *m = xzalloc(sizeof(*m));
+
+	m->path = xstrdup(path);
+	m->build_id = build_id;
+	m->hash = hash;
+	m->id = nmodules + 1;
+
+	if (nmodules >= modules_allocated)
+		modules = xgrowarray(modules, &modules_allocated,
+				     sizeof(*modules));
+	modules[nmodules++] = m;
+
+	return m;
+}
+
+static struct stack *
+add_stack(const struct stack_ids_frame *frames, const unsigned int nframes,
+	  const unsigned int hash)
+{
+	struct stack *s = xmalloc(sizeof(*s));
+
+	s->frames = xallocarray(nframes, sizeof(*frames));
+	memcpy(s->frames, frames, nframes * sizeof(*frames));
+	s->nframes = nframes;
+	s->id = nstacks + 1;
+	s->hash = hash;
+	s->next = NULL;
+
+	if (nstacks >= stacks_allocated)
+		stacks = xgrowarray(stacks, &stacks_allocated,
+				    sizeof(*stacks));
+	stacks[nstacks++] = s;
+
+	return s;
+}
+
+void
+stack_ids_start(const char *fname)
+{
+	if (!fname)
+		return;
+
+	stacks_fp = fopen_stream(fname, "w");
+	if (!stacks_fp)
+		perror_msg_and_die("%s", fname);
+	stacks_fname = fname;
+	fputs(STACK_IDS_HEADER "\n", stacks_fp);
+}
+
+/* Mapped files that cannot be read in the same state as they were mapped.  */
+static bool
+is_pseudo_path(const char *path)
+{
+	static const char deleted[] = " (deleted)";
+	const size_t len = strlen(path);
+
+	return path[0] != '/'
+	       || (len >= sizeof(deleted) - 1
+		   && !strcmp(path + len - (sizeof(deleted) - 1), deleted));
+}
+
+unsigned int
+stack_ids_module(const char *path)
+{
+	const unsigned int hash = hash_bytes(2166136261U, path, strlen(path));
+
+	for (struct stack_module *m =
+		module_hash_size ? module_hash[hash & (module_hash_size - 1)]
+				 : NULL;
+	     m; m = m->next) {
+		if (m->hash == hash && !strcmp(m->path, path))
+			return m->id;
+	}
+
+	struct stack_module *m =
+		add_module(path, is_pseudo_path(path)
+				 ? NULL : elf_file_build_id(path), hash);
+
+	if (nmodules > module_hash_size)
+		grow_module_hash();
+	else {
+		m->next = module_hash[hash & (module_hash_size - 1)];
+		module_hash[hash & (module_hash_size - 1)] = m;
+	}
+
+	if (stacks_fp)
+		fprintf(stacks_fp, "M %u %s %s\n", m->id,
+			m->build_id ? m->build_id : "-", m->path);
+
+	return m->id;
+}
+
+static bool
+same_frames(const struct stack *s, const struct stack_ids_frame *frames,
+	    const unsigned int nframes)
+{
+	if (s->nframes != nframes)
+		return false;
+
+	for (unsigned int i = 0; i < nframes; ++i) {
+		if (s->frames[i].module != frames[i].module
+		    || s->frames[i].offset != frames[i].offset)
+			return false;
+	}
+
+	return true;
+}
+
+unsigned int
+stack_ids_stack(const struct stack_ids_frame *frames,
+		const unsigned int nframes)
+{
+	const unsigned int hash = hash_frames(frames, nframes);
+
+	stack_lookups++;
+
+	for (struct stack *s =
+		stack_hash_size ? stack_hash[hash & (stack_hash_size - 1)]
+				: NULL;
+	     s; s = s->next) {
+		if (s->hash == hash && same_frames(s, frames, nframes))
+			return s->id;
+	}
+
+	struct stack *s = add_stack(frames, nframes, hash);
+
+	if (nstacks > stack_hash_size)
+		grow_stack_hash();
+	else {
+		s->next = stack_hash[hash & (stack_hash_size - 1)];
+		stack_hash[hash & (stack_hash_size - 1)] = s;
+	}
+
+	if (stacks_fp) {
+		fprintf(stacks_fp, "S %u", s->id);
+		for (unsigned int i = 0; i < nframes; ++i)
+			fprintf(stacks_fp, " %u+0x%" PRIx64,
+				frames[i].module, frames[i].offset);
+		fputc('\n', stacks_fp);
+	}
+
+	return s->id;
+}
+
+static const struct elf_symbols *
+get_module_symbols(struct stack_module *m)
+{
+	if (m->syms_loaded)
+		return m->syms;
+	m->syms_loaded = true;
+
+	if (is_pseudo_path(m->path))
+		return NULL;
+
+	m->syms = elf_symbols_load(m->path);
+	if (!m->syms || !m->build_id)
+		return m->syms;
+
+	const char *build_id = elf_symbols_build_id(m->syms);
+	if (!build_id || strcmp(build_id, m->build_id)) {
+		error_msg("%s: build-id does not match the traced file,"
+			  " not symbolizing", m->path);
+		elf_symbols_free(m->syms);
+		m->syms = NULL;
+	}
+
+	return m->syms;
+}
+
+/*
+ * Keep the format used for stack trace entries by unwind.c,
+ * see STACK_ENTRY_SYMBOL_FMT there.
+ */
+static void
+print_frame(FILE *fp, const struct stack_ids_frame *frame)
+{
+	if (!frame->module || frame->module > nmodules) {
+		fprintf(fp, " > ?? [0x%" PRIx64 "]\n", frame->offset);
+		return;
+	}
+
+	struct stack_module *m = modules[frame->module - 1];
+	const struct elf_symbols *syms = get_module_symbols(m);
+	uint64_t function_offset = 0;
+	const char *symbol_name =
+		syms ? elf_symbols_lookup(syms, frame->offset,
+					  &function_offset)
+		     : NULL;
+
+	if (!symbol_name) {
+		fprintf(fp, " > %s() [0x%" PRIx64 "]\n", m->path, frame->offset);
+		return;
+	}
+
+#if defined ENABLE_STACKTRACE && defined USE_DEMANGLE
+	char *demangled_name =
+		cplus_demangle(symbol_name, DMGL_AUTO | DMGL_PARAMS);
+#endif
+	fprintf(fp, " > %s(%s+0x%" PRIx64 ") [0x%" PRIx64 "]\n",
+		m->path,
+#if defined ENABLE_STACKTRACE && defined USE_DEMANGLE
+		demangled_name ? demangled_name :
+#endif
+		symbol_name,
+		function_offset, frame->offset);
+#if defined ENABLE_STACKTRACE && defined USE_DEMANGLE
+	free(demangled_name);
+#endif
+}
+
+static void
+print_stacks(FILE *fp)
+{
+	for (unsigned int i = 0; i < nstacks; ++i) {
+		fprintf(fp, "stack #%u:\n", stacks[i]->id);
+		for (unsigned int j = 0; j < stacks[i]->nframes; ++j)
+			print_frame(fp, &stacks[i]->frames[j]);
+	}
+}
+
+void
+stack_ids_finish(FILE *fp)
+{
+	if (stacks_fp) {
+		if (fclose(stacks_fp))
+			perror_msg("%s", stacks_fname);
+		stacks_fp = NULL;
+	} else {
+		print_stacks(fp);
+	}
+
+	debug_msg("stack ids: %" PRIu64 " stack traces, %u unique stacks,"
+		  " %u mapped files", stack_lookups, nstacks, nmodules);
+}
+
+static char *
+parse_module(char *line, unsigned int *id, char **build_id)
+{
+	char *end;
+
+	*id = strtoul(line, &end, 10);
+	if (end == line || *end != ' ')
+		return NULL;
+
+	*build_id = end + 1;
+	char *path = strchr(*build_id, ' ');
+	if (!path || path == *build_id || !path[1])
+		return NULL;
+	*path++ = '\0';
+
+	return path;
+}
+
+static bool
+parse_stack(char *line, struct stack_ids_frame **frames, size_t *allocated,
+	    unsigned int *nframes, unsigned int *id)
+{
+	char *end;
+
+	*id = strtoul(line, &end, 10);
+	if (end == line)
+		return false;
+	*nframes = 0;
+
+	for (line = end; *line == ' '; line = end) {
+		struct stack_ids_frame frame;
+
+		frame.module = strtoul(line + 1, &end, 10);
+		if (end == line + 1 || end[0] != '+')
+			return false;
+		line = end + 1;
+		frame.offset = strtoull(line, &end, 16);
+		if (end == line)
+			return false;
+
+		if (*nframes >= *allocated)
+			*frames = xgrowarray(*frames, allocated,
+					     sizeof(**frames));
+		(*frames)[(*nframes)++] = frame;
+	}
+
+	return !*line;
+}
+
+void
+stack_ids_symbolize(const char *fname, FILE *fp)
+{
+	FILE *in = fopen_stream(fname, "r");
+	if (!in)
+		perror_msg_and_die("%s", fname);
+
+	char *line = NULL;
+	size_t line_size = 0;
+	struct stack_ids_frame *frames = NULL;
+	size_t frames_allocated = 0;
+	unsigned long lineno = 0;
+	ssize_t len;
+
+	while ((len = getline(&line, &line_size, in)) > 0) {
+		++lineno;
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		if (lineno == 1 && strcmp(line, STACK_IDS_HEADER))
+			error_msg_and_die("%s: not a stacks file", fname);
+
+		unsigned int id;
+		unsigned int nframes;
+		char *build_id;
+		char *path;
+
+		switch (line[0]) {
+		case '#':
+		case '\0':
+			continue;
+		case 'M':
+			if (line[1] != ' '
+			    || !(path = parse_module(line + 2, &id, &build_id))
+			    || id != nmodules + 1)
+				break;
+			add_module(path, strcmp(build_id, "-")
+					 ? xstrdup(build_id) : NULL, 0);
+			continue;
+		case 'S':
+			if (line[1] != ' '
+			    || !parse_stack(line + 2, &frames, &frames_allocated,
+					    &nframes, &id)
+			    || id != nstacks + 1)
+				break;
+			add_stack(frames, nframes, 0);
+			continue;
+		}
+
+		error_msg_and_die("%s:%lu: invalid record", fname, lineno);
+	}
+
+	if (ferror(in))
+		perror_msg_and_die("%s", fname);
+	if (!lineno)
+		error_msg_and_die("%s: not a stacks file", fname);
+
+	fclose(in);
+	free(line);
+	free(frames);
+
+	print_stacks(fp);
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef STRACE_STACK_IDS_H
+# define STRACE_STACK_IDS_H
+
+/*
+ * Deduplicated stack traces, see --stack-trace-ids and --symbolize.
+ *
+ * Every unique stack gets an id, its frames are recorded as offsets
+ * in the mapped files and are symbolized from the files on disk
+ * either at exit or by a separate strace --symbolize run.
+ */
+
+struct stack_ids_frame {
+	/* The id of the mapped file, 0 if the address is not in any.  */
+	unsigned int module;
+	/* The offset in the file or the address.  */
+	uint64_t offset;
+};
+
+extern bool stack_trace_ids;
+
+/* Starts recording the stacks to the file, or in memory if NULL.  */
+extern void stack_ids_start(const char *fname);
+/* Prints the stacks recorded in memory to fp, or closes the file.  */
+extern void stack_ids_finish(FILE *fp);
+
+/* Returns the id of the mapped file.  */
+extern unsigned int stack_ids_module(const char *path);
+/* Returns the id of the stack.  */
+extern unsigned int stack_ids_stack(const struct stack_ids_frame *,
+				    unsigned int nframes);
+
+/* Prints the stacks recorded in the file to fp, see --symbolize.  */
+extern void stack_ids_symbolize(const char *fname, FILE *fp);
+
+#endif /* !STRACE_STACK_IDS_H */
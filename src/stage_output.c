@@ -8,39 +8,175 @@
  */
 
 /*
- * open_memstream returns a FILE stream that allows writing to a
- * dynamically growing buffer, that can be either copied to
- * tcp->outf (syscall successful) or dropped (syscall failed)
+ * The output of a syscall is written to a staging stream that appends
+ * it to a buffer, that can be either copied to tcp->outf (syscall
+ * successful) or dropped (syscall failed).
+ *
+ * When fopencookie is available, the stream and the buffer of a tcb
+ * are created on the first use and reused for all subsequent syscalls,
+ * otherwise a new stream is created by open_memstream for every syscall.
  */
 
 #include "defs.h"
 
 struct staged_output_data {
+	FILE *fp;		/* The staging stream */
+	FILE *real_outf;	/* Backup for real outf while staging */
+#ifdef HAVE_FOPENCOOKIE
+	char *buf;
+	size_t len;
+	size_t size;
+#else
 	char *memfptr;
 	size_t memfloc;
-	FILE *real_outf;	/* Backup for real outf while staging */
+#endif
 };
 
-FILE *
-strace_open_memstream(struct tcb *tcp)
+#ifdef HAVE_FOPENCOOKIE
+
+static ssize_t
+staged_output_write(void *cookie, const char *data, size_t size)
 {
-	FILE *fp = NULL;
+	struct staged_output_data *const sod = cookie;
+
+	while (sod->size - sod->len < size)
+		sod->buf = xgrowarray(sod->buf, &sod->size, 1);
+	memcpy(sod->buf + sod->len, data, size);
+	sod->len += size;
+
+	return size;
+}
+
+static FILE *
+open_staging_stream(struct tcb *tcp)
+{
+	struct tcb_cold *const cold = get_tcb_cold(tcp);
+	struct staged_output_data *sod = cold->staged_output_data;
+
+	if (!sod) {
+		static const cookie_io_functions_t funcs = {
+			.write = staged_output_write,
+		};
+
+		sod = cold->staged_output_data = xcalloc(1, sizeof(*sod));
+		sod->fp = fopencookie(sod, "w", funcs);
+		if (!sod->fp)
+			perror_msg_and_die("fopencookie");
+	}
+
+	sod->len = 0;
+
+	return sod->fp;
+}
 
-#if HAVE_OPEN_MEMSTREAM
-	tcp->staged_output_data = xmalloc(sizeof(*tcp->staged_output_data));
-	fp = open_memstream(&tcp->staged_output_data->memfptr,
-			    &tcp->staged_output_data->memfloc);
-	if (!fp)
+static void
+close_staging_stream(struct tcb *tcp, bool publish)
+{
+	struct staged_output_data *const sod = tcp->cold->staged_output_data;
+
+	if (fflush(sod->fp))
+		perror_msg("fflush(tcp->outf)");
+
+	if (!sod->len)
+		return;
+
+	if (publish)
+		fwrite(sod->buf, 1, sod->len, sod->real_outf);
+	else
+		debug_msg("syscall output dropped: %.*s",
+			  (int) MIN(sod->len, INT_MAX), sod->buf);
+}
+
+void
+free_staged_output(struct tcb *tcp)
+{
+	struct staged_output_data *const sod =
+		tcp->cold ? tcp->cold->staged_output_data : NULL;
+
+	if (!sod)
+		return;
+
+	fclose(sod->fp);
+	free(sod->buf);
+	free(sod);
+	tcp->cold->staged_output_data = NULL;
+}
+
+#elif defined HAVE_OPEN_MEMSTREAM
+
+static FILE *
+open_staging_stream(struct tcb *tcp)
+{
+	struct tcb_cold *const cold = get_tcb_cold(tcp);
+	struct staged_output_data *sod = cold->staged_output_data;
+
+	if (!sod)
+		sod = cold->staged_output_data = xcalloc(1, sizeof(*sod));
+
+	sod->fp = open_memstream(&sod->memfptr, &sod->memfloc);
+	if (!sod->fp)
 		perror_msg_and_die("open_memstream");
 	/*
-	 * Call to fflush required to update tcp->memfptr,
+	 * Call to fflush required to update sod->memfptr,
 	 * see open_memstream man page.
 	 */
-	fflush(fp);
+	fflush(sod->fp);
+
+	return sod->fp;
+}
+
+static void
+close_staging_stream(struct tcb *tcp, bool publish)
+{
+	struct staged_output_data *const sod = tcp->cold->staged_output_data;
+
+	if (fclose(sod->fp))
+		perror_msg("fclose(tcp->outf)");
+	sod->fp = NULL;
+
+	if (sod->memfptr) {
+		if (publish)
+			fputs_unlocked(sod->memfptr, sod->real_outf);
+		else
+			debug_msg("syscall output dropped: %s",
+				  sod->memfptr);
+
+		free(sod->memfptr);
+		sod->memfptr = NULL;
+	}
+}
+
+void
+free_staged_output(struct tcb *tcp)
+{
+	if (!tcp->cold)
+		return;
+
+	free(tcp->cold->staged_output_data);
+	tcp->cold->staged_output_data = NULL;
+}
+
+#else /* !HAVE_FOPENCOOKIE && !HAVE_OPEN_MEMSTREAM */
+
+void
+free_staged_output(struct tcb *tcp)
+{
+}
+
+#endif
+
+FILE *
+strace_open_memstream(struct tcb *tcp)
+{
+	FILE *fp = NULL;
+
+#if defined HAVE_FOPENCOOKIE || defined HAVE_OPEN_MEMSTREAM
+	fp = open_staging_stream(tcp);
 
 	/* Store the FILE pointer for later restoration. */
-	tcp->staged_output_data->real_outf = tcp->outf;
+	tcp->cold->staged_output_data->real_outf = tcp->outf;
 	tcp->outf = fp;
+	tcp->flags |= TCB_STAGED_OUTPUT;
 #endif
 
 	return fp;
@@ -49,28 +185,15 @@ strace_open_memstream(struct tcb *tcp)
 void
 strace_close_memstream(struct tcb *tcp, bool publish)
 {
-#if HAVE_OPEN_MEMSTREAM
-	if (!tcp->staged_output_data) {
+#if defined HAVE_FOPENCOOKIE || defined HAVE_OPEN_MEMSTREAM
+	if (!(tcp->flags & TCB_STAGED_OUTPUT)) {
 		debug_msg("memstream already closed");
 		return;
 	}
 
-	if (fclose(tcp->outf))
-		perror_msg("fclose(tcp->outf)");
+	tcp->outf = tcp->cold->staged_output_data->real_outf;
+	tcp->flags &= ~TCB_STAGED_OUTPUT;
 
-	tcp->outf = tcp->staged_output_data->real_outf;
-	if (tcp->staged_output_data->memfptr) {
-		if (publish)
-			fputs_unlocked(tcp->staged_output_data->memfptr,
-				       tcp->outf);
-		else
-			debug_msg("syscall output dropped: %s",
-				  tcp->staged_output_data->memfptr);
-
-		free(tcp->staged_output_data->memfptr);
-		tcp->staged_output_data->memfptr = NULL;
-	}
-	free(tcp->staged_output_data);
-	tcp->staged_output_data = NULL;
+	close_staging_stream(tcp, publish);
 #endif
 }
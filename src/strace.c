@@ -10,6 +10,7 @@
  */
 
 #include "defs.h"
+#include <ctype.h>
 #include <stdarg.h>
 #include <limits.h>
 #include <fcntl.h>
@@ -27,7 +28,12 @@
 #include <locale.h>
 #include <sys/utsname.h>
 #include <sys/prctl.h>
+#include <sys/epoll.h>
+#ifdef HAVE_SYS_SIGNALFD_H
+# include <sys/signalfd.h>
+#endif
 
+#include "bintrace.h"
 #include "kill_save_errno.h"
 #include "filter_seccomp.h"
 #include "largefile_wrappers.h"
@@ -42,6 +48,7 @@
 #include "delay.h"
 #include "wait.h"
 #include "secontext.h"
+#include "stack_ids.h"
 
 /* In some libc, these aren't declared. Do it ourself: */
 extern char **environ;
@@ -51,6 +58,8 @@ extern char *optarg;
 #ifdef ENABLE_STACKTRACE
 /* if this is true do the stack trace for every system call */
 bool stack_trace_enabled;
+/* The file to record the stacks into, see --stack-trace-ids.  */
+static const char *stack_ids_fname;
 #endif
 
 #define my_tkill(tid, sig) syscall(__NR_tkill, (tid), (sig))
@@ -137,6 +146,43 @@ static const struct xlat_data daemonize_str[] = {
  */
 static unsigned int daemonized_tracer;
 
+/*
+ * --event-loop: how the main loop waits for tracee events.
+ * With EVENT_LOOP_EPOLL, SIGCHLD and SIGALRM are kept blocked and received
+ * through a signalfd, and the delay timer is a timerfd, so neither
+ * sigprocmask calls around wait4 nor the delay timer signal handler
+ * are needed.
+ */
+enum {
+	EVENT_LOOP_WAIT  = 0,
+	EVENT_LOOP_EPOLL = 1,
+};
+static const struct xlat_data event_loop_str[] = {
+	{ EVENT_LOOP_WAIT,	"wait" },
+	{ EVENT_LOOP_EPOLL,	"epoll" },
+};
+static unsigned int event_loop = EVENT_LOOP_WAIT;
+
+static const struct xlat_data output_ring_full_str[] = {
+	{ OUTPUT_RING_BLOCK,	"block" },
+	{ OUTPUT_RING_DROP,	"drop" },
+};
+
+enum output_format {
+	OUTPUT_FORMAT_TEXT,
+	OUTPUT_FORMAT_BINARY,
+};
+static const struct xlat_data output_format_str[] = {
+	{ OUTPUT_FORMAT_TEXT,	"text" },
+	{ OUTPUT_FORMAT_BINARY,	"binary" },
+};
+/* The binary trace to replay.  */
+static const char *replay_fname;
+/* The stacks file to symbolize.  */
+static const char *symbolize_fname;
+static int event_epoll_fd = -1;
+static int event_signal_fd = -1;
+
 static int post_attach_sigstop = TCB_IGNORE_ONE_SIGSTOP;
 #define use_seize (post_attach_sigstop == 0)
 
@@ -175,10 +221,39 @@ struct tcb_wait_data {
 static struct tcb **tcbtab;
 static unsigned int nprocs;
 static size_t tcbtabsize;
+/* The list of tcbs with pid 0, linked through next_free.  */
+static struct tcb *free_tcbs;
 
 static struct tcb_wait_data *tcb_wait_tab;
 static size_t tcb_wait_tab_size;
 
+/*
+ * Events harvested for tcbs that already had an event in the same
+ * harvest, handled after the first events of all tcbs.
+ */
+static struct extra_event {
+	int pid;
+	size_t wait_data_idx;
+} *extra_events;
+static size_t extra_events_size;
+static size_t extra_events_count;
+static size_t extra_events_pos;
+
+/*
+ * --event-batch=N: harvest at most N events per wakeup
+ * and dispatch them in pid order; 0 means no limit, FIFO order.
+ */
+static unsigned int event_batch_size;
+
+/* Number of wakeups that harvested 1, 2..3, 4..7, ..., 128+ events.  */
+#define EVENT_BATCH_HIST_SIZE 8
+static struct {
+	uint64_t wakeups;
+	uint64_t events;
+	uint64_t max_events;
+	uint64_t hist[EVENT_BATCH_HIST_SIZE];
+} event_batch_stats;
+
 
 #ifndef HAVE_PROGRAM_INVOCATION_NAME
 char *program_invocation_name;
@@ -189,15 +264,69 @@ unsigned os_release; /* generated from uname()'s u.release */
 static void detach(struct tcb *tcp);
 static void cleanup(int sig);
 static void interrupt(int sig);
+static void flight_recorder_sighandler(int sig);
 
 #ifdef HAVE_SIG_ATOMIC_T
 static volatile sig_atomic_t interrupted, restart_failed;
+static volatile sig_atomic_t flight_recorder_dump_requested;
+static volatile sig_atomic_t timer_fired;
 #else
 static volatile int interrupted, restart_failed;
+static volatile int flight_recorder_dump_requested;
+static volatile int timer_fired;
 #endif
 
 static sigset_t timer_set;
 static void timer_sighandler(int);
+static bool restart_delayed_tcbs(void);
+
+/*
+ * With --summary-interval, a periodic timer sends SIGALRM just like
+ * the delay timer does, so the main loop wakes up to print the summary
+ * of the interval.
+ */
+static struct timespec summary_interval;
+/* The start of tracing, the start and the end of the current interval.  */
+static struct timespec summary_interval_origin;
+static struct timespec summary_interval_start;
+static struct timespec summary_interval_end;
+static bool summary_interval_cumulative;
+static const char *summary_interval_fname;
+static FILE *summary_interval_fp;
+
+/*
+ * With --attach-cgroup, the processes listed in cgroup.procs are attached
+ * at startup, and the list is rescanned periodically, so the processes
+ * that join the cgroup later are attached, too.
+ */
+static const char *attach_cgroup_path;
+static FILE *attach_cgroup_fp;
+/*
+ * The processes that are not to be attached again: those that could not
+ * be attached on the first scan and those that have been detached.
+ * The processes that are not listed in cgroup.procs by the end
+ * of a scan are removed from the set, as their pids can be reused.
+ */
+static struct number_set *attach_cgroup_skip_set;
+/* The processes of attach_cgroup_skip_set listed in the current scan.  */
+static struct number_set *attach_cgroup_listed_set;
+static struct timespec attach_cgroup_next_scan;
+static timer_t attach_cgroup_timer;
+static const struct timespec attach_cgroup_interval = { 0, 100000000 };
+
+static void attach_cgroup(bool rescan);
+static void start_attach_cgroup_timer(void);
+static bool attach_cgroup_rescan_due(void);
+
+static int parse_summary_interval(const char *);
+static void start_summary_interval_timer(void);
+static bool summary_interval_expired(void);
+static void print_interval_summary(bool final);
+
+static void init_epoll_event_loop(void);
+static int epoll_wait_event(int *status, struct rusage *ru);
+
+static struct tcb *pid2tcb(int pid);
 
 #ifndef HAVE_STRERROR
 
@@ -286,6 +415,8 @@ Usage: strace [-ACdffhi" K_OPT "qqrtttTvVwxxyyzZ] [-I N] [-b execve] [-e EXPR]..
    or: strace -c[dfwzZ] [-I N] [-b execve] [-e EXPR]... [-O OVERHEAD]\n\
               [-S SORTBY] [-P PATH]... [-p PID]... [-U COLUMNS] [--seccomp-bpf]\n\
               { -p PID | [-DDD] [-E VAR=VAL]... [-u USERNAME] PROG [ARGS] }\n\
+   or: strace [OPTIONS] --replay=FILE\n\
+   or: strace [-o FILE] --symbolize=FILE\n\
 \n\
 General:\n\
   -e EXPR        a qualifying expression: OPTION=[!]all or OPTION=[!]VAL1[,VAL2]...\n\
@@ -299,8 +430,13 @@ Startup:\n\
                  remove VAR from the environment for command\n\
   -p PID, --attach=PID\n\
                  trace process with process id PID, may be repeated\n\
+  --attach-cgroup=PATH\n\
+                 trace processes of the cgroup v2 directory PATH\n\
   -u USERNAME, --user=USERNAME\n\
                  run command as USERNAME handling setuid and/or setgid\n\
+  --replay=FILE  print the trace recorded with --format=binary into FILE\n\
+  --symbolize=FILE\n\
+                 print the stacks recorded with --stack-trace-ids=FILE\n\
 \n\
 Tracing:\n\
   -b execve, --detach-on=execve\n\
@@ -321,6 +457,10 @@ Tracing:\n\
      3, never:      fatal signals are always blocked (default if '-o FILE PROG')\n\
      4, never_tstp: fatal signals and SIGTSTP (^Z) are always blocked\n\
                     (useful to make 'strace -o FILE PROG' not stop on ^Z)\n\
+  --event-batch=N\n\
+                 handle at most N tracee stops per wakeup, in pid order\n\
+  --event-loop={wait|epoll}\n\
+                 wait for tracee events with wait4 (default) or epoll\n\
 \n\
 Filtering:\n\
   -e trace=[!][?]{{SYSCALL|GROUP|all|/REGEX}[@64|@32|@x32]|none},\n\
@@ -386,6 +526,9 @@ Output format:\n\
 "\
   -k, --stack-traces\n\
                  obtain stack trace between each syscall\n\
+  --stack-trace-ids[=FILE]\n\
+                 print ids of unique stack traces, symbolize them on exit\n\
+                 or record them into FILE for --symbolize\n\
 "
 #endif
 "\
@@ -397,6 +540,22 @@ Output format:\n\
                  open the file provided in the -o option in append mode\n\
   --output-separately\n\
                  output into separate files (by appending pid to file names)\n\
+  --output-ring=SIZE\n\
+                 pass the output to the file through a SIZE bytes long\n\
+                 in-memory ring drained by a separate thread\n\
+  --output-ring-full=block|drop\n\
+                 whether to wait or to discard the output when the ring\n\
+                 is full (default is block)\n\
+  --format=text|binary\n\
+                 write the trace to the file provided in the -o option\n\
+                 as text (default) or in the binary format for --replay\n\
+  --flight-recorder=SIZE\n\
+                 keep the last SIZE bytes of the output to the file\n\
+                 in memory, write them out on SIGUSR1, tracee crash,\n\
+                 trigger, or exit\n\
+  --flight-recorder-trigger=SET[:error=ERRNO_SET]\n\
+                 write out the flight recorder when a syscall from SET\n\
+                 exits (with an error from ERRNO_SET)\n\
   -q, --quiet=attach,personality\n\
                  suppress messages about attaching, detaching, etc.\n\
   -qq, --quiet=attach,personality,exit\n\
@@ -437,6 +596,9 @@ Output format:\n\
   -yy, --decode-fds=all\n\
                  print all available information associated with file\n\
                  descriptors in addition to paths\n\
+  --fd-path-cache\n\
+                 reuse paths associated with file descriptors until they\n\
+                 are closed or replaced (requires -f)\n\
   --decode-pids=pidns\n\
                  print PIDs in strace's namespace, too\n\
   -Y, --decode-pids=comm\n\
@@ -452,12 +614,25 @@ Statistics:\n\
      units:      one of s, ms, us, ns; default is microseconds\n\
   -S SORTBY, --summary-sort-by=SORTBY\n\
                  sort syscall counts by: time, min-time, max-time, avg-time,\n\
-                 calls, errors, name, nothing (default %s)\n\
+                 p50, p90, p99, p999, stddev, calls, errors, name, nothing\n\
+                 (default %s)\n\
   -U COLUMNS, --summary-columns=COLUMNS\n\
                  show specific columns in the summary report: comma-separated\n\
                  list of time-percent, total-time, min-time, max-time, \n\
-                 avg-time, calls, errors, name\n\
+                 avg-time, p50, p90, p99, p999, stddev, calls, errors, name\n\
                  (default time-percent,total-time,avg-time,calls,errors,name)\n\
+  --summary-histograms\n\
+                 print a latency histogram of each syscall after the summary\n\
+  --summary-by=process|thread|comm\n\
+                 also rank processes, threads, or commands by syscall time\n\
+  --summary-top=N\n\
+                 print N top entries of --summary-by ranking (default 10)\n\
+  --summary-interval=INTERVAL\n\
+                 print the summary of each INTERVAL (in seconds by default)\n\
+  --summary-interval-cumulative\n\
+                 also print the summary since start after each interval\n\
+  --summary-interval-output=FILE\n\
+                 write the interval summaries to FILE in JSON lines format\n\
   -w, --summary-wall-clock\n\
                  summarise syscall latency (default is system time)\n\
 \n\
@@ -481,6 +656,9 @@ Tampering:\n\
 Miscellaneous:\n\
   -d, --debug    enable debug output to stderr\n\
   -h, --help     print help message\n\
+  --memory-cache-pages=N\n\
+                 cache up to N pages of tracee memory while it is stopped\n\
+                 (default %u, 0 disables caching)\n\
   --seccomp-bpf  enable seccomp-bpf filtering\n\
   --tips[=[[id:]ID][,[format:]FORMAT]]\n\
                  show strace tips, tricks, and tweaks on exit\n\
@@ -491,7 +669,8 @@ Miscellaneous:\n\
 /* ancient, no one should use it
 -F -- attempt to follow vforks (deprecated, use -f)\n\
  */
-, DEFAULT_ACOLUMN, DEFAULT_STRLEN, DEFAULT_SORTBY);
+, DEFAULT_ACOLUMN, DEFAULT_STRLEN, DEFAULT_SORTBY,
+  DEFAULT_UMOVE_CACHE_SIZE);
 	exit(0);
 
 #undef K_OPT
@@ -519,18 +698,36 @@ error_opt_arg(int opt, const struct option *lopt, const char *arg)
 	}
 }
 
+/*
+ * Attaches to the process without stopping it if PTRACE_SEIZE is used,
+ * ptrace_interrupt_seized has to be called afterwards to stop it.
+ */
 static int
-ptrace_attach_or_seize(int pid, const char **ptrace_attach_cmd)
+ptrace_attach_or_seize_nostop(int pid, const char **ptrace_attach_cmd)
 {
-	int r;
 	if (!use_seize)
 		return *ptrace_attach_cmd = "PTRACE_ATTACH",
 		       ptrace(PTRACE_ATTACH, pid, 0L, 0L);
-	r = ptrace(PTRACE_SEIZE, pid, 0L, (unsigned long) ptrace_setoptions);
+	return *ptrace_attach_cmd = "PTRACE_SEIZE",
+	       ptrace(PTRACE_SEIZE, pid, 0L, (unsigned long) ptrace_setoptions);
+}
+
+static int
+ptrace_interrupt_seized(int pid, const char **ptrace_attach_cmd)
+{
+	if (!use_seize)
+		return 0;
+	return *ptrace_attach_cmd = "PTRACE_INTERRUPT",
+	       ptrace(PTRACE_INTERRUPT, pid, 0L, 0L);
+}
+
+static int
+ptrace_attach_or_seize(int pid, const char **ptrace_attach_cmd)
+{
+	int r = ptrace_attach_or_seize_nostop(pid, ptrace_attach_cmd);
 	if (r)
-		return *ptrace_attach_cmd = "PTRACE_SEIZE", r;
-	r = ptrace(PTRACE_INTERRUPT, pid, 0L, 0L);
-	return *ptrace_attach_cmd = "PTRACE_INTERRUPT", r;
+		return r;
+	return ptrace_interrupt_seized(pid, ptrace_attach_cmd);
 }
 
 static const char *
@@ -557,6 +754,8 @@ ptrace_restart(const unsigned int op, struct tcb *const tcp, unsigned int sig)
 {
 	int err;
 
+	invalidate_umove_cache(tcp);
+
 	errno = 0;
 	ptrace(op, tcp->pid, 0L, (unsigned long) sig);
 	err = errno;
@@ -620,6 +819,20 @@ swap_uid(void)
 	}
 }
 
+/*
+ * With both --output-ring and --flight-recorder, the output kept
+ * by the flight recorder is written out through the output ring.
+ */
+static FILE *
+wrap_output(FILE *fp)
+{
+	if (output_ring_size)
+		fp = output_ring_wrap(fp);
+	if (flight_recorder_size)
+		fp = flight_recorder_wrap(fp);
+	return fp;
+}
+
 static FILE *
 strace_fopen(const char *path)
 {
@@ -631,7 +844,7 @@ strace_fopen(const char *path)
 		perror_msg_and_die("Can't fopen '%s'", path);
 	swap_uid();
 	set_cloexec_flag(fileno(fp));
-	return fp;
+	return wrap_output(fp);
 }
 
 static int popen_pid;
@@ -681,7 +894,7 @@ strace_popen(const char *command)
 	fp = fdopen(fds[1], "w");
 	if (!fp)
 		perror_msg_and_die("fdopen");
-	return fp;
+	return wrap_output(fp);
 }
 
 static void
@@ -701,7 +914,8 @@ ATTRIBUTE_FORMAT((printf, 1, 0))
 static void
 tvprintf(const char *const fmt, va_list args)
 {
-	if (current_tcp) {
+	/* The text output is not needed when recording the binary trace.  */
+	if (current_tcp && !bintrace_recording) {
 		int n = vfprintf(current_tcp->outf, fmt, args);
 		if (n < 0) {
 			/* very unlikely due to vfprintf buffering */
@@ -727,7 +941,7 @@ tprintf(const char *fmt, ...)
 void
 tprints(const char *str)
 {
-	if (current_tcp) {
+	if (current_tcp && !bintrace_recording) {
 		int n = fputs_unlocked(str, current_tcp->outf);
 		if (n >= 0) {
 			current_tcp->curcol += strlen(str);
@@ -811,7 +1025,8 @@ printleader(struct tcb *tcp)
 
 	if (printing_tcp) {
 		set_current_tcp(printing_tcp);
-		if (!tcp->staged_output_data && printing_tcp->curcol != 0 &&
+		if (!(tcp->flags & TCB_STAGED_OUTPUT) &&
+		    printing_tcp->curcol != 0 &&
 		    (!output_separately || printing_tcp == tcp)) {
 			/*
 			 * case 1: we have a shared log (i.e. not -ff), and last line
@@ -829,8 +1044,9 @@ printleader(struct tcb *tcp)
 	current_tcp->curcol = 0;
 
 	if (print_pid_pfx || (nprocs > 1 && !outfname)) {
+		const char *const comm = tcp->cold ? tcp->cold->comm : "";
 		size_t len = is_number_in_set(DECODE_PID_COMM, decode_pid_set)
-			     ? strlen(tcp->comm) : 0;
+			     ? strlen(comm) : 0;
 
 		if (print_pid_pfx) {
 			if (len)
@@ -841,7 +1057,7 @@ printleader(struct tcb *tcp)
 			tprintf("[pid %5u", tcp->pid);
 		}
 
-		print_comm_str(tcp->comm, len);
+		print_comm_str(comm, len);
 
 		if (!print_pid_pfx)
 			tprints("]");
@@ -852,7 +1068,7 @@ printleader(struct tcb *tcp)
 
 	if (tflag_format) {
 		struct timespec ts;
-		clock_gettime(CLOCK_REALTIME, &ts);
+		get_trace_time(CLOCK_REALTIME, &ts);
 
 		time_t local = ts.tv_sec;
 		char str[MAX(sizeof("HH:MM:SS"), sizeof(local) * 3)];
@@ -871,7 +1087,7 @@ printleader(struct tcb *tcp)
 
 	if (rflag) {
 		struct timespec ts;
-		clock_gettime(CLOCK_MONOTONIC, &ts);
+		get_trace_time(CLOCK_MONOTONIC, &ts);
 
 		static struct timespec ots;
 		if (ots.tv_sec == 0)
@@ -944,6 +1160,15 @@ expand_tcbtab(void)
 	     tcb_ptr < tcbtab + tcbtabsize;
 	     ++tcb_ptr, ++newtcbs)
 		*tcb_ptr = newtcbs;
+
+	debug_msg("expanded the tcb table from %zu to %zu tcbs",
+		  old_tcbtabsize, tcbtabsize);
+
+	/* The new tcbs are taken from the free list in the order of tcbtab.  */
+	for (size_t i = tcbtabsize; i > old_tcbtabsize; --i) {
+		tcbtab[i - 1]->next_free = free_tcbs;
+		free_tcbs = tcbtab[i - 1];
+	}
 }
 
 static char *
@@ -986,38 +1211,187 @@ print_pid_comm(int pid)
 void
 maybe_load_task_comm(struct tcb *tcp)
 {
-	if (!is_number_in_set(DECODE_PID_COMM, decode_pid_set))
+	if (!is_number_in_set(DECODE_PID_COMM, decode_pid_set)
+	    && !count_summary_needs_comm())
+		return;
+
+	struct tcb_cold *const cold = get_tcb_cold(tcp);
+	load_pid_comm(get_proc_pid(tcp->pid), cold->comm, sizeof(cold->comm));
+}
+
+/*
+ * pid -> tcb index: an open addressing hash table with linear probing
+ * and backward shift deletion, so there are no tombstones and lookups
+ * stay short regardless of how many tracees come and go.
+ * The table is kept at most half full.
+ */
+static struct tcb **pid_hash;
+static size_t pid_hash_size;	/* 0 or a power of 2 */
+static size_t pid_hash_used;
+
+static struct {
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t probes;
+	uint64_t max_probes;
+} pid_hash_stats;
+
+static size_t
+pid_hash_slot(const int pid)
+{
+	return ((unsigned int) pid * 2654435761U) & (pid_hash_size - 1);
+}
+
+static void
+pid_hash_place(struct tcb *tcp)
+{
+	size_t i = pid_hash_slot(tcp->pid);
+
+	while (pid_hash[i])
+		i = (i + 1) & (pid_hash_size - 1);
+	pid_hash[i] = tcp;
+}
+
+static void
+pid_hash_insert(struct tcb *tcp)
+{
+	if ((pid_hash_used + 1) * 2 > pid_hash_size) {
+		struct tcb **const old_hash = pid_hash;
+		const size_t old_size = pid_hash_size;
+
+		pid_hash_size = old_size ? old_size * 2 : 64;
+		pid_hash = xcalloc(pid_hash_size, sizeof(*pid_hash));
+		for (size_t i = 0; i < old_size; ++i) {
+			if (old_hash[i])
+				pid_hash_place(old_hash[i]);
+		}
+		free(old_hash);
+	}
+
+	pid_hash_place(tcp);
+	pid_hash_used++;
+}
+
+static void
+pid_hash_remove(struct tcb *tcp)
+{
+	if (!pid_hash_size)
 		return;
 
-	load_pid_comm(get_proc_pid(tcp->pid), tcp->comm, sizeof(tcp->comm));
+	const size_t mask = pid_hash_size - 1;
+	size_t i = pid_hash_slot(tcp->pid);
+
+	for (; pid_hash[i] != tcp; i = (i + 1) & mask) {
+		if (!pid_hash[i])
+			return;
+	}
+
+	/*
+	 * Shift back the entries that follow in the same cluster
+	 * and would become unreachable through the freed slot.
+	 */
+	for (size_t j = (i + 1) & mask; pid_hash[j]; j = (j + 1) & mask) {
+		const size_t home = pid_hash_slot(pid_hash[j]->pid);
+
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			pid_hash[i] = pid_hash[j];
+			i = j;
+		}
+	}
+	pid_hash[i] = NULL;
+	pid_hash_used--;
+}
+
+static struct tcb *
+pid_hash_lookup(const int pid)
+{
+	if (!pid_hash_size)
+		return NULL;
+
+	const size_t mask = pid_hash_size - 1;
+	struct tcb *tcp;
+	uint64_t probes = 1;
+
+	pid_hash_stats.lookups++;
+	for (size_t i = pid_hash_slot(pid); (tcp = pid_hash[i]);
+	     i = (i + 1) & mask, ++probes) {
+		if (tcp->pid == pid)
+			break;
+	}
+
+	pid_hash_stats.probes += probes;
+	if (probes > pid_hash_stats.max_probes)
+		pid_hash_stats.max_probes = probes;
+	if (tcp)
+		pid_hash_stats.hits++;
+	else
+		pid_hash_stats.misses++;
+
+	return tcp;
+}
+
+static void
+print_pid_hash_stats(void)
+{
+	debug_msg("pid2tcb: %" PRIu64 " lookups, %" PRIu64 " hits, %" PRIu64
+		  " misses, %.2f average probes, %" PRIu64 " max probes"
+		  ", %zu/%zu slots used",
+		  pid_hash_stats.lookups, pid_hash_stats.hits,
+		  pid_hash_stats.misses,
+		  pid_hash_stats.lookups
+		  ? (double) pid_hash_stats.probes / pid_hash_stats.lookups
+		  : 0.0,
+		  pid_hash_stats.max_probes, pid_hash_used, pid_hash_size);
 }
 
+/*
+ * Takes a tcb from the list of free tcbs.  The free tcbs are zeroed
+ * by expand_tcbtab and droptcb except for the cold fields that are
+ * kept for reuse and reset by reset_tcb_cold.
+ */
 static struct tcb *
 alloctcb(int pid)
 {
-	if (nprocs == tcbtabsize)
+	if (!free_tcbs)
 		expand_tcbtab();
 
-	for (unsigned int i = 0; i < tcbtabsize; ++i) {
-		struct tcb *tcp = tcbtab[i];
-		if (!tcp->pid) {
-			memset(tcp, 0, sizeof(*tcp));
-			list_init(&tcp->wait_list);
-			tcp->pid = pid;
-			maybe_load_task_comm(tcp);
+	struct tcb *tcp = free_tcbs;
+	if (tcp->pid)
+		error_msg_and_die("bug in alloctcb");
+	free_tcbs = tcp->next_free;
+	tcp->next_free = NULL;
+
+	list_init(&tcp->wait_list);
+	tcp->pid = pid;
+	maybe_load_task_comm(tcp);
 #if SUPPORTED_PERSONALITIES > 1
-			tcp->currpers = current_personality;
+	tcp->currpers = current_personality;
 #endif
+	pid_hash_insert(tcp);
+	nprocs++;
+	debug_msg("new tcb for pid %d, active tcbs:%d", tcp->pid, nprocs);
+	return tcp;
+}
+
+static void
+reset_tcb_cold(struct tcb_cold *cold)
+{
+	memset(cold, 0, sizeof(*cold));
 #ifdef ENABLE_SECONTEXT
-			tcp->last_dirfd = AT_FDCWD;
+	cold->last_dirfd = AT_FDCWD;
 #endif
-			nprocs++;
-			debug_msg("new tcb for pid %d, active tcbs:%d",
-				  tcp->pid, nprocs);
-			return tcp;
-		}
+}
+
+struct tcb_cold *
+get_tcb_cold(struct tcb *tcp)
+{
+	if (!tcp->cold) {
+		tcp->cold = xmalloc(sizeof(*tcp->cold));
+		reset_tcb_cold(tcp->cold);
 	}
-	error_msg_and_die("bug in alloctcb");
+
+	return tcp->cold;
 }
 
 void *
@@ -1057,16 +1431,18 @@ droptcb(struct tcb *tcp)
 	if (tcp->pid == 0)
 		return;
 
-	if (cflag && debug_flag) {
+	if (cflag && debug_flag && tcp->cold) {
 		struct timespec dt;
 
-		ts_sub(&dt, &tcp->stime, &tcp->atime);
+		ts_sub(&dt, &tcp->cold->stime, &tcp->cold->atime);
 		debug_func_msg("pid %d: %.9f seconds of system time spent "
 			       "since attach", tcp->pid, ts_float(&dt));
 	}
 
-	for (int p = 0; p < SUPPORTED_PERSONALITIES; ++p)
-		free(tcp->inject_vec[p]);
+	if (tcp->cold) {
+		for (int p = 0; p < SUPPORTED_PERSONALITIES; ++p)
+			free(tcp->cold->inject_vec[p]);
+	}
 
 	free_tcb_priv_data(tcp);
 
@@ -1082,6 +1458,10 @@ droptcb(struct tcb *tcp)
 	if (tcp->mmap_cache)
 		tcp->mmap_cache->free_fn(tcp, __func__);
 
+	pidns_drop_tracee(tcp);
+
+	count_drop_tcb(tcp);
+
 	nprocs--;
 	debug_msg("dropped tcb for pid %d, %d remain", tcp->pid, nprocs);
 
@@ -1109,8 +1489,22 @@ droptcb(struct tcb *tcp)
 		printing_tcp = NULL;
 
 	list_remove(&tcp->wait_list);
+	pid_hash_remove(tcp);
+	invalidate_umove_cache(tcp);
+	free_fd_path_cache(tcp);
+	free_staged_output(tcp);
+
+	struct tcb_cold *const cold = tcp->cold;
+	if (cold) {
+		undelay_tcb(tcp);
+		free(cold->delayed_wait_data);
+		reset_tcb_cold(cold);
+	}
 
 	memset(tcp, 0, sizeof(*tcp));
+	tcp->cold = cold;
+	tcp->next_free = free_tcbs;
+	free_tcbs = tcp;
 }
 
 /* Detach traced process.
@@ -1271,6 +1665,10 @@ detach(struct tcb *tcp)
 	    && (tcp->flags & TCB_ATTACHED))
 		error_msg("Process %u detached", tcp->pid);
 
+	/* Do not attach it again on the next rescan of the cgroup.  */
+	if (attach_cgroup_fp)
+		add_number_to_set(tcp->pid, attach_cgroup_skip_set);
+
 	droptcb(tcp);
 }
 
@@ -1302,65 +1700,121 @@ process_opt_p_list(char *opt)
 	}
 }
 
-static void
-attach_tcb(struct tcb *const tcp)
+/*
+ * Seizes the threads of the process that are not traced yet, without
+ * stopping them, and appends their tids to the tids array.
+ * Returns the number of the threads seized.
+ */
+static unsigned int
+attach_new_threads(const int pid, int **tids, size_t *tids_size,
+		   size_t *tids_count)
+{
+	static const char task_path[] = "/proc/%d/task";
+	char procdir[sizeof(task_path) + sizeof(int) * 3];
+	const char *ptrace_attach_cmd;
+	unsigned int nattached = 0;
+	DIR *dir;
+
+	xsprintf(procdir, task_path, get_proc_pid(pid));
+	dir = opendir(procdir);
+	if (!dir)
+		return 0;
+
+	struct_dirent *de;
+
+	while ((de = read_dir(dir)) != NULL) {
+		if (de->d_fileno == 0)
+			continue;
+
+		int tid = string_to_uint(de->d_name);
+		if (tid <= 0 || pid2tcb(tid))
+			continue;
+
+		/*
+		 * The threads created by the seized threads are attached
+		 * by the kernel, so they fail with EPERM here.
+		 */
+		if (ptrace_attach_or_seize_nostop(tid, &ptrace_attach_cmd) < 0) {
+			debug_perror_msg("attach: ptrace(%s, %d)",
+					 ptrace_attach_cmd, tid);
+			continue;
+		}
+
+		after_successful_attach(alloctcb(tid),
+					TCB_GRABBED | post_attach_sigstop);
+		debug_msg("attach to pid %d succeeded", tid);
+
+		if (*tids_count >= *tids_size)
+			*tids = xgrowarray(*tids, tids_size, sizeof(**tids));
+		(*tids)[(*tids_count)++] = tid;
+		++nattached;
+	}
+
+	closedir(dir);
+
+	return nattached;
+}
+
+/*
+ * Returns 0 if the process is attached, the error code otherwise.
+ * With -f, the threads of the process are seized in several passes
+ * over /proc/PID/task until a pass finds no new threads, so the threads
+ * created during the scan are not missed, and then they are stopped
+ * all at once.
+ */
+static int
+attach_tcb(struct tcb *const tcp, const bool quiet_eperm)
 {
 	const char *ptrace_attach_cmd;
 
 	if (ptrace_attach_or_seize(tcp->pid, &ptrace_attach_cmd) < 0) {
-		perror_msg("attach: ptrace(%s, %d)",
-			   ptrace_attach_cmd, tcp->pid);
+		const int err = errno;
+
+		if (err == EPERM && quiet_eperm)
+			debug_perror_msg("attach: ptrace(%s, %d)",
+					 ptrace_attach_cmd, tcp->pid);
+		else
+			perror_msg("attach: ptrace(%s, %d)",
+				   ptrace_attach_cmd, tcp->pid);
 		droptcb(tcp);
-		return;
+		return err;
 	}
 
 	after_successful_attach(tcp, TCB_GRABBED | post_attach_sigstop);
 	debug_msg("attach to pid %d (main) succeeded", tcp->pid);
 
-	static const char task_path[] = "/proc/%d/task";
-	char procdir[sizeof(task_path) + sizeof(int) * 3];
-	DIR *dir;
-	unsigned int ntid = 0, nerr = 0;
-
-	if (followfork && tcp->pid != strace_child &&
-	    xsprintf(procdir, task_path, get_proc_pid(tcp->pid)) > 0 &&
-	    (dir = opendir(procdir)) != NULL) {
-		struct_dirent *de;
+	int *tids = NULL;
+	size_t tids_size = 0, ntid = 0;
 
-		while ((de = read_dir(dir)) != NULL) {
-			if (de->d_fileno == 0)
-				continue;
+	if (followfork && tcp->pid != strace_child) {
+		unsigned int npasses = 0;
 
-			int tid = string_to_uint(de->d_name);
-			if (tid <= 0 || tid == tcp->pid)
-				continue;
+		while (attach_new_threads(tcp->pid, &tids, &tids_size, &ntid))
+			++npasses;
 
-			++ntid;
-			if (ptrace_attach_or_seize(tid, &ptrace_attach_cmd) < 0)
-			{
-				++nerr;
+		for (size_t i = 0; i < ntid; ++i) {
+			if (ptrace_interrupt_seized(tids[i],
+						    &ptrace_attach_cmd) < 0)
 				debug_perror_msg("attach: ptrace(%s, %d)",
-						 ptrace_attach_cmd, tid);
-				continue;
-			}
-
-			after_successful_attach(alloctcb(tid),
-						TCB_GRABBED | post_attach_sigstop);
-			debug_msg("attach to pid %d succeeded", tid);
+						 ptrace_attach_cmd, tids[i]);
 		}
 
-		closedir(dir);
+		debug_msg("attached to %zu threads of pid %d in %u passes",
+			  ntid, tcp->pid, npasses + 1);
+		free(tids);
 	}
 
 	if (!is_number_in_set(QUIET_ATTACH, quiet_set)) {
-		if (ntid > nerr)
+		if (ntid)
 			error_msg("Process %u attached"
-				  " with %u threads",
-				  tcp->pid, ntid - nerr + 1);
+				  " with %zu threads",
+				  tcp->pid, ntid + 1);
 		else
 			error_msg("Process %u attached",
 				  tcp->pid);
 	}
+
+	return 0;
 }
 
 static void
@@ -1427,7 +1881,7 @@ startup_attach(void)
 			continue;
 		}
 
-		attach_tcb(tcp);
+		attach_tcb(tcp, false);
 
 		if (interrupted)
 			return;
@@ -2181,6 +2635,10 @@ init(int argc, char *argv[])
 	int tflag_short = 0;
 	bool columns_set = false;
 	bool sortby_set = false;
+	bool histograms_set = false;
+	bool summary_by_set = false;
+	bool summary_top_set = false;
+	bool flight_recorder_trigger_set = false;
 
 	/*
 	 * We can initialise global_path_set only after tracing backend
@@ -2245,6 +2703,25 @@ init(int argc, char *argv[])
 		GETOPT_TS,
 		GETOPT_PIDNS_TRANSLATION,
 		GETOPT_TIPS,
+		GETOPT_EVENT_BATCH,
+		GETOPT_EVENT_LOOP,
+		GETOPT_MEMORY_CACHE_PAGES,
+		GETOPT_FD_PATH_CACHE,
+		GETOPT_OUTPUT_RING,
+		GETOPT_OUTPUT_RING_FULL,
+		GETOPT_OUTPUT_FORMAT,
+		GETOPT_REPLAY,
+		GETOPT_FLIGHT_RECORDER,
+		GETOPT_FLIGHT_RECORDER_TRIGGER,
+		GETOPT_STACK_TRACE_IDS,
+		GETOPT_SYMBOLIZE,
+		GETOPT_ATTACH_CGROUP,
+		GETOPT_SUMMARY_HISTOGRAMS,
+		GETOPT_SUMMARY_INTERVAL,
+		GETOPT_SUMMARY_INTERVAL_CUMULATIVE,
+		GETOPT_SUMMARY_INTERVAL_OUTPUT,
+		GETOPT_SUMMARY_BY,
+		GETOPT_SUMMARY_TOP,
 
 		GETOPT_QUAL_TRACE,
 		GETOPT_QUAL_ABBREV,
@@ -2280,10 +2757,12 @@ init(int argc, char *argv[])
 		{ "instruction-pointer", no_argument,      0, 'i' },
 		{ "interruptible",	required_argument, 0, 'I' },
 		{ "stack-traces",	no_argument,	   0, 'k' },
+		{ "stack-trace",	no_argument,	   0, 'k' },
 		{ "syscall-number",	no_argument,	   0, 'n' },
 		{ "output",		required_argument, 0, 'o' },
 		{ "summary-syscall-overhead", required_argument, 0, 'O' },
 		{ "attach",		required_argument, 0, 'p' },
+		{ "attach-cgroup",	required_argument, 0, GETOPT_ATTACH_CGROUP },
 		{ "trace-path",		required_argument, 0, 'P' },
 		{ "relative-timestamps", optional_argument, 0, 'r' },
 		{ "string-limit",	required_argument, 0, 's' },
@@ -2293,6 +2772,16 @@ init(int argc, char *argv[])
 		{ "syscall-times",	optional_argument, 0, 'T' },
 		{ "user",		required_argument, 0, 'u' },
 		{ "summary-columns",	required_argument, 0, 'U' },
+		{ "summary-histograms",	no_argument,	   0,
+			GETOPT_SUMMARY_HISTOGRAMS },
+		{ "summary-interval",	required_argument, 0,
+			GETOPT_SUMMARY_INTERVAL },
+		{ "summary-interval-cumulative", no_argument, 0,
+			GETOPT_SUMMARY_INTERVAL_CUMULATIVE },
+		{ "summary-interval-output", required_argument, 0,
+			GETOPT_SUMMARY_INTERVAL_OUTPUT },
+		{ "summary-by",		required_argument, 0, GETOPT_SUMMARY_BY },
+		{ "summary-top",	required_argument, 0, GETOPT_SUMMARY_TOP },
 		{ "no-abbrev",		no_argument,	   0, 'v' },
 		{ "version",		no_argument,	   0, 'V' },
 		{ "summary-wall-clock", no_argument,	   0, 'w' },
@@ -2304,6 +2793,23 @@ init(int argc, char *argv[])
 		{ "failing-only",	no_argument,	   0, 'Z' },
 		{ "seccomp-bpf",	no_argument,	   0, GETOPT_SECCOMP },
 		{ "tips",		optional_argument, 0, GETOPT_TIPS },
+		{ "event-batch",	required_argument, 0, GETOPT_EVENT_BATCH },
+		{ "event-loop",		required_argument, 0, GETOPT_EVENT_LOOP },
+		{ "memory-cache-pages",	required_argument, 0,
+			GETOPT_MEMORY_CACHE_PAGES },
+		{ "fd-path-cache",	no_argument,	   0, GETOPT_FD_PATH_CACHE },
+		{ "output-ring",	required_argument, 0, GETOPT_OUTPUT_RING },
+		{ "output-ring-full",	required_argument, 0,
+			GETOPT_OUTPUT_RING_FULL },
+		{ "format",		required_argument, 0, GETOPT_OUTPUT_FORMAT },
+		{ "replay",		required_argument, 0, GETOPT_REPLAY },
+		{ "flight-recorder",	required_argument, 0,
+			GETOPT_FLIGHT_RECORDER },
+		{ "flight-recorder-trigger", required_argument, 0,
+			GETOPT_FLIGHT_RECORDER_TRIGGER },
+		{ "stack-trace-ids",	optional_argument, 0,
+			GETOPT_STACK_TRACE_IDS },
+		{ "symbolize",		required_argument, 0, GETOPT_SYMBOLIZE },
 
 		{ "trace",	required_argument, 0, GETOPT_QUAL_TRACE },
 		{ "abbrev",	required_argument, 0, GETOPT_QUAL_ABBREV },
@@ -2481,6 +2987,32 @@ init(int argc, char *argv[])
 			columns_set = true;
 			set_count_summary_columns(optarg);
 			break;
+		case GETOPT_SUMMARY_HISTOGRAMS:
+			histograms_set = true;
+			set_count_summary_histograms();
+			break;
+		case GETOPT_SUMMARY_INTERVAL:
+			if (parse_summary_interval(optarg))
+				error_opt_arg(c, lopt, optarg);
+			break;
+		case GETOPT_SUMMARY_INTERVAL_CUMULATIVE:
+			summary_interval_cumulative = true;
+			break;
+		case GETOPT_SUMMARY_INTERVAL_OUTPUT:
+			summary_interval_fname = optarg;
+			break;
+		case GETOPT_SUMMARY_BY:
+			if (set_count_summary_by(optarg))
+				error_opt_arg(c, lopt, optarg);
+			summary_by_set = true;
+			break;
+		case GETOPT_SUMMARY_TOP:
+			i = string_to_uint(optarg);
+			if (i < 0)
+				error_opt_arg(c, lopt, optarg);
+			set_count_summary_top(i);
+			summary_top_set = true;
+			break;
 		case 'v':
 			qualify_abbrev("none");
 			break;
@@ -2535,6 +3067,90 @@ init(int argc, char *argv[])
 			if (parse_tips_arg(optarg ?: ""))
 				error_opt_arg(c, lopt, optarg);
 			break;
+		case GETOPT_EVENT_BATCH:
+			i = string_to_uint(optarg);
+			if (i <= 0)
+				error_opt_arg(c, lopt, optarg);
+			event_batch_size = i;
+			break;
+		case GETOPT_EVENT_LOOP:
+			i = find_arg_val(optarg, event_loop_str, -1, -1);
+			if (i < 0)
+				error_opt_arg(c, lopt, optarg);
+#ifndef HAVE_SYS_SIGNALFD_H
+			if (i == EVENT_LOOP_EPOLL)
+				error_msg_and_die("--event-loop=epoll is not"
+						  " supported by this build"
+						  " of strace");
+#endif
+			event_loop = i;
+			break;
+		case GETOPT_MEMORY_CACHE_PAGES:
+			i = string_to_uint_upto(optarg, MAX_UMOVE_CACHE_SIZE);
+			if (i < 0)
+				error_opt_arg(c, lopt, optarg);
+			umove_cache_size = i;
+			break;
+		case GETOPT_FD_PATH_CACHE:
+			fd_path_cache_enabled = true;
+			break;
+		case GETOPT_OUTPUT_RING:
+			i = string_to_uint_upto(optarg, MAX_OUTPUT_RING_SIZE);
+			if (i < MIN_OUTPUT_RING_SIZE)
+				error_opt_arg(c, lopt, optarg);
+#ifndef HAVE_FOPENCOOKIE
+			error_msg_and_die("--output-ring is not supported"
+					  " by this build of strace");
+#endif
+			output_ring_size = i;
+			break;
+		case GETOPT_OUTPUT_RING_FULL:
+			i = find_arg_val(optarg, output_ring_full_str, -1, -1);
+			if (i < 0)
+				error_opt_arg(c, lopt, optarg);
+			output_ring_policy = i;
+			break;
+		case GETOPT_OUTPUT_FORMAT:
+			i = find_arg_val(optarg, output_format_str, -1, -1);
+			if (i < 0)
+				error_opt_arg(c, lopt, optarg);
+			bintrace_recording = i == OUTPUT_FORMAT_BINARY;
+			break;
+		case GETOPT_REPLAY:
+			replay_fname = optarg;
+			break;
+		case GETOPT_FLIGHT_RECORDER:
+			i = string_to_uint_upto(optarg,
+						MAX_FLIGHT_RECORDER_SIZE);
+			if (i < MIN_FLIGHT_RECORDER_SIZE)
+				error_opt_arg(c, lopt, optarg);
+#ifndef HAVE_FOPENCOOKIE
+			error_msg_and_die("--flight-recorder is not supported"
+					  " by this build of strace");
+#endif
+			flight_recorder_size = i;
+			break;
+		case GETOPT_FLIGHT_RECORDER_TRIGGER:
+			qualify_flight_recorder_trigger(optarg);
+			flight_recorder_trigger_set = true;
+			break;
+		case GETOPT_STACK_TRACE_IDS:
+#ifdef ENABLE_STACKTRACE
+			stack_trace_enabled = true;
+			stack_trace_ids = true;
+			stack_ids_fname = optarg;
+#else
+			error_msg_and_die("Stack traces (--stack-trace-ids "
+					  "option) are not supported by this "
+					  "build of strace");
+#endif
+			break;
+		case GETOPT_SYMBOLIZE:
+			symbolize_fname = optarg;
+			break;
+		case GETOPT_ATTACH_CGROUP:
+			attach_cgroup_path = optarg;
+			break;
 		case GETOPT_QUAL_SECONTEXT:
 			qualify_secontext(optarg ? optarg : secontext_qual);
 			break;
@@ -2594,7 +3210,21 @@ init(int argc, char *argv[])
 	argv += optind;
 	argc -= optind;
 
-	if (argc < 0 || (!nprocs && !argc)) {
+	if (symbolize_fname) {
+		if (argc || nprocs || attach_cgroup_path)
+			error_msg_and_help("--symbolize cannot be used with"
+					   " PROG [ARGS] or -p PID");
+		if (replay_fname)
+			error_msg_and_help("--symbolize and --replay"
+					   " are mutually exclusive");
+	} else if (replay_fname) {
+		if (argc || nprocs || attach_cgroup_path)
+			error_msg_and_help("--replay cannot be used with"
+					   " PROG [ARGS] or -p PID");
+		if (bintrace_recording)
+			error_msg_and_help("--replay and --format=binary"
+					   " are mutually exclusive");
+	} else if (argc < 0 || (!nprocs && !argc && !attach_cgroup_path)) {
 		error_msg_and_help("must have PROG [ARGS] or -p PID");
 	}
 
@@ -2653,7 +3283,7 @@ init(int argc, char *argv[])
 		 */
 		for (unsigned int i = 0; i < tcbtabsize; ++i) {
 			struct tcb *tcp = tcbtab[i];
-			if (tcp->comm[0] == 0)
+			if (tcp->pid && (!tcp->cold || !tcp->cold->comm[0]))
 				maybe_load_task_comm(tcp);
 		}
 	}
@@ -2698,6 +3328,12 @@ init(int argc, char *argv[])
 		}
 	}
 
+	if (fd_path_cache_enabled && !followfork) {
+		error_msg("--fd-path-cache cannot be used without "
+			  "-f/--follow-forks, disabling");
+		fd_path_cache_enabled = false;
+	}
+
 	if (output_separately && cflag) {
 		error_msg_and_help("(-c/--summary-only or -C/--summary) and"
 				   " -ff/--output-separately"
@@ -2714,6 +3350,39 @@ init(int argc, char *argv[])
 				   " (-c/--summary-only or -C/--summary)");
 	}
 
+	if (histograms_set && !cflag) {
+		error_msg_and_help("--summary-histograms must be given with"
+				   " (-c/--summary-only or -C/--summary)");
+	}
+
+	if (summary_by_set && !cflag) {
+		error_msg_and_help("--summary-by must be given with"
+				   " (-c/--summary-only or -C/--summary)");
+	}
+
+	if (summary_top_set && !summary_by_set)
+		error_msg_and_help("--summary-top must be given with"
+				   " --summary-by");
+
+	if (ts_nz(&summary_interval)) {
+		if (!cflag)
+			error_msg_and_help("--summary-interval must be given"
+					   " with (-c/--summary-only or"
+					   " -C/--summary)");
+	} else if (summary_interval_cumulative || summary_interval_fname) {
+		error_msg_and_help("%s must be given with --summary-interval",
+				   summary_interval_fname
+				   ? "--summary-interval-output"
+				   : "--summary-interval-cumulative");
+	}
+
+	if (summary_interval_fname) {
+		summary_interval_fp = fopen_stream(summary_interval_fname, "w");
+		if (!summary_interval_fp)
+			perror_msg_and_die("%s", summary_interval_fname);
+		enable_count_percentiles();
+	}
+
 	if (sortby_set && !cflag) {
 		error_msg("-S/--summary-sort-by has no effect without"
 			  " (-c/--summary-only or -C/--summary)");
@@ -2755,11 +3424,70 @@ init(int argc, char *argv[])
 		if (open_append)
 			error_msg("-A/--output-append-mode has no effect "
 				  "without -o/--output");
+		if (output_ring_size)
+			error_msg("--output-ring has no effect "
+				  "without -o/--output");
+		if (bintrace_recording)
+			error_msg_and_help("--format=binary requires"
+					   " -o/--output");
+		if (flight_recorder_size)
+			error_msg_and_help("--flight-recorder requires"
+					   " -o/--output");
+	}
+
+	if (flight_recorder_trigger_set && !flight_recorder_size)
+		error_msg_and_help("--flight-recorder-trigger must be given"
+				   " with --flight-recorder");
+
+	if (flight_recorder_size && bintrace_recording)
+		error_msg_and_help("--flight-recorder and --format=binary"
+				   " are mutually exclusive");
+
+	if (bintrace_recording) {
+		if (output_separately)
+			error_msg_and_help("--format=binary and"
+					   " -ff/--output-separately"
+					   " are mutually exclusive");
+		if (cflag)
+			error_msg_and_help("--format=binary and"
+					   " (-c/--summary-only or -C/--summary)"
+					   " are mutually exclusive");
+	}
+
+	if (output_ring_size && output_separately && outfname)
+		error_msg_and_help("--output-ring and -ff/--output-separately"
+				   " are mutually exclusive");
+
+	/*
+	 * The binary trace contains only the data fetched from the tracee
+	 * memory and the paths of descriptors.
+	 */
+	if (bintrace_recording || replay_fname) {
+		const char *const mode =
+			replay_fname ? "--replay" : "--format=binary";
+
+		if (stack_trace_enabled)
+			error_msg_and_help("-k/--stack-traces cannot be used"
+					   " with %s", mode);
+#ifdef ENABLE_SECONTEXT
+		if (!number_set_array_is_empty(secontext_set, 0))
+			error_msg_and_help("--secontext cannot be used"
+					   " with %s", mode);
+#endif
+		if (!number_set_array_is_empty(decode_pid_set, 0))
+			error_msg_and_help("--decode-pids cannot be used"
+					   " with %s", mode);
+		if (is_number_in_set(DECODE_FD_SOCKET, decode_fd_set) ||
+		    is_number_in_set(DECODE_FD_DEV, decode_fd_set) ||
+		    is_number_in_set(DECODE_FD_PIDFD, decode_fd_set))
+			error_msg_and_help("only paths of file descriptors"
+					   " can be decoded with %s", mode);
 	}
 
-#ifndef HAVE_OPEN_MEMSTREAM
+#if !defined HAVE_FOPENCOOKIE && !defined HAVE_OPEN_MEMSTREAM
 	if (!is_complete_set(status_set, NUMBER_OF_STATUSES))
-		error_msg_and_help("open_memstream is required to use -z, -Z, or -e status");
+		error_msg_and_help("fopencookie or open_memstream is required"
+				   " to use -z, -Z, or -e status");
 #endif
 
 	if (zflags > 1)
@@ -2781,6 +3509,8 @@ init(int argc, char *argv[])
 #ifdef ENABLE_STACKTRACE
 	if (stack_trace_enabled)
 		unwind_init();
+	if (stack_trace_ids)
+		stack_ids_start(stack_ids_fname);
 #endif
 
 	/* See if they want to run as another user. */
@@ -2857,12 +3587,36 @@ init(int argc, char *argv[])
 		setvbuf(shared_log, NULL, _IOLBF, 0);
 	}
 
-	/*
-	 * argv[0]	-pPID	-oFILE	Default interactive setting
-	 * yes		*	0	INTR_WHILE_WAIT
-	 * no		1	0	INTR_WHILE_WAIT
-	 * yes		*	1	INTR_NEVER
-	 * no		1	1	INTR_WHILE_WAIT
+	if (bintrace_recording) {
+		/* The output file receives the binary trace instead.  */
+		bintrace_start_recording(shared_log);
+		shared_log = fopen("/dev/null", "w");
+		if (!shared_log)
+			perror_msg_and_die("/dev/null");
+	}
+
+	if (replay_fname) {
+		bintrace_start_replay(replay_fname);
+		bintrace_replaying = true;
+	}
+
+	if (attach_cgroup_path) {
+		char *procs = xasprintf("%s/cgroup.procs", attach_cgroup_path);
+
+		attach_cgroup_fp = fopen_stream(procs, "r");
+		if (!attach_cgroup_fp)
+			perror_msg_and_die("%s", procs);
+		free(procs);
+		attach_cgroup_skip_set = alloc_number_set_array(1);
+		attach_cgroup_listed_set = alloc_number_set_array(1);
+	}
+
+	/*
+	 * argv[0]	-pPID	-oFILE	Default interactive setting
+	 * yes		*	0	INTR_WHILE_WAIT
+	 * no		1	0	INTR_WHILE_WAIT
+	 * yes		*	1	INTR_NEVER
+	 * no		1	1	INTR_WHILE_WAIT
 	 */
 
 	if (daemonized_tracer && !opt_intr)
@@ -2926,6 +3680,9 @@ init(int argc, char *argv[])
 		set_sighandler(SIGTERM, interactive ? interrupt : SIG_IGN, NULL);
 	}
 
+	if (flight_recorder_size)
+		set_sighandler(SIGUSR1, flight_recorder_sighandler, NULL);
+
 	sigemptyset(&timer_set);
 	sigaddset(&timer_set, SIGALRM);
 	sigprocmask(SIG_BLOCK, &timer_set, NULL);
@@ -2934,13 +3691,25 @@ init(int argc, char *argv[])
 	if (nprocs != 0 || daemonized_tracer)
 		startup_attach();
 
+	if (attach_cgroup_fp && !interrupted) {
+		attach_cgroup(false);
+		start_attach_cgroup_timer();
+	}
+
+	if (event_loop == EVENT_LOOP_EPOLL)
+		init_epoll_event_loop();
+
+	if (ts_nz(&summary_interval))
+		start_summary_interval_timer();
+
 	/* Do we want pids printed in our -o OUTFILE?
 	 * -ff: no (every pid has its own file); or
 	 * -f: yes (there can be more pids in the future); or
 	 * -p PID1,PID2: yes (there are already more than one pid)
 	 */
 	print_pid_pfx = outfname && !output_separately &&
-		((followfork && !output_separately) || nprocs > 1);
+		((followfork && !output_separately) || nprocs > 1
+		 || attach_cgroup_fp);
 }
 
 static struct tcb *
@@ -2949,23 +3718,7 @@ pid2tcb(const int pid)
 	if (pid <= 0)
 		return NULL;
 
-#define PID2TCB_CACHE_SIZE 1024U
-#define PID2TCB_CACHE_MASK (PID2TCB_CACHE_SIZE - 1)
-
-	static struct tcb *pid2tcb_cache[PID2TCB_CACHE_SIZE];
-	struct tcb **const ptcp = &pid2tcb_cache[pid & PID2TCB_CACHE_MASK];
-	struct tcb *tcp = *ptcp;
-
-	if (tcp && tcp->pid == pid)
-		return tcp;
-
-	for (unsigned int i = 0; i < tcbtabsize; ++i) {
-		tcp = tcbtab[i];
-		if (tcp->pid == pid)
-			return *ptcp = tcp;
-	}
-
-	return NULL;
+	return pid_hash_lookup(pid);
 }
 
 static void
@@ -2993,6 +3746,12 @@ interrupt(int sig)
 	interrupted = sig;
 }
 
+static void
+flight_recorder_sighandler(int sig)
+{
+	flight_recorder_dump_requested = 1;
+}
+
 static void
 print_debug_info(const int pid, int status)
 {
@@ -3118,12 +3877,17 @@ maybe_switch_tcbs(struct tcb *tcp, const int pid)
 	FILE *fp = execve_thread->outf;
 	execve_thread->outf = tcp->outf;
 	tcp->outf = fp;
-	if (execve_thread->staged_output_data || tcp->staged_output_data) {
-		struct staged_output_data *staged_output_data;
-
-		staged_output_data = execve_thread->staged_output_data;
-		execve_thread->staged_output_data = tcp->staged_output_data;
-		tcp->staged_output_data = staged_output_data;
+	struct staged_output_data *const execve_sod = execve_thread->cold
+		? execve_thread->cold->staged_output_data : NULL;
+	struct staged_output_data *const sod = tcp->cold
+		? tcp->cold->staged_output_data : NULL;
+	if (execve_sod || sod) {
+		get_tcb_cold(execve_thread)->staged_output_data = sod;
+		get_tcb_cold(tcp)->staged_output_data = execve_sod;
+	}
+	if ((execve_thread->flags ^ tcp->flags) & TCB_STAGED_OUTPUT) {
+		execve_thread->flags ^= TCB_STAGED_OUTPUT;
+		tcp->flags ^= TCB_STAGED_OUTPUT;
 	}
 
 	/* And their column positions */
@@ -3133,7 +3897,9 @@ maybe_switch_tcbs(struct tcb *tcp, const int pid)
 	droptcb(tcp);
 	/* Switch to the thread, reusing leader's outfile and pid */
 	tcp = execve_thread;
+	pid_hash_remove(tcp);
 	tcp->pid = pid;
+	pid_hash_insert(tcp);
 	if (cflag != CFLAG_ONLY_STATS) {
 		if (!is_number_in_set(QUIET_THREAD_EXECVE, quiet_set)) {
 			printleader(tcp);
@@ -3167,6 +3933,9 @@ maybe_switch_current_tcp(void)
 static void
 print_signalled(struct tcb *tcp, const int pid, int status)
 {
+	if (bintrace_recording)
+		bintrace_record_status(tcp, BINTRACE_SIGNALLED, status);
+
 	if (pid == strace_child) {
 		exit_code = 0x100 | WTERMSIG(status);
 		strace_child = 0;
@@ -3180,11 +3949,17 @@ print_signalled(struct tcb *tcp, const int pid, int status)
 			WCOREDUMP(status) ? "(core dumped) " : "");
 		line_ended();
 	}
+
+	if (flight_recorder_size)
+		flight_recorder_signalled(WTERMSIG(status));
 }
 
 static void
 print_exited(struct tcb *tcp, const int pid, int status)
 {
+	if (bintrace_recording)
+		bintrace_record_status(tcp, BINTRACE_EXITED, status);
+
 	if (pid == strace_child) {
 		exit_code = WEXITSTATUS(status);
 		strace_child = 0;
@@ -3201,6 +3976,9 @@ print_exited(struct tcb *tcp, const int pid, int status)
 static void
 print_stopped(struct tcb *tcp, const siginfo_t *si, const unsigned int sig)
 {
+	if (bintrace_recording && !hide_log(tcp))
+		bintrace_record_signal(tcp, si, sig);
+
 	if (cflag != CFLAG_ONLY_STATS
 	    && !hide_log(tcp)
 	    && is_number_in_set(sig, signal_set)) {
@@ -3241,8 +4019,11 @@ startup_tcb(struct tcb *tcp)
 	if ((tcp->flags & TCB_GRABBED) && (get_scno(tcp) == 1))
 		tcp->s_prev_ent = tcp->s_ent;
 
+	pidns_add_tracee(tcp);
+
 	if (cflag) {
-		tcp->atime = tcp->stime;
+		struct tcb_cold *const cold = get_tcb_cold(tcp);
+		cold->atime = cold->stime;
 	}
 }
 
@@ -3254,6 +4035,9 @@ print_event_exit(struct tcb *tcp)
 		return;
 	}
 
+	if (bintrace_recording)
+		bintrace_record_status(tcp, BINTRACE_STOP_BEFORE_EXIT, 0);
+
 	if (!output_separately && printing_tcp && printing_tcp != tcp
 	    && printing_tcp->curcol != 0) {
 		set_current_tcp(printing_tcp);
@@ -3322,34 +4106,134 @@ tcb_wait_tab_check_size(const size_t size)
 	}
 }
 
+static void
+queue_extra_event(const int pid, const size_t wait_data_idx)
+{
+	if (extra_events_count >= extra_events_size)
+		extra_events = xgrowarray(extra_events, &extra_events_size,
+					  sizeof(*extra_events));
+
+	extra_events[extra_events_count].pid = pid;
+	extra_events[extra_events_count].wait_data_idx = wait_data_idx;
+	extra_events_count++;
+}
+
+static int
+tcb_pid_cmp(const void *a, const void *b)
+{
+	const int pid_a = (*(const struct tcb *const *) a)->pid;
+	const int pid_b = (*(const struct tcb *const *) b)->pid;
+
+	return (pid_a > pid_b) - (pid_a < pid_b);
+}
+
+/* Sort the queue of at most count pending tcbs by pid.  */
+static void
+sort_tcbs_by_pid(struct list_item *queue, const size_t count)
+{
+	static struct tcb **tcps;
+	static size_t tcps_size;
+
+	while (count > tcps_size)
+		tcps = xgrowarray(tcps, &tcps_size, sizeof(*tcps));
+
+	size_t n = 0;
+	for (struct list_item *elem; (elem = list_remove_head(queue)); )
+		tcps[n++] = list_elem(elem, struct tcb, wait_list);
+
+	qsort(tcps, n, sizeof(*tcps), tcb_pid_cmp);
+
+	for (size_t i = 0; i < n; ++i)
+		list_append(queue, &tcps[i]->wait_list);
+}
+
+static void
+account_event_batch(const size_t events)
+{
+	unsigned int bucket = 0;
+
+	for (size_t n = events; n > 1 && bucket < EVENT_BATCH_HIST_SIZE - 1;
+	     n >>= 1)
+		++bucket;
+
+	event_batch_stats.wakeups++;
+	event_batch_stats.events += events;
+	event_batch_stats.hist[bucket]++;
+	if (events > event_batch_stats.max_events)
+		event_batch_stats.max_events = events;
+}
+
+static void
+print_event_batch_stats(void)
+{
+	char buf[EVENT_BATCH_HIST_SIZE * (sizeof(" 128+:") + 20)];
+	char *p = buf;
+
+	buf[0] = '\0';
+	for (unsigned int i = 0; i < EVENT_BATCH_HIST_SIZE; ++i) {
+		if (!event_batch_stats.hist[i])
+			continue;
+		if (i == EVENT_BATCH_HIST_SIZE - 1)
+			p = xappendstr(buf, p, " %u+:%" PRIu64, 1U << i,
+				       event_batch_stats.hist[i]);
+		else if (i)
+			p = xappendstr(buf, p, " %u-%u:%" PRIu64, 1U << i,
+				       (2U << i) - 1, event_batch_stats.hist[i]);
+		else
+			p = xappendstr(buf, p, " 1:%" PRIu64,
+				       event_batch_stats.hist[i]);
+	}
+
+	debug_msg("next_event: %" PRIu64 " wakeups, %" PRIu64 " events"
+		  ", %.2f events per wakeup, %" PRIu64 " max;"
+		  " events per wakeup histogram:%s",
+		  event_batch_stats.wakeups, event_batch_stats.events,
+		  event_batch_stats.wakeups
+		  ? (double) event_batch_stats.events / event_batch_stats.wakeups
+		  : 0.0,
+		  event_batch_stats.max_events, buf);
+}
+
 static const struct tcb_wait_data *
 next_event(void)
 {
 	if (interrupted)
 		return NULL;
 
-	invalidate_umove_cache();
+	/*
+	 * The expirations of the timers that send SIGALRM are checked
+	 * against the clock below, so a SIGALRM that comes after this point
+	 * is not for an expiration that has been handled.
+	 */
+	timer_fired = 0;
+
+	/*
+	 * The SIGALRM handler only interrupts wait4, and while there are
+	 * events to reap, the timer expirations are not read at all,
+	 * so restart the expired delayed tcbs here.
+	 */
+	if (delayed_tcb_expired() && !restart_delayed_tcbs())
+		return NULL;
+
+	if (summary_interval_expired())
+		print_interval_summary(false);
+
+	if (attach_cgroup_rescan_due())
+		attach_cgroup(true);
+
+	if (flight_recorder_dump_requested) {
+		flight_recorder_dump_requested = 0;
+		flight_recorder_dump("SIGUSR1");
+	}
 
 	struct tcb *tcp = NULL;
 	struct list_item *elem;
 
 	static EMPTY_LIST(pending_tcps);
-	/* Handle the queued tcbs before waiting for new events.  */
-	if (!list_is_empty(&pending_tcps))
+	/* Handle the queued events before waiting for new events.  */
+	if (!list_is_empty(&pending_tcps) || extra_events_count)
 		goto next_event_get_tcp;
 
-	static struct tcb *extra_tcp;
-	static size_t wait_extra_data_idx;
-	/* Handle the extra tcb event.  */
-	if (extra_tcp) {
-		tcp = extra_tcp;
-		extra_tcp = NULL;
-		tcp->wait_data_idx = wait_extra_data_idx;
-
-		debug_msg("dequeued extra event for pid %u", tcp->pid);
-		goto next_event_exit;
-	}
-
 	/*
 	 * Used to exit simply when nprocs hits zero, but in this testcase:
 	 *  int main(void) { _exit(!!fork()); }
@@ -3371,52 +4255,74 @@ next_event(void)
 			return NULL;
 	}
 
-	const bool unblock_delay_timer = is_delay_timer_armed();
+	int status;
+	struct rusage ru;
+	int pid;
+	int wait_errno;
+
+	if (event_loop == EVENT_LOOP_EPOLL) {
+		pid = epoll_wait_event(&status, cflag ? &ru : NULL);
+		wait_errno = errno;
+
+		if (restart_failed)
+			return NULL;
+
+		goto next_event_harvest;
+	}
+
+	const bool unblock_delay_timer = is_delay_timer_armed()
+					 || ts_nz(&summary_interval)
+					 || attach_cgroup_fp;
 
 	/*
-	 * The window of opportunity to handle expirations
-	 * of the delay timer opens here.
+	 * The window of opportunity for the timers to interrupt wait4()
+	 * opens here.
 	 *
-	 * Unblock the signal handler for the delay timer
-	 * iff the delay timer is already created.
+	 * Unblock the signal handler for the timers
+	 * iff any of them is armed.
 	 */
 	if (unblock_delay_timer)
 		sigprocmask(SIG_UNBLOCK, &timer_set, NULL);
 
 	/*
-	 * If the delay timer has expired, then its expiration
-	 * has been handled already by the signal handler.
+	 * If the delay timer has expired after the check above,
+	 * then the signal handler has been called on unblocking,
+	 * and wait4() is not called so that the expiration is handled
+	 * on the next call.
 	 *
 	 * If the delay timer expires during wait4(),
-	 * then the system call will be interrupted and
-	 * the expiration will be handled by the signal handler.
+	 * then the system call will be interrupted.  If it expires
+	 * right before wait4() is called, then it fires again shortly,
+	 * like the other timers do.
 	 */
-	int status;
-	struct rusage ru;
-	int pid = wait4(-1, &status, __WALL, (cflag ? &ru : NULL));
-	int wait_errno = errno;
+	if (timer_fired) {
+		pid = -1;
+		wait_errno = EINTR;
+	} else {
+		pid = wait4(-1, &status, __WALL, (cflag ? &ru : NULL));
+		wait_errno = errno;
+	}
 
 	/*
-	 * The window of opportunity to handle expirations
-	 * of the delay timer closes here.
+	 * The window of opportunity for the timers to interrupt wait4()
+	 * closes here.
 	 *
-	 * Block the signal handler for the delay timer
+	 * Block the signal handler for the timers
 	 * iff it was unblocked earlier.
 	 */
-	if (unblock_delay_timer) {
+	if (unblock_delay_timer)
 		sigprocmask(SIG_BLOCK, &timer_set, NULL);
 
-		if (restart_failed)
-			return NULL;
-	}
-
+next_event_harvest:;
 	size_t wait_tab_pos = 0;
 	bool wait_nohang = false;
 
 	/*
 	 * Wait for new events until wait4() returns 0 (meaning that there's
-	 * nothing more to wait for for now), or a second event for some tcb
-	 * appears (which may happen if a tracee was SIGKILL'ed, for example).
+	 * nothing more to wait for for now), or event_batch_size events
+	 * are harvested.  A second event for some tcb (which may happen
+	 * if a tracee was SIGKILL'ed, for example) is queued separately
+	 * and handled after the first events of all tcbs.
 	 */
 	for (;;) {
 		struct tcb_wait_data *wd;
@@ -3458,8 +4364,9 @@ next_event(void)
 		}
 
 		if (cflag) {
-			tcp->stime.tv_sec = ru.ru_stime.tv_sec;
-			tcp->stime.tv_nsec = ru.ru_stime.tv_usec * 1000;
+			struct tcb_cold *const cold = get_tcb_cold(tcp);
+			cold->stime.tv_sec = ru.ru_stime.tv_sec;
+			cold->stime.tv_nsec = ru.ru_stime.tv_usec * 1000;
 		}
 
 		tcb_wait_tab_check_size(wait_tab_pos);
@@ -3560,8 +4467,7 @@ next_event(void)
 				       "for pid %d, status %0#x", pid, status);
 
 		if (!list_is_empty(&tcp->wait_list)) {
-			wait_extra_data_idx = wait_tab_pos;
-			extra_tcp = tcp;
+			queue_extra_event(tcp->pid, wait_tab_pos);
 			debug_func_msg("queued extra pid %d", tcp->pid);
 		} else {
 			tcp->wait_data_idx = wait_tab_pos;
@@ -3571,7 +4477,7 @@ next_event(void)
 
 		wait_tab_pos++;
 
-		if (extra_tcp)
+		if (event_batch_size && wait_tab_pos >= event_batch_size)
 			break;
 
 next_event_wait_next:
@@ -3580,20 +4486,44 @@ next_event_wait_next:
 		wait_nohang = true;
 	}
 
+	if (wait_tab_pos) {
+		account_event_batch(wait_tab_pos);
+		if (event_batch_size && wait_tab_pos > 1)
+			sort_tcbs_by_pid(&pending_tcps, wait_tab_pos);
+	}
+
 next_event_get_tcp:
 	elem = list_remove_head(&pending_tcps);
 
-	if (!elem) {
-		tcb_wait_tab_check_size(0);
-		memset(tcb_wait_tab, 0, sizeof(*tcb_wait_tab));
-		tcb_wait_tab->te = TE_NEXT;
-
-		return tcb_wait_tab;
-	} else {
+	if (elem) {
 		tcp = list_elem(elem, struct tcb, wait_list);
 		debug_func_msg("dequeued pid %d", tcp->pid);
+		goto next_event_exit;
 	}
 
+	while (extra_events_pos < extra_events_count) {
+		const struct extra_event *const ev =
+			&extra_events[extra_events_pos++];
+
+		/* The tcb may have been dropped by its first event.  */
+		tcp = pid2tcb(ev->pid);
+		if (!tcp) {
+			debug_msg("dropped extra event for pid %d", ev->pid);
+			continue;
+		}
+
+		tcp->wait_data_idx = ev->wait_data_idx;
+		debug_msg("dequeued extra event for pid %d", tcp->pid);
+		goto next_event_exit;
+	}
+	extra_events_count = extra_events_pos = 0;
+
+	tcb_wait_tab_check_size(0);
+	memset(tcb_wait_tab, 0, sizeof(*tcb_wait_tab));
+	tcb_wait_tab->te = TE_NEXT;
+
+	return tcb_wait_tab;
+
 next_event_exit:
 	/* Is this the very first time we see this tracee stopped? */
 	if (tcp->flags & TCB_STARTUP)
@@ -3612,11 +4542,15 @@ trace_syscall(struct tcb *tcp, unsigned int *sig)
 {
 	if (entering(tcp)) {
 		int res = syscall_entering_decode(tcp);
+		if (res != 0 && bintrace_recording)
+			bintrace_record_syscall_entering(tcp, res);
 		switch (res) {
 		case 0:
 			return 0;
 		case 1:
 			res = syscall_entering_trace(tcp, sig);
+			if (bintrace_recording && filtered(tcp))
+				bintrace_cancel_event();
 		}
 		syscall_entering_finish(tcp, res);
 		return res;
@@ -3624,7 +4558,11 @@ trace_syscall(struct tcb *tcp, unsigned int *sig)
 		struct timespec ts = {};
 		int res = syscall_exiting_decode(tcp, &ts);
 		if (res != 0) {
+			if (bintrace_recording)
+				bintrace_record_syscall_exiting(tcp, res);
 			res = syscall_exiting_trace(tcp, &ts, res);
+			if (flight_recorder_size)
+				flight_recorder_syscall_exiting(tcp);
 		}
 		syscall_exiting_finish(tcp);
 		return res;
@@ -3812,11 +4750,13 @@ dispatch_event(const struct tcb_wait_data *wd)
 
 	/* If the process is being delayed, do not ptrace_restart just yet */
 	if (syscall_delayed(current_tcp)) {
-		if (current_tcp->delayed_wait_data)
+		struct tcb_cold *const cold = get_tcb_cold(current_tcp);
+
+		if (cold->delayed_wait_data)
 			error_func_msg("pid %d has delayed wait data set"
 				       " already", current_tcp->pid);
 
-		current_tcp->delayed_wait_data = copy_trace_wait_data(wd);
+		cold->delayed_wait_data = copy_trace_wait_data(wd);
 
 		return true;
 	}
@@ -3829,10 +4769,201 @@ dispatch_event(const struct tcb_wait_data *wd)
 	return true;
 }
 
+/*
+ * A number without a unit is a number of seconds,
+ * otherwise the time specification format of -O is accepted.
+ */
+static int
+parse_summary_interval(const char *str)
+{
+	const size_t len = strlen(str);
+	char *spec = len && (isdigit((unsigned char) str[len - 1])
+			     || str[len - 1] == '.')
+		     ? xasprintf("%ss", str) : xstrdup(str);
+	int rc = parse_ts(spec, &summary_interval);
+
+	free(spec);
+
+	return rc || !ts_nz(&summary_interval) ? -1 : 0;
+}
+
+static void
+start_summary_interval_timer(void)
+{
+	const struct itimerspec its = {
+		.it_interval = summary_interval,
+		.it_value = summary_interval,
+	};
+	timer_t timer;
+
+	if (timer_create(CLOCK_MONOTONIC, NULL, &timer))
+		perror_msg_and_die("timer_create");
+
+	clock_gettime(CLOCK_MONOTONIC, &summary_interval_origin);
+	summary_interval_start = summary_interval_origin;
+	ts_add(&summary_interval_end, &summary_interval_start,
+	       &summary_interval);
+
+	if (timer_settime(timer, 0, &its, NULL))
+		perror_msg_and_die("timer_settime");
+}
+
+static bool
+summary_interval_expired(void)
+{
+	if (!ts_nz(&summary_interval))
+		return false;
+
+	struct timespec ts_now;
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+
+	return ts_cmp(&ts_now, &summary_interval_end) >= 0;
+}
+
+static bool
+is_tracer_process(const int pid)
+{
+	return pid == strace_tracer_pid || pid == popen_pid;
+}
+
+/*
+ * Attaches to the processes listed in cgroup.procs that are not traced yet.
+ * Returns the number of the processes attached.
+ */
+static unsigned int
+attach_cgroup_pass(const bool rescan)
+{
+	unsigned int nattached = 0;
+	int pid;
+
+	rewind(attach_cgroup_fp);
+
+	while (!interrupted && fscanf(attach_cgroup_fp, "%d", &pid) == 1) {
+		if (pid <= 0 || pid2tcb(pid) || is_tracer_process(pid))
+			continue;
+
+		if (is_number_in_set(pid, attach_cgroup_skip_set)) {
+			add_number_to_set(pid, attach_cgroup_listed_set);
+			continue;
+		}
+
+		/*
+		 * On rescans, the processes forked by the tracees
+		 * are attached by the kernel already, they fail with EPERM,
+		 * so only the processes that cannot be attached
+		 * on the first scan are skipped.
+		 */
+		const int err = attach_tcb(alloctcb(pid), rescan);
+
+		if (!err) {
+			++nattached;
+		} else if (err == EPERM && !rescan) {
+			add_number_to_set(pid, attach_cgroup_skip_set);
+			add_number_to_set(pid, attach_cgroup_listed_set);
+		}
+	}
+
+	if (ferror(attach_cgroup_fp)) {
+		perror_msg("%s/cgroup.procs", attach_cgroup_path);
+		fclose(attach_cgroup_fp);
+		attach_cgroup_fp = NULL;
+		if (rescan)
+			timer_delete(attach_cgroup_timer);
+	}
+
+	return nattached;
+}
+
+/*
+ * Repeats the passes over cgroup.procs until a pass finds no new processes,
+ * so the processes forked by the members during the scan are not missed.
+ */
+static void
+attach_cgroup(const bool rescan)
+{
+	unsigned int npasses = 1;
+
+	while (attach_cgroup_fp && attach_cgroup_pass(rescan) && !interrupted)
+		++npasses;
+
+	/* Forget the skipped processes that have left the cgroup.  */
+	if (!interrupted) {
+		free_number_set_array(attach_cgroup_skip_set, 1);
+		attach_cgroup_skip_set = attach_cgroup_listed_set;
+		attach_cgroup_listed_set = alloc_number_set_array(1);
+	}
+
+	debug_msg("%s %s in %u passes", rescan ? "rescanned" : "scanned",
+		  attach_cgroup_path, npasses);
+
+	struct timespec ts_now;
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+	ts_add(&attach_cgroup_next_scan, &ts_now, &attach_cgroup_interval);
+}
+
+static void
+start_attach_cgroup_timer(void)
+{
+	const struct itimerspec its = {
+		.it_interval = attach_cgroup_interval,
+		.it_value = attach_cgroup_interval,
+	};
+
+	if (!attach_cgroup_fp)
+		return;
+
+	if (timer_create(CLOCK_MONOTONIC, NULL, &attach_cgroup_timer))
+		perror_msg_and_die("timer_create");
+
+	if (timer_settime(attach_cgroup_timer, 0, &its, NULL))
+		perror_msg_and_die("timer_settime");
+}
+
+static bool
+attach_cgroup_rescan_due(void)
+{
+	if (!attach_cgroup_fp)
+		return false;
+
+	struct timespec ts_now;
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+
+	return ts_cmp(&ts_now, &attach_cgroup_next_scan) >= 0;
+}
+
+/*
+ * Prints the summary of the calls made since the end of the previous
+ * interval and starts the next one.  The counters are only updated
+ * from the main loop, so no syscall is lost or counted twice.
+ */
+static void
+print_interval_summary(bool final)
+{
+	struct timespec ts_now, start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+	ts_sub(&start, &summary_interval_start, &summary_interval_origin);
+	ts_sub(&end, &ts_now, &summary_interval_origin);
+
+	call_summary_interval(shared_log, summary_interval_fp, &start, &end,
+			      summary_interval_cumulative && !final);
+
+	summary_interval_start = ts_now;
+	/* Skip the intervals missed, if any.  */
+	while (ts_cmp(&summary_interval_end, &ts_now) <= 0)
+		ts_add(&summary_interval_end, &summary_interval_end,
+		       &summary_interval);
+}
+
 static bool
 restart_delayed_tcb(struct tcb *const tcp)
 {
-	struct tcb_wait_data *wd = tcp->delayed_wait_data;
+	struct tcb_cold *const cold = get_tcb_cold(tcp);
+	struct tcb_wait_data *const delayed_wd = cold->delayed_wait_data;
+	struct tcb_wait_data *wd = delayed_wd;
+
+	/* The tcb can be dropped by dispatch_event.  */
+	cold->delayed_wait_data = NULL;
 
 	if (!wd) {
 		error_func_msg("No delayed wait data found for pid %d",
@@ -3851,8 +4982,7 @@ restart_delayed_tcb(struct tcb *const tcp)
 	bool ret = dispatch_event(wd);
 	current_tcp = prev_tcp;
 
-	free_trace_wait_data(tcp->delayed_wait_data);
-	tcp->delayed_wait_data = NULL;
+	free_trace_wait_data(delayed_wd);
 
 	return ret;
 }
@@ -3860,54 +4990,215 @@ restart_delayed_tcb(struct tcb *const tcp)
 static bool
 restart_delayed_tcbs(void)
 {
-	struct tcb *tcp_next = NULL;
 	struct timespec ts_now;
+	struct tcb *tcp;
 
 	clock_gettime(CLOCK_MONOTONIC, &ts_now);
 
-	for (size_t i = 0; i < tcbtabsize; i++) {
-		struct tcb *tcp = tcbtab[i];
-
-		if (tcp->pid && syscall_delayed(tcp)) {
-			if (ts_cmp(&ts_now, &tcp->delay_expiration_time) > 0) {
-				if (!restart_delayed_tcb(tcp))
-					return false;
-			} else {
-				/* Check whether this tcb is the next.  */
-				if (!tcp_next ||
-				    ts_cmp(&tcp_next->delay_expiration_time,
-					   &tcp->delay_expiration_time) > 0) {
-					tcp_next = tcp;
-				}
-			}
-		}
+	while ((tcp = pop_expired_delayed_tcb(&ts_now))) {
+		if (!restart_delayed_tcb(tcp))
+			return false;
 	}
 
-	if (tcp_next)
-		arm_delay_timer(tcp_next);
+	arm_delay_timer();
 
 	return true;
 }
 
 /*
- * As this signal handler does a lot of work that is not suitable
- * for signal handlers, extra care must be taken to ensure that
- * it is enabled only in those places where it's safe.
+ * This signal handler is enabled only around wait4() in next_event()
+ * to interrupt it, the expirations are handled by next_event().
  */
 static void
 timer_sighandler(int sig)
 {
-	delay_timer_expired();
+	timer_fired = 1;
+}
 
-	if (restart_failed)
-		return;
+static void
+init_epoll_event_loop(void)
+{
+#ifdef HAVE_SYS_SIGNALFD_H
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGALRM);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	event_signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (event_signal_fd < 0)
+		perror_msg_and_die("signalfd");
+
+	event_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (event_epoll_fd < 0)
+		perror_msg_and_die("epoll_create1");
+
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.fd = event_signal_fd,
+	};
+	if (epoll_ctl(event_epoll_fd, EPOLL_CTL_ADD, event_signal_fd, &ev))
+		perror_msg_and_die("epoll_ctl");
+
+	/* Delay timer expirations are read from a timerfd if possible.  */
+	const int timer_fd = create_delay_timerfd();
+	if (timer_fd >= 0) {
+		ev.data.fd = timer_fd;
+		if (epoll_ctl(event_epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev))
+			perror_msg_and_die("epoll_ctl");
+	}
+
+	debug_msg("epoll event loop: epoll fd %d, signalfd %d, timerfd %d",
+		  event_epoll_fd, event_signal_fd, timer_fd);
+#endif /* HAVE_SYS_SIGNALFD_H */
+}
+
+/*
+ * Consume pending signals from the signalfd.  Expirations of the delay timer
+ * that sends SIGALRM, used when there is no timerfd, are handled here,
+ * in the main loop context rather than in a signal handler.
+ */
+static void
+drain_event_signal_fd(void)
+{
+#ifdef HAVE_SYS_SIGNALFD_H
+	struct signalfd_siginfo si[8];
+	bool timer_expired = false;
+	ssize_t rc;
+
+	while ((rc = read(event_signal_fd, si, sizeof(si))) > 0) {
+		for (size_t i = 0; i < rc / sizeof(si[0]); ++i) {
+			if (si[i].ssi_signo == SIGALRM)
+				timer_expired = true;
+		}
+	}
+	if (rc < 0 && errno != EAGAIN && errno != EINTR)
+		perror_msg_and_die("read signalfd");
+
+	if (timer_expired) {
+		delay_timer_expired();
+		if (!restart_delayed_tcbs())
+			restart_failed = 1;
+	}
+#endif /* HAVE_SYS_SIGNALFD_H */
+}
+
+/*
+ * The epoll counterpart of the blocking wait4(__WALL) in next_event():
+ * returns the same as wait4 would, sleeping in epoll_wait
+ * while there is nothing to reap.
+ */
+static int
+epoll_wait_event(int *status, struct rusage *ru)
+{
+	for (;;) {
+		int pid = wait4(-1, status, __WALL | WNOHANG, ru);
+
+		if (pid)
+			return pid;
+
+		struct epoll_event ev;
+		int rc = epoll_wait(event_epoll_fd, &ev, 1, -1);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				return -1;
+			perror_msg_and_die("epoll_wait");
+		}
+
+		drain_event_signal_fd();
+
+		if (delay_timerfd_expired() && !restart_delayed_tcbs())
+			restart_failed = 1;
+
+		if (restart_failed || interrupted
+		    || summary_interval_expired()
+		    || attach_cgroup_rescan_due()) {
+			errno = EINTR;
+			return -1;
+		}
+	}
+}
 
-	int saved_errno = errno;
+/* Feeds the events recorded in the binary trace to the decoders.  */
+static void
+replay_trace(void)
+{
+	const struct bintrace_record *rec;
+
+	while (!interrupted && (rec = bintrace_next_event())) {
+		struct tcb *tcp = pid2tcb(rec->pid);
+
+		if (!tcp) {
+			tcp = alloctcb(rec->pid);
+			after_successful_attach(tcp, 0);
+		}
+		set_current_tcp(tcp);
+
+		switch (rec->type) {
+		case BINTRACE_SYSCALL_ENTERING: {
+			const struct bintrace_syscall_entering *e =
+				(const void *) rec;
+			unsigned int sig = 0;
+			int res = syscall_entering_replay(tcp, e->personality,
+							  e->scno, e->true_scno,
+							  e->args, e->res);
+			if (res == 1)
+				res = syscall_entering_trace(tcp, &sig);
+			syscall_entering_finish(tcp, res);
+			break;
+		}
 
-	if (!restart_delayed_tcbs())
-		restart_failed = 1;
+		case BINTRACE_SYSCALL_EXITING: {
+			const struct bintrace_syscall_exiting *e =
+				(const void *) rec;
+			struct timespec ts = {};
 
-	errno = saved_errno;
+			if (entering(tcp))
+				break;
+			int res = syscall_exiting_replay(tcp, e->rval, e->error,
+							 &ts, e->res);
+			if (res != 0)
+				syscall_exiting_trace(tcp, &ts, res);
+			syscall_exiting_finish(tcp);
+			break;
+		}
+
+		case BINTRACE_SIGNAL:
+		case BINTRACE_GROUP_STOP: {
+			const struct bintrace_signal *s = (const void *) rec;
+
+			print_stopped(tcp, rec->type == BINTRACE_SIGNAL
+					   ? &s->si : NULL, s->sig);
+			break;
+		}
+
+		case BINTRACE_STOP_BEFORE_EXIT:
+			print_event_exit(tcp);
+			break;
+
+		case BINTRACE_EXITED:
+			print_exited(tcp, tcp->pid,
+				     ((const struct bintrace_status *) rec)->status);
+			droptcb(tcp);
+			break;
+
+		case BINTRACE_SIGNALLED:
+			print_signalled(tcp, tcp->pid,
+					((const struct bintrace_status *) rec)->status);
+			droptcb(tcp);
+			break;
+		}
+	}
+
+	/* The rest of the tracees have been detached.  */
+	for (unsigned int i = 0; i < tcbtabsize; ++i) {
+		if (tcbtab[i]->pid)
+			droptcb(tcbtab[i]);
+	}
+
+	bintrace_finish_replay();
 }
 
 static void ATTRIBUTE_NORETURN
@@ -3916,11 +5207,31 @@ terminate(void)
 	int sig = interrupted;
 
 	cleanup(sig);
-	if (cflag)
+	if (debug_flag) {
+		print_pid_hash_stats();
+		print_event_batch_stats();
+		print_umove_cache_stats();
+		print_fd_path_cache_stats();
+		print_sockaddr_cache_stats();
+		print_pidns_stats();
+		print_mmap_cache_stats();
+		print_flight_recorder_stats();
+	}
+	if (cflag) {
+		if (ts_nz(&summary_interval))
+			print_interval_summary(true);
 		call_summary(shared_log);
+	}
+	if (summary_interval_fp)
+		fclose(summary_interval_fp);
+	if (bintrace_recording)
+		bintrace_finish_recording();
+	if (stack_trace_ids)
+		stack_ids_finish(shared_log);
 	fflush(NULL);
 	if (shared_log != stderr)
 		fclose(shared_log);
+	output_ring_finish();
 	if (popen_pid) {
 		while (waitpid(popen_pid, NULL, 0) < 0 && errno == EINTR)
 			;
@@ -3962,6 +5273,15 @@ main(int argc, char *argv[])
 	setlocale(LC_ALL, "");
 	init(argc, argv);
 
+	if (replay_fname) {
+		replay_trace();
+		terminate();
+	}
+	if (symbolize_fname) {
+		stack_ids_symbolize(symbolize_fname, shared_log);
+		terminate();
+	}
+
 	exit_code = !nprocs;
 
 	while (dispatch_event(next_event()))
@@ -13,6 +13,7 @@
  */
 
 #include "defs.h"
+#include "bintrace.h"
 #include "get_personality.h"
 #include "mmap_notify.h"
 #include "native_defs.h"
@@ -24,6 +25,7 @@
 #include "poke.h"
 #include "retval.h"
 #include "fault.h"
+#include "secontext.h"
 #include <limits.h>
 #include <fcntl.h>
 
@@ -444,6 +446,7 @@ print_err_ret(kernel_ulong_t ret, unsigned long u_error)
 
 static long get_regs(struct tcb *);
 static int get_syscall_args(struct tcb *);
+static void set_syscall_entry(struct tcb *);
 static int get_syscall_result(struct tcb *);
 static void get_error(struct tcb *, bool);
 static void set_error(struct tcb *, unsigned long);
@@ -464,16 +467,20 @@ struct inject_opts *inject_vec[SUPPORTED_PERSONALITIES];
 static struct inject_opts *
 tcb_inject_opts(struct tcb *tcp)
 {
-	return (scno_in_range(tcp->scno) && tcp->inject_vec[current_personality])
-	       ? &tcp->inject_vec[current_personality][tcp->scno] : NULL;
+	struct inject_opts *const vec =
+		tcp->cold ? tcp->cold->inject_vec[current_personality] : NULL;
+
+	return (scno_in_range(tcp->scno) && vec) ? &vec[tcp->scno] : NULL;
 }
 
 
 static long
 tamper_with_syscall_entering(struct tcb *tcp, unsigned int *signo)
 {
-	if (!tcp->inject_vec[current_personality]) {
-		tcp->inject_vec[current_personality] =
+	struct tcb_cold *const cold = get_tcb_cold(tcp);
+
+	if (!cold->inject_vec[current_personality]) {
+		cold->inject_vec[current_personality] =
 			xarraydup(inject_vec[current_personality],
 				  nsyscalls, sizeof(**inject_vec));
 	}
@@ -615,6 +622,8 @@ syscall_entering_decode(struct tcb *tcp)
 	}
 #endif
 
+	update_fd_path_cache(tcp);
+
 	return 1;
 }
 
@@ -669,6 +678,8 @@ syscall_entering_trace(struct tcb *tcp, unsigned int *sig)
 	if (!is_complete_set(status_set, NUMBER_OF_STATUSES))
 		strace_open_memstream(tcp);
 
+	prefetch_syscall_args(tcp);
+
 	printleader(tcp);
 	tprints_arg_begin(tcp_sysent(tcp)->sys_name);
 	int res = raw(tcp) ? printargs(tcp) : tcp_sysent(tcp)->sys_func(tcp);
@@ -684,14 +695,16 @@ syscall_entering_finish(struct tcb *tcp, int res)
 
 	/* Measure the entrance time as late as possible to avoid errors. */
 	if ((Tflag || cflag) && !filtered(tcp))
-		clock_gettime(CLOCK_MONOTONIC, &tcp->etime);
+		get_trace_time(CLOCK_MONOTONIC, &get_tcb_cold(tcp)->etime);
 
 	/* Start tracking system time */
 	if (cflag) {
+		struct tcb_cold *const cold = get_tcb_cold(tcp);
+
 		if (debug_flag) {
 			struct timespec dt;
 
-			ts_sub(&dt, &tcp->stime, &tcp->ltime);
+			ts_sub(&dt, &cold->stime, &cold->ltime);
 
 			if (ts_nz(&dt))
 				debug_func_msg("pid %d: %.9f seconds of system "
@@ -700,7 +713,7 @@ syscall_entering_finish(struct tcb *tcp, int res)
 					       tcp->pid, ts_float(&dt));
 		}
 
-		tcp->ltime = tcp->stime;
+		cold->ltime = cold->stime;
 	}
 }
 
@@ -717,15 +730,21 @@ syscall_exiting_decode(struct tcb *tcp, struct timespec *pts)
 {
 	/* Measure the exit time as early as possible to avoid errors. */
 	if ((Tflag || cflag) && !filtered(tcp))
-		clock_gettime(CLOCK_MONOTONIC, pts);
+		get_trace_time(CLOCK_MONOTONIC, pts);
 
+	/*
+	 * The clients of mmap_notify update their state from the result
+	 * of the syscall, so fetch it even if the syscall is filtered out.
+	 */
 	if (tcp_sysent(tcp)->sys_flags & MEMORY_MAPPING_CHANGE)
-		mmap_notify_report(tcp);
+		mmap_notify_report(tcp, get_syscall_result(tcp) > 0);
 
 	if ((tcp_sysent(tcp)->sys_flags & COMM_CHANGE) && !syserror(tcp) &&
 	    (tcp_sysent(tcp)->sen != SEN_prctl || tcp->u_arg[0] == PR_SET_NAME))
 		maybe_load_task_comm(tcp);
 
+	update_fd_path_cache(tcp);
+
 	if (filtered(tcp))
 		return 0;
 
@@ -741,6 +760,62 @@ syscall_exiting_decode(struct tcb *tcp, struct timespec *pts)
 	return get_syscall_result(tcp);
 }
 
+/*
+ * Counterpart of syscall_entering_decode for a syscall entering
+ * replayed from the binary trace, res is the value returned
+ * by syscall_entering_decode when the trace was recorded.
+ */
+int
+syscall_entering_replay(struct tcb *tcp, const unsigned int personality,
+			const kernel_ulong_t scno,
+			const kernel_ulong_t true_scno,
+			const uint64_t *const args, const int res)
+{
+#if SUPPORTED_PERSONALITIES > 1
+	update_personality(tcp, personality);
+#endif
+
+	tcp->scno = scno;
+	tcp->true_scno = true_scno;
+	tcp->s_ent = NULL;
+	tcp->qual_flg = QUAL_RAW | DEFAULT_QUAL_FLAGS;
+	for (unsigned int i = 0; i < MAX_ARGS; ++i)
+		tcp->u_arg[i] = args[i];
+
+	/* Failed get_scno leaves the syscall number invalid.  */
+	if (res == 1 || scno_is_valid(scno))
+		set_syscall_entry(tcp);
+	/* There is no tracee to tamper with.  */
+	tcp->qual_flg &= ~QUAL_INJECT;
+
+	if (res != 1) {
+		printleader(tcp);
+		tprints_arg_begin(tcp_sysent(tcp)->sys_name);
+	}
+
+	return res;
+}
+
+/*
+ * Counterpart of syscall_exiting_decode for a syscall exiting
+ * replayed from the binary trace.
+ */
+int
+syscall_exiting_replay(struct tcb *tcp, const kernel_long_t rval,
+		       const int error, struct timespec *pts, const int res)
+{
+	if ((Tflag || cflag) && !filtered(tcp))
+		get_trace_time(CLOCK_MONOTONIC, pts);
+
+	if (filtered(tcp))
+		return 0;
+
+	tcp->u_rval = rval;
+	tcp->u_error = error;
+
+	return res;
+}
+
 void
 print_syscall_resume(struct tcb *tcp)
 {
@@ -753,7 +828,8 @@ print_syscall_resume(struct tcb *tcp)
 	 * "strace -ff -oLOG test/threaded_execve" corner case.
 	 * It's the only case when -ff mode needs reprinting.
 	 */
-	if ((!output_separately && printing_tcp != tcp && !tcp->staged_output_data)
+	if ((!output_separately && printing_tcp != tcp &&
+	     !(tcp->flags & TCB_STAGED_OUTPUT))
 	    || (tcp->flags & TCB_REPRINT)) {
 		tcp->flags &= ~TCB_REPRINT;
 		printleader(tcp);
@@ -825,10 +901,13 @@ syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 	if (raw(tcp)) {
 		/* sys_res = printargs(tcp); - but it's nop on sysexit */
 	} else {
-		if (tcp->sys_func_rval & RVAL_DECODED)
+		if (tcp->sys_func_rval & RVAL_DECODED) {
 			sys_res = tcp->sys_func_rval;
-		else
+		} else {
+			if (!syserror(tcp))
+				prefetch_syscall_args(tcp);
 			sys_res = tcp_sysent(tcp)->sys_func(tcp);
+		}
 	}
 
 	if (!is_complete_set(status_set, NUMBER_OF_STATUSES)) {
@@ -992,7 +1071,7 @@ syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 		print_injected_note(tcp);
 	}
 	if (Tflag) {
-		ts_sub(ts, ts, &tcp->etime);
+		ts_sub(ts, ts, &get_tcb_cold(tcp)->etime);
 		tprintf(" <%ld", (long) ts->tv_sec);
 		if (Tflag_width) {
 			tprintf(".%0*ld",
@@ -1018,13 +1097,14 @@ syscall_exiting_finish(struct tcb *tcp)
 			TCB_INJECT_POKE_EXIT | TCB_TAMPERED_DELAYED | TCB_TAMPERED_POKED);
 	tcp->sys_func_rval = 0;
 	free_tcb_priv_data(tcp);
+	update_sockaddr_cache(tcp);
 
-#ifdef ENABLE_SECONTEXT
-	tcp->last_dirfd = AT_FDCWD;
-#endif
+	selinux_set_last_dirfd(tcp, AT_FDCWD);
 
-	if (cflag)
-		tcp->ltime = tcp->stime;
+	if (cflag) {
+		struct tcb_cold *const cold = get_tcb_cold(tcp);
+		cold->ltime = cold->stime;
+	}
 }
 
 bool
@@ -1373,6 +1453,30 @@ const struct_sysent stub_sysent = {
 	.sys_name = "????",
 };
 
+/* Sets tcp->s_ent and tcp->qual_flg according to tcp->scno.  */
+static void
+set_syscall_entry(struct tcb *tcp)
+{
+	if (scno_is_valid(tcp->scno)) {
+		tcp->s_ent = &sysent[tcp->scno];
+		tcp->qual_flg = qual_flags(tcp->scno);
+	} else {
+		struct sysent_buf *s = xzalloc(sizeof(*s));
+
+		s->tcp = tcp;
+		s->ent = stub_sysent;
+		s->ent.sys_name = s->buf;
+		xsprintf(s->buf, "syscall_%#" PRI_klx, shuffle_scno(tcp->scno));
+
+		tcp->s_ent = &s->ent;
+
+		set_tcb_priv_data(tcp, s, free_sysent_buf);
+
+		debug_msg("pid %d invalid syscall %#" PRI_klx,
+			  tcp->pid, shuffle_scno(tcp->scno));
+	}
+}
+
 /*
  * Returns:
  * 0: "ignore this ptrace stop", syscall_entering_decode() should return a "bail
@@ -1406,24 +1510,7 @@ get_scno(struct tcb *tcp)
 	tcp->true_scno = tcp->scno;
 	tcp->scno = shuffle_scno(tcp->scno);
 
-	if (scno_is_valid(tcp->scno)) {
-		tcp->s_ent = &sysent[tcp->scno];
-		tcp->qual_flg = qual_flags(tcp->scno);
-	} else {
-		struct sysent_buf *s = xzalloc(sizeof(*s));
-
-		s->tcp = tcp;
-		s->ent = stub_sysent;
-		s->ent.sys_name = s->buf;
-		xsprintf(s->buf, "syscall_%#" PRI_klx, shuffle_scno(tcp->scno));
-
-		tcp->s_ent = &s->ent;
-
-		set_tcb_priv_data(tcp, s, free_sysent_buf);
-
-		debug_msg("pid %d invalid syscall %#" PRI_klx,
-			  tcp->pid, shuffle_scno(tcp->scno));
-	}
+	set_syscall_entry(tcp);
 
 	/*
 	 * We refrain from argument decoding during recovering
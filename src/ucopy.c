@@ -14,6 +14,7 @@
 
 #include "defs.h"
 #include <sys/uio.h>
+#include "bintrace.h"
 
 #include "scno.h"
 #include "ptrace.h"
@@ -81,48 +82,382 @@ process_read_mem(const pid_t pid, void *const laddr,
 	return rc;
 }
 
-static int cached_idx = -1;
-static unsigned long cached_raddr[4];
+/*
+ * Cache of tracee memory pages read by vm_read_mem, keyed by (tcb, page).
+ * Pages of a tracee are valid while it stays stopped, so the cache
+ * is invalidated for a tcb when it is restarted or dropped, and entirely
+ * on writes to tracee memory, as other tcbs may share the address space.
+ * The pages of a tcb are linked into a list starting
+ * at tcb->umove_cache_pages.  Entries are evicted in LRU order.
+ */
+#define UMOVE_CACHE_NIL ((unsigned int) -1)
+
+struct umove_cache_entry {
+	unsigned long raddr;	/* page address, 0 if the entry is unused */
+	struct tcb *tcp;
+	unsigned int hash_next;	/* next entry in the same hash bucket */
+	unsigned int tcb_prev;	/* the list of pages of the same tcb */
+	unsigned int tcb_next;
+	unsigned int lru_prev;
+	unsigned int lru_next;
+	char *buf;
+};
+
+unsigned int umove_cache_size = DEFAULT_UMOVE_CACHE_SIZE;
+
+static struct umove_cache_entry *umove_cache;
+static unsigned int *umove_cache_hash;
+static unsigned int umove_cache_hash_mask;
+static unsigned int umove_cache_lru_head = UMOVE_CACHE_NIL;
+static unsigned int umove_cache_lru_tail = UMOVE_CACHE_NIL;
+static unsigned int umove_cache_used;
+
+static struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t reads;
+	uint64_t invalidations;
+	uint64_t prefetched;
+} umove_cache_stats;
+
+static void
+umove_cache_init(void)
+{
+	unsigned int nbuckets = 1;
+
+	while (nbuckets < umove_cache_size * 2)
+		nbuckets <<= 1;
+
+	umove_cache = xcalloc(umove_cache_size, sizeof(*umove_cache));
+	umove_cache_hash = xallocarray(nbuckets, sizeof(*umove_cache_hash));
+	umove_cache_hash_mask = nbuckets - 1;
+	for (unsigned int i = 0; i < nbuckets; ++i)
+		umove_cache_hash[i] = UMOVE_CACHE_NIL;
+
+	for (unsigned int i = 0; i < umove_cache_size; ++i) {
+		umove_cache[i].hash_next = UMOVE_CACHE_NIL;
+		umove_cache[i].tcb_prev = UMOVE_CACHE_NIL;
+		umove_cache[i].tcb_next = UMOVE_CACHE_NIL;
+		umove_cache[i].lru_prev = i ? i - 1 : UMOVE_CACHE_NIL;
+		umove_cache[i].lru_next =
+			i + 1 < umove_cache_size ? i + 1 : UMOVE_CACHE_NIL;
+	}
+	umove_cache_lru_head = 0;
+	umove_cache_lru_tail = umove_cache_size - 1;
+}
+
+static unsigned int
+umove_cache_bucket(const struct tcb *const tcp, const unsigned long raddr)
+{
+	const unsigned long key = (raddr / get_pagesize()) ^
+				  ((unsigned long) tcp->pid << 16);
+
+	return (key * 2654435761U) & umove_cache_hash_mask;
+}
+
+static void
+umove_cache_lru_unlink(const unsigned int idx)
+{
+	struct umove_cache_entry *const e = &umove_cache[idx];
+
+	if (e->lru_prev != UMOVE_CACHE_NIL)
+		umove_cache[e->lru_prev].lru_next = e->lru_next;
+	else
+		umove_cache_lru_head = e->lru_next;
+
+	if (e->lru_next != UMOVE_CACHE_NIL)
+		umove_cache[e->lru_next].lru_prev = e->lru_prev;
+	else
+		umove_cache_lru_tail = e->lru_prev;
+}
+
+static void
+umove_cache_lru_push_head(const unsigned int idx)
+{
+	struct umove_cache_entry *const e = &umove_cache[idx];
+
+	e->lru_prev = UMOVE_CACHE_NIL;
+	e->lru_next = umove_cache_lru_head;
+	if (umove_cache_lru_head != UMOVE_CACHE_NIL)
+		umove_cache[umove_cache_lru_head].lru_prev = idx;
+	else
+		umove_cache_lru_tail = idx;
+	umove_cache_lru_head = idx;
+}
+
+static void
+umove_cache_lru_push_tail(const unsigned int idx)
+{
+	struct umove_cache_entry *const e = &umove_cache[idx];
+
+	e->lru_next = UMOVE_CACHE_NIL;
+	e->lru_prev = umove_cache_lru_tail;
+	if (umove_cache_lru_tail != UMOVE_CACHE_NIL)
+		umove_cache[umove_cache_lru_tail].lru_next = idx;
+	else
+		umove_cache_lru_head = idx;
+	umove_cache_lru_tail = idx;
+}
+
+static void
+umove_cache_tcb_link(const unsigned int idx)
+{
+	struct umove_cache_entry *const e = &umove_cache[idx];
+	const unsigned int head = e->tcp->umove_cache_pages;
+
+	e->tcb_prev = UMOVE_CACHE_NIL;
+	e->tcb_next = head ? head - 1 : UMOVE_CACHE_NIL;
+	if (head)
+		umove_cache[head - 1].tcb_prev = idx;
+	e->tcp->umove_cache_pages = idx + 1;
+}
+
+static void
+umove_cache_tcb_unlink(const unsigned int idx)
+{
+	struct umove_cache_entry *const e = &umove_cache[idx];
+
+	if (e->tcb_prev != UMOVE_CACHE_NIL)
+		umove_cache[e->tcb_prev].tcb_next = e->tcb_next;
+	else
+		e->tcp->umove_cache_pages = e->tcb_next + 1;
+
+	if (e->tcb_next != UMOVE_CACHE_NIL)
+		umove_cache[e->tcb_next].tcb_prev = e->tcb_prev;
+
+	e->tcb_prev = UMOVE_CACHE_NIL;
+	e->tcb_next = UMOVE_CACHE_NIL;
+}
+
+static void
+umove_cache_drop(const unsigned int idx)
+{
+	struct umove_cache_entry *const e = &umove_cache[idx];
+	unsigned int *p = &umove_cache_hash[umove_cache_bucket(e->tcp,
+							       e->raddr)];
+
+	for (; *p != UMOVE_CACHE_NIL; p = &umove_cache[*p].hash_next) {
+		if (*p == idx) {
+			*p = e->hash_next;
+			break;
+		}
+	}
+
+	umove_cache_tcb_unlink(idx);
+
+	e->raddr = 0;
+	e->tcp = NULL;
+	e->hash_next = UMOVE_CACHE_NIL;
+	umove_cache_used--;
+
+	umove_cache_lru_unlink(idx);
+	umove_cache_lru_push_tail(idx);
+}
+
+static unsigned int
+umove_cache_lookup(const struct tcb *const tcp, const unsigned long raddr)
+{
+	unsigned int idx = umove_cache_hash[umove_cache_bucket(tcp, raddr)];
+
+	for (; idx != UMOVE_CACHE_NIL; idx = umove_cache[idx].hash_next) {
+		if (umove_cache[idx].raddr == raddr &&
+		    umove_cache[idx].tcp == tcp) {
+			umove_cache_lru_unlink(idx);
+			umove_cache_lru_push_head(idx);
+			return idx;
+		}
+	}
+
+	return UMOVE_CACHE_NIL;
+}
+
+/* Take the least recently used entry and assign (tcp, raddr) to it.  */
+static unsigned int
+umove_cache_alloc(struct tcb *const tcp, const unsigned long raddr)
+{
+	const unsigned int idx = umove_cache_lru_tail;
+	struct umove_cache_entry *const e = &umove_cache[idx];
+
+	if (e->raddr)
+		umove_cache_drop(idx);
+	if (!e->buf)
+		e->buf = xmalloc(get_pagesize());
+
+	e->raddr = raddr;
+	e->tcp = tcp;
+
+	unsigned int *const head =
+		&umove_cache_hash[umove_cache_bucket(tcp, raddr)];
+	e->hash_next = *head;
+	*head = idx;
+	umove_cache_tcb_link(idx);
+	umove_cache_used++;
+
+	umove_cache_lru_unlink(idx);
+	umove_cache_lru_push_head(idx);
+
+	return idx;
+}
 
 void
-invalidate_umove_cache(void)
+invalidate_umove_cache(struct tcb *tcp)
 {
-	cached_idx = -1;
+	if (!tcp->umove_cache_pages)
+		return;
+
+	umove_cache_stats.invalidations++;
+	while (tcp->umove_cache_pages)
+		umove_cache_drop(tcp->umove_cache_pages - 1);
 }
 
-static int
-get_next_unused_idx(void)
+/* Drop all cached pages, of all tcbs.  */
+static void
+flush_umove_cache(void)
 {
-	return (cached_idx + 1) % ARRAY_SIZE(cached_raddr);
+	if (!umove_cache_used)
+		return;
+
+	umove_cache_stats.invalidations++;
+	for (unsigned int i = 0; i < umove_cache_size; ++i) {
+		if (umove_cache[i].raddr)
+			umove_cache_drop(i);
+	}
 }
 
-static int
-lookup_cached_raddr_idx(const unsigned long raddr)
-{
-	if (cached_idx >= 0) {
-		for (int i = cached_idx; i >= 0; --i)
-			if (raddr == cached_raddr[i])
-				return i;
-		for (int i = (int) ARRAY_SIZE(cached_raddr) - 1;
-		     i > cached_idx; --i)
-			if (raddr == cached_raddr[i])
-				return i;
+void
+print_umove_cache_stats(void)
+{
+	const uint64_t lookups = umove_cache_stats.hits +
+				 umove_cache_stats.misses;
+
+	debug_msg("umove cache: %u pages, %" PRIu64 " hits, %" PRIu64
+		  " misses (%.1f%% hit rate), %" PRIu64 " process_vm_readv"
+		  " calls, %" PRIu64 " invalidations, %" PRIu64
+		  " pages prefetched",
+		  umove_cache_size, umove_cache_stats.hits,
+		  umove_cache_stats.misses,
+		  lookups ? 100.0 * umove_cache_stats.hits / lookups : 0.0,
+		  umove_cache_stats.reads, umove_cache_stats.invalidations,
+		  umove_cache_stats.prefetched);
+}
+
+/*
+ * Fetch the pages listed in idx[] that are not cached yet, coalescing them
+ * into a single process_vm_readv call with one remote iovec per run
+ * of adjacent pages.  Entries of the pages that have not
+ * been read are dropped.  Returns the number of leading pages available.
+ */
+static unsigned int
+umove_cache_fill(const struct tcb *const tcp, const unsigned int *const idx,
+		 const bool *const miss, const unsigned int npages)
+{
+	static struct iovec *local, *remote;
+	static size_t local_size, remote_size;
+	const size_t page_size = get_pagesize();
+	unsigned int nlocal = 0, nremote = 0;
+
+	for (unsigned int i = 0; i < npages; ++i) {
+		if (!miss[i])
+			continue;
+
+		if (nlocal >= local_size)
+			local = xgrowarray(local, &local_size, sizeof(*local));
+		local[nlocal].iov_base = umove_cache[idx[i]].buf;
+		local[nlocal].iov_len = page_size;
+		++nlocal;
+
+		char *const raddr = (char *) umove_cache[idx[i]].raddr;
+		if (nremote && (char *) remote[nremote - 1].iov_base +
+			       remote[nremote - 1].iov_len == raddr) {
+			remote[nremote - 1].iov_len += page_size;
+		} else {
+			if (nremote >= remote_size)
+				remote = xgrowarray(remote, &remote_size,
+						    sizeof(*remote));
+			remote[nremote].iov_base = raddr;
+			remote[nremote].iov_len = page_size;
+			++nremote;
+		}
 	}
-	return -1;
+
+	if (!nlocal)
+		return npages;
+
+	umove_cache_stats.reads++;
+	ssize_t rc = process_vm_readv(tcp->pid, local, nlocal,
+				      remote, nremote, 0);
+	const int saved_errno = rc < 0 ? errno : EFAULT;
+	if (rc < 0 && errno == ENOSYS)
+		process_vm_readv_not_supported = true;
+
+	size_t nread = rc > 0 ? rc / page_size : 0;
+	unsigned int avail = npages;
+
+	for (unsigned int i = 0; i < npages; ++i) {
+		if (!miss[i])
+			continue;
+		if (nread) {
+			--nread;
+			continue;
+		}
+		umove_cache_drop(idx[i]);
+		if (avail == npages)
+			avail = i;
+	}
+
+	errno = saved_errno;
+	return avail;
 }
 
+static unsigned int *umove_cache_idx;
+static bool *umove_cache_miss;
+
+/*
+ * Look up the pages, assigning cache entries to the missing ones,
+ * and store the entry indices into umove_cache_idx[].
+ *
+ * As npages does not exceed the cache size, and every page looked up
+ * or allocated here becomes the most recently used one, allocations
+ * never evict pages of the same request.
+ */
 static void
-set_cached_raddr_idx(const unsigned long raddr, const int idx)
+umove_cache_get_pages(struct tcb *const tcp, const unsigned long *const pages,
+		      const unsigned long first_page, const unsigned int npages)
 {
-	if (cached_idx < 0)
-		memset(cached_raddr, 0, sizeof(cached_raddr));
-	cached_raddr[idx] = raddr;
-	cached_idx = idx;
+	static size_t idx_size;
+
+	if (npages > idx_size) {
+		umove_cache_idx = xreallocarray(umove_cache_idx, npages,
+						sizeof(*umove_cache_idx));
+		umove_cache_miss = xreallocarray(umove_cache_miss, npages,
+						 sizeof(*umove_cache_miss));
+		idx_size = npages;
+	}
+
+	for (unsigned int i = 0; i < npages; ++i) {
+		const unsigned long raddr =
+			pages ? pages[i] : first_page + i * get_pagesize();
+		unsigned int idx = umove_cache_lookup(tcp, raddr);
+
+		umove_cache_miss[i] = idx == UMOVE_CACHE_NIL;
+		if (umove_cache_miss[i]) {
+			umove_cache_stats.misses++;
+			idx = umove_cache_alloc(tcp, raddr);
+		} else {
+			umove_cache_stats.hits++;
+		}
+		umove_cache_idx[i] = idx;
+	}
 }
 
+/*
+ * Read up to len bytes of tracee memory through the page cache.
+ * If stop_at_nul is set, the copying stops right after the first NUL byte,
+ * so the last byte read is NUL if and only if a NUL byte has been seen.
+ */
 static ssize_t
-vm_read_mem(const pid_t pid, void *laddr,
-	    const kernel_ulong_t kraddr, size_t len)
+vm_read_cached(struct tcb *const tcp, void *laddr,
+	       const kernel_ulong_t kraddr, size_t len, const bool stop_at_nul)
 {
 	if (!len)
 		return len;
@@ -138,62 +473,155 @@ vm_read_mem(const pid_t pid, void *laddr,
 
 	const size_t page_size = get_pagesize();
 	const size_t page_mask = page_size - 1;
-	unsigned long page_start = taddr & ~page_mask;
+	const unsigned long page_start = taddr & ~page_mask;
 	const unsigned long page_after_last =
 		(taddr + len + page_mask) & ~page_mask;
 
-	if (!page_start ||
+	if (!umove_cache_size ||
+	    !page_start ||
 	    page_after_last < page_start ||
-	    page_after_last - page_start > ARRAY_SIZE(cached_raddr) * page_size)
-		return process_read_mem(pid, laddr, (void *) taddr, len);
+	    page_after_last - page_start > umove_cache_size * page_size) {
+		ssize_t r = process_read_mem(tcp->pid, laddr,
+					     (void *) taddr, len);
 
-	size_t total_read = 0;
+		if (stop_at_nul && r > 0) {
+			const char *nul_addr = memchr(laddr, '\0', r);
 
-	for (;;) {
-		static char *buf[ARRAY_SIZE(cached_raddr)];
-		int idx = lookup_cached_raddr_idx(page_start);
+			if (nul_addr)
+				r = nul_addr - (const char *) laddr + 1;
+		}
+		return r;
+	}
 
-		if (idx == -1) {
-			idx = get_next_unused_idx();
+	if (!umove_cache)
+		umove_cache_init();
 
-			if (!buf[idx])
-				buf[idx] = xmalloc(page_size);
+	const unsigned int npages = (page_after_last - page_start) / page_size;
 
-			const ssize_t rc =
-				process_read_mem(pid, buf[idx],
-						 (void *) page_start, page_size);
-			if (rc < 0)
-				return total_read ? (ssize_t) total_read : rc;
+	umove_cache_get_pages(tcp, NULL, page_start, npages);
 
-			set_cached_raddr_idx(page_start, idx);
-		}
+	const unsigned int *const idx = umove_cache_idx;
+	const unsigned int avail =
+		umove_cache_fill(tcp, idx, umove_cache_miss, npages);
+	if (!avail)
+		return -1;
 
-		const unsigned long offset = taddr - page_start;
-		size_t copy_len, next_len;
+	size_t total_read = 0;
+	unsigned long offset = taddr - page_start;
+
+	for (unsigned int i = 0; i < avail && len; ++i) {
+		const size_t copy_len = MIN(len, page_size - offset);
+		const void *const src = umove_cache[idx[i]].buf + offset;
 
-		if (len <= page_size - offset) {
-			copy_len = len;
-			next_len = 0;
+		if (stop_at_nul) {
+			const char *end = memccpy(laddr, src, '\0', copy_len);
+
+			if (end)
+				return total_read + (end - (const char *) laddr);
 		} else {
-			copy_len = page_size - offset;
-			next_len = len - copy_len;
+			memcpy(laddr, src, copy_len);
 		}
-
-		memcpy(laddr, buf[idx] + offset, copy_len);
 		total_read += copy_len;
-
-		if (!next_len)
-			break;
-
-		len = next_len;
 		laddr += copy_len;
-		page_start += page_size;
-		taddr = page_start;
+		len -= copy_len;
+		offset = 0;
 	}
 
 	return total_read;
 }
 
+static ssize_t
+vm_read_mem(struct tcb *const tcp, void *const laddr,
+	    const kernel_ulong_t kraddr, const size_t len)
+{
+	return vm_read_cached(tcp, laddr, kraddr, len, false);
+}
+
+static ssize_t
+vm_read_str(struct tcb *const tcp, char *const laddr,
+	    const kernel_ulong_t kraddr, const size_t len)
+{
+	return vm_read_cached(tcp, laddr, kraddr, len, true);
+}
+
+/*
+ * Bytes after an address within its page below which the page that follows
+ * is prefetched as well, as the data is likely to cross the page boundary.
+ */
+#define PREFETCH_TAIL_SIZE 256
+
+static bool tracee_addr_is_invalid(kernel_ulong_t addr);
+
+/*
+ * Load the pages referenced by the given tracee addresses into the cache
+ * using a single process_vm_readv call, so that subsequent umove* calls
+ * made by the decoder are served from the cache.
+ */
+void
+umove_prefetch(struct tcb *const tcp, const kernel_ulong_t *const addrs,
+	       const unsigned int count)
+{
+	if (!umove_cache_size || process_vm_readv_not_supported ||
+	    bintrace_replaying)
+		return;
+
+	const size_t page_size = get_pagesize();
+	const size_t page_mask = page_size - 1;
+	unsigned long pages[MAX_ARGS * 2];
+	unsigned int npages = 0;
+
+	for (unsigned int i = 0; i < count && i < MAX_ARGS; ++i) {
+		const unsigned long addr = addrs[i];
+
+		if (tracee_addr_is_invalid(addrs[i]) ||
+		    addrs[i] != (kernel_ulong_t) addr || addr < page_size)
+			continue;
+
+		pages[npages++] = addr & ~page_mask;
+		if ((addr & page_mask) > page_size - PREFETCH_TAIL_SIZE &&
+		    (addr | page_mask) + 1 != 0)
+			pages[npages++] = (addr | page_mask) + 1;
+	}
+
+	/* Sort and deduplicate, there are at most a dozen of pages.  */
+	for (unsigned int i = 1; i < npages; ++i) {
+		const unsigned long page = pages[i];
+		unsigned int j = i;
+
+		for (; j && pages[j - 1] > page; --j)
+			pages[j] = pages[j - 1];
+		pages[j] = page;
+	}
+	unsigned int nuniq = 0;
+	for (unsigned int i = 0; i < npages; ++i) {
+		if (!nuniq || pages[nuniq - 1] != pages[i])
+			pages[nuniq++] = pages[i];
+	}
+	npages = MIN(nuniq, umove_cache_size);
+
+	if (!npages)
+		return;
+
+	if (!umove_cache)
+		umove_cache_init();
+
+	umove_cache_get_pages(tcp, pages, 0, npages);
+
+	unsigned int nmiss = 0;
+	for (unsigned int i = 0; i < npages; ++i)
+		nmiss += umove_cache_miss[i];
+	umove_cache_stats.prefetched += nmiss;
+
+	/*
+	 * Prefetch lookups are not the decoder's lookups,
+	 * do not let them distort the hit rate.
+	 */
+	umove_cache_stats.misses -= nmiss;
+	umove_cache_stats.hits -= npages - nmiss;
+
+	umove_cache_fill(tcp, umove_cache_idx, umove_cache_miss, npages);
+}
+
 static ssize_t
 vm_write_mem(const pid_t pid, void *const laddr,
 	     const kernel_ulong_t raddr, const size_t len)
@@ -290,13 +718,9 @@ umoven_peekdata(const int pid, kernel_ulong_t addr, unsigned int len,
 	return 0;
 }
 
-/*
- * Copy `len' bytes of data from process `pid'
- * at address `addr' to our space at `our_addr'.
- */
-int
-umoven(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
-       void *const our_addr)
+static int
+umoven_tracee(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
+	      void *const our_addr)
 {
 	if (tracee_addr_is_invalid(addr))
 		return -1;
@@ -306,7 +730,7 @@ umoven(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 	if (process_vm_readv_not_supported)
 		return umoven_peekdata(pid, addr, len, our_addr);
 
-	int r = vm_read_mem(pid, our_addr, addr, len);
+	int r = vm_read_mem(tcp, our_addr, addr, len);
 	if ((unsigned int) r == len)
 		return 0;
 	if (r >= 0) {
@@ -332,6 +756,38 @@ umoven(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 	}
 }
 
+/*
+ * Copy `len' bytes of data from process `pid'
+ * at address `addr' to our space at `our_addr'.
+ */
+int
+umoven(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
+       void *const our_addr)
+{
+	if (bintrace_replaying)
+		return bintrace_replay_umoven(tcp, addr, len, our_addr);
+
+	const int rc = umoven_tracee(tcp, addr, len, our_addr);
+
+	if (bintrace_recording)
+		bintrace_record_mem(tcp, BINTRACE_MEM, addr, len, our_addr, rc);
+
+	return rc;
+}
+
+/*
+ * Check whether any byte of the word is zero without looking at its bytes
+ * one by one; the result is exact, so most words of a string are skipped
+ * at the cost of a few arithmetic operations.
+ */
+static inline bool
+word_has_zero_byte(const unsigned long w)
+{
+	const unsigned long ones = -1UL / 0xff;
+
+	return (w - ones) & ~w & (ones << 7);
+}
+
 /*
  * Like umoven_peekdata but make the additional effort of looking
  * for a terminating zero byte.
@@ -342,7 +798,6 @@ umovestr_peekdata(const int pid, kernel_ulong_t addr, unsigned int len,
 {
 	unsigned int nread = 0;
 	unsigned int residue = addr & (sizeof(long) - 1);
-	void *const orig_addr = laddr;
 
 	while (len) {
 		addr &= -sizeof(long);		/* aligned address */
@@ -376,9 +831,12 @@ umovestr_peekdata(const int pid, kernel_ulong_t addr, unsigned int len,
 
 		unsigned int m = MIN(sizeof(long) - residue, len);
 		memcpy(laddr, &u.data[residue], m);
-		while (residue < sizeof(long))
-			if (u.data[residue++] == '\0')
-				return (laddr - orig_addr) + residue;
+		if (word_has_zero_byte(u.val)) {
+			const char *nul_addr = memchr(laddr, '\0', m);
+
+			if (nul_addr)
+				return nread + (nul_addr - (char *) laddr) + 1;
+		}
 		residue = 0;
 		addr += sizeof(long);
 		laddr += m;
@@ -389,20 +847,9 @@ umovestr_peekdata(const int pid, kernel_ulong_t addr, unsigned int len,
 	return 0;
 }
 
-/*
- * Like `umove' but make the additional effort of looking
- * for a terminating zero byte.
- *
- * Returns < 0 on error, strlen + 1  if NUL was seen,
- * else 0 if len bytes were read but no NUL byte seen.
- *
- * Note: there is no guarantee we won't overwrite some bytes
- * in laddr[] _after_ terminating NUL (but, of course,
- * we never write past laddr[len-1]).
- */
-int
-umovestr(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
-	 char *laddr)
+static int
+umovestr_tracee(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
+		char *laddr)
 {
 	if (tracee_addr_is_invalid(addr))
 		return -1;
@@ -427,12 +874,10 @@ umovestr(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 		if (chunk_len > end_in_page) /* crosses to the next page */
 			chunk_len -= end_in_page;
 
-		int r = vm_read_mem(pid, laddr, addr, chunk_len);
+		int r = vm_read_str(tcp, laddr, addr, chunk_len);
 		if (r > 0) {
-			char *nul_addr = memchr(laddr, '\0', r);
-
-			if (nul_addr)
-				return (nul_addr - laddr) + 1;
+			if (laddr[r - 1] == '\0')
+				return nread + r;
 			addr += r;
 			laddr += r;
 			nread += r;
@@ -468,6 +913,32 @@ umovestr(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 	return 0;
 }
 
+/*
+ * Like `umove' but make the additional effort of looking
+ * for a terminating zero byte.
+ *
+ * Returns < 0 on error, strlen + 1  if NUL was seen,
+ * else 0 if len bytes were read but no NUL byte seen.
+ *
+ * Note: there is no guarantee we won't overwrite some bytes
+ * in laddr[] _after_ terminating NUL (but, of course,
+ * we never write past laddr[len-1]).
+ */
+int
+umovestr(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
+	 char *laddr)
+{
+	if (bintrace_replaying)
+		return bintrace_replay_umovestr(tcp, addr, len, laddr);
+
+	const int rc = umovestr_tracee(tcp, addr, len, laddr);
+
+	if (bintrace_recording)
+		bintrace_record_mem(tcp, BINTRACE_STR, addr, len, laddr, rc);
+
+	return rc;
+}
+
 static bool
 upoken_peekpoke(const int pid, const kernel_ulong_t addr,
 		const unsigned int len, void *const our_addr,
@@ -563,6 +1034,9 @@ upoken(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 
 	const int pid = tcp->pid;
 
+	/* Threads and CLONE_VM children share the memory being written.  */
+	flush_umove_cache();
+
 	if (process_vm_writev_not_supported)
 		return upoken_pokedata(pid, addr, len, our_addr);
 
@@ -50,7 +50,7 @@ static unsigned long long mapping_generation = 1;
 static unsigned long long uwcache_clock;
 
 static void
-update_mapping_generation(struct tcb *tcp, void *unused)
+update_mapping_generation(struct tcb *tcp, bool have_result, void *unused)
 {
 	mapping_generation++;
 }
@@ -100,7 +100,7 @@ tcb_init(struct tcb *tcp)
 static void
 tcb_fin(struct tcb *tcp)
 {
-	struct ctx *ctx = tcp->unwind_ctx;
+	struct ctx *ctx = tcp->cold->unwind_ctx;
 	if (ctx) {
 		dwfl_end(ctx->dwfl);
 		free(ctx);
@@ -110,7 +110,7 @@ tcb_fin(struct tcb *tcp)
 static void
 flush_cache_maybe(struct tcb *tcp)
 {
-	struct ctx *ctx = tcp->unwind_ctx;
+	struct ctx *ctx = tcp->cold->unwind_ctx;
 	if (!ctx)
 		return;
 
@@ -177,6 +177,10 @@ frame_callback(Dwfl_Frame *state, void *arg)
 		return -1;
 	}
 
+	/* Max number of frames to print exceeded? */
+	if (user_data->stack_depth-- == 0)
+		return DWARF_CB_ABORT;
+
 	if (!isactivation)
 		pc--;
 
@@ -214,20 +218,72 @@ frame_callback(Dwfl_Frame *state, void *arg)
 		}
 	}
 
-	/* Max number of frames to print reached? */
+	return DWARF_CB_OK;
+}
+
+struct pc_user_data {
+	unwind_pc_action_fn pc_action;
+	void *data;
+	int stack_depth;
+};
+
+static int
+pc_frame_callback(Dwfl_Frame *state, void *arg)
+{
+	struct pc_user_data *user_data = arg;
+	Dwarf_Addr pc;
+	bool isactivation;
+
+	if (!dwfl_frame_pc(state, &pc, &isactivation)) {
+		/* Propagate the error to the caller.  */
+		return -1;
+	}
+
+	/* Max number of frames to report exceeded? */
 	if (user_data->stack_depth-- == 0)
 		return DWARF_CB_ABORT;
 
+	if (!isactivation)
+		pc--;
+
+	user_data->pc_action(user_data->data, pc);
+
 	return DWARF_CB_OK;
 }
 
+static void
+tcb_walk_pcs(struct tcb *tcp,
+	     unwind_pc_action_fn pc_action,
+	     unwind_error_action_fn error_action,
+	     void *data)
+{
+	struct ctx *ctx = tcp->cold->unwind_ctx;
+	if (!ctx)
+		return;
+
+	struct pc_user_data user_data = {
+		.pc_action = pc_action,
+		.data = data,
+		.stack_depth = UNWIND_MAX_PCS_FRAMES,
+	};
+
+	flush_cache_maybe(tcp);
+
+	int r = dwfl_getthread_frames(ctx->dwfl, tcp->pid, pc_frame_callback,
+				      &user_data);
+	if (r)
+		error_action(data,
+			     r < 0 ? dwfl_errmsg(-1) : "too many stack frames",
+			     0);
+}
+
 static void
 tcb_walk(struct tcb *tcp,
 	 unwind_call_action_fn call_action,
 	 unwind_error_action_fn error_action,
 	 void *data)
 {
-	struct ctx *ctx = tcp->unwind_ctx;
+	struct ctx *ctx = tcp->cold->unwind_ctx;
 	if (!ctx)
 		return;
 
@@ -255,4 +311,5 @@ const struct unwind_unwinder_t unwinder = {
 	.tcb_init = tcb_init,
 	.tcb_fin = tcb_fin,
 	.tcb_walk = tcb_walk,
+	.tcb_walk_pcs = tcb_walk_pcs,
 };
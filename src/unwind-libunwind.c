@@ -38,7 +38,7 @@ tcb_init(struct tcb *tcp)
 static void
 tcb_fin(struct tcb *tcp)
 {
-	_UPT_destroy(tcp->unwind_ctx);
+	_UPT_destroy(tcp->cold->unwind_ctx);
 }
 
 static void
@@ -121,7 +121,7 @@ walk(struct tcb *tcp,
 
 	symbol_name = xmalloc(symbol_name_size);
 
-	if (unw_init_remote(&cursor, libunwind_as, tcp->unwind_ctx) < 0)
+	if (unw_init_remote(&cursor, libunwind_as, tcp->cold->unwind_ctx) < 0)
 		perror_func_msg_and_die("cannot initialize libunwind");
 
 	for (stack_depth = 0; stack_depth < 256; ++stack_depth) {
@@ -137,11 +137,8 @@ walk(struct tcb *tcp,
 	free(symbol_name);
 }
 
-static void
-tcb_walk(struct tcb *tcp,
-	 unwind_call_action_fn call_action,
-	 unwind_error_action_fn error_action,
-	 void *data)
+static bool
+prepare_walk(struct tcb *tcp)
 {
 	switch (mmap_cache_rebuild_if_invalid(tcp, __func__)) {
 		case MMAP_CACHE_REBUILD_RENEWED:
@@ -153,18 +150,59 @@ tcb_walk(struct tcb *tcp,
 			unw_flush_cache(libunwind_as, 0, 0);
 			ATTRIBUTE_FALLTHROUGH;
 		case MMAP_CACHE_REBUILD_READY:
-			walk(tcp, call_action, error_action, data);
-			break;
+			return true;
 		default:
-			/* Do nothing */
-			;
+			return false;
 	}
 }
 
+static void
+tcb_walk(struct tcb *tcp,
+	 unwind_call_action_fn call_action,
+	 unwind_error_action_fn error_action,
+	 void *data)
+{
+	if (prepare_walk(tcp))
+		walk(tcp, call_action, error_action, data);
+}
+
+static void
+tcb_walk_pcs(struct tcb *tcp,
+	     unwind_pc_action_fn pc_action,
+	     unwind_error_action_fn error_action,
+	     void *data)
+{
+	unw_cursor_t cursor;
+	int stack_depth;
+
+	if (!prepare_walk(tcp))
+		return;
+
+	if (unw_init_remote(&cursor, libunwind_as, tcp->cold->unwind_ctx) < 0)
+		perror_func_msg_and_die("cannot initialize libunwind");
+
+	for (stack_depth = 0; stack_depth < UNWIND_MAX_PCS_FRAMES;
+	     ++stack_depth) {
+		unw_word_t ip;
+
+		if (unw_get_reg(&cursor, UNW_REG_IP, &ip) < 0) {
+			perror_msg("cannot walk the stack of process %d",
+				   tcp->pid);
+			break;
+		}
+		pc_action(data, ip);
+		if (unw_step(&cursor) <= 0)
+			break;
+	}
+	if (stack_depth >= UNWIND_MAX_PCS_FRAMES)
+		error_action(data, "too many stack frames", 0);
+}
+
 const struct unwind_unwinder_t unwinder = {
 	.name = "libunwind",
 	.init = init,
 	.tcb_init = tcb_init,
 	.tcb_fin = tcb_fin,
 	.tcb_walk = tcb_walk,
+	.tcb_walk_pcs = tcb_walk_pcs,
 };
@@ -6,6 +6,8 @@
  */
 
 #include "defs.h"
+#include "mmap_cache.h"
+#include "stack_ids.h"
 #include "unwind.h"
 
 #ifdef USE_DEMANGLE
@@ -41,33 +43,40 @@ unwind_init(void)
 {
 	if (unwinder.init)
 		unwinder.init();
+	/* The frames are resolved to mapped files with the mmap cache.  */
+	if (stack_trace_ids)
+		mmap_cache_enable();
 }
 
 void
 unwind_tcb_init(struct tcb *tcp)
 {
-	if (tcp->unwind_queue)
+	struct tcb_cold *const cold = get_tcb_cold(tcp);
+
+	if (cold->unwind_queue)
 		return;
 
-	tcp->unwind_queue = xmalloc(sizeof(*tcp->unwind_queue));
-	tcp->unwind_queue->head = NULL;
-	tcp->unwind_queue->tail = NULL;
+	cold->unwind_queue = xmalloc(sizeof(*cold->unwind_queue));
+	cold->unwind_queue->head = NULL;
+	cold->unwind_queue->tail = NULL;
 
-	tcp->unwind_ctx = unwinder.tcb_init(tcp);
+	cold->unwind_ctx = unwinder.tcb_init(tcp);
 }
 
 void
 unwind_tcb_fin(struct tcb *tcp)
 {
-	if (!tcp->unwind_queue)
+	struct tcb_cold *const cold = tcp->cold;
+
+	if (!cold || !cold->unwind_queue)
 		return;
 
-	queue_print(tcp->unwind_queue);
-	free(tcp->unwind_queue);
-	tcp->unwind_queue = NULL;
+	queue_print(cold->unwind_queue);
+	free(cold->unwind_queue);
+	cold->unwind_queue = NULL;
 
 	unwinder.tcb_fin(tcp);
-	tcp->unwind_ctx = NULL;
+	cold->unwind_ctx = NULL;
 }
 
 /*
@@ -188,21 +197,12 @@ sprint_call_or_error(const char *binary_filename,
  * queue manipulators
  */
 static void
-queue_put(struct unwind_queue_t *queue,
-	  const char *binary_filename,
-	  const char *symbol_name,
-	  unwind_function_offset_t function_offset,
-	  unsigned long true_offset,
-	  const char *error)
+queue_put_line(struct unwind_queue_t *queue, char *output_line)
 {
 	struct call_t *call;
 
 	call = xmalloc(sizeof(*call));
-	call->output_line = sprint_call_or_error(binary_filename,
-						 symbol_name,
-						 function_offset,
-						 true_offset,
-						 error);
+	call->output_line = output_line;
 	call->next = NULL;
 
 	if (!queue->head) {
@@ -214,6 +214,21 @@ queue_put(struct unwind_queue_t *queue,
 	}
 }
 
+static void
+queue_put(struct unwind_queue_t *queue,
+	  const char *binary_filename,
+	  const char *symbol_name,
+	  unwind_function_offset_t function_offset,
+	  unsigned long true_offset,
+	  const char *error)
+{
+	queue_put_line(queue, sprint_call_or_error(binary_filename,
+						   symbol_name,
+						   function_offset,
+						   true_offset,
+						   error));
+}
+
 static void
 queue_put_call(void *queue,
 	       const char *binary_filename,
@@ -261,6 +276,66 @@ queue_print(struct unwind_queue_t *queue)
 	}
 }
 
+/*
+ * stack ids
+ */
+struct pc_queue {
+	unsigned long pcs[UNWIND_MAX_PCS_FRAMES];
+	unsigned int n;
+};
+
+static void
+pc_queue_put(void *data, unsigned long pc)
+{
+	struct pc_queue *queue = data;
+
+	if (queue->n < ARRAY_SIZE(queue->pcs))
+		queue->pcs[queue->n++] = pc;
+}
+
+static void
+pc_queue_put_error(void *data, const char *error, unsigned long pc)
+{
+	if (pc)
+		pc_queue_put(data, pc);
+}
+
+/* Returns the id of the current stack of the tracee, 0 if it is empty.  */
+static unsigned int
+get_stack_id(struct tcb *tcp)
+{
+	struct pc_queue queue;
+
+	queue.n = 0;
+	unwinder.tcb_walk_pcs(tcp, pc_queue_put, pc_queue_put_error, &queue);
+	if (!queue.n)
+		return 0;
+
+	struct stack_ids_frame frames[UNWIND_MAX_PCS_FRAMES];
+	const bool have_maps = mmap_cache_rebuild_if_invalid(tcp, __func__)
+			       != MMAP_CACHE_REBUILD_NOCACHE;
+
+	for (unsigned int i = 0; i < queue.n; ++i) {
+		const unsigned long pc = queue.pcs[i];
+		const struct mmap_cache_entry_t *entry =
+			have_maps ? mmap_cache_search(tcp, pc) : NULL;
+
+		if (entry) {
+			frames[i].module =
+				stack_ids_module(entry->binary_filename);
+			frames[i].offset =
+				pc - entry->start_addr + entry->mmap_offset;
+		} else {
+			frames[i].module = 0;
+			frames[i].offset = pc;
+		}
+	}
+
+	return stack_ids_stack(frames, queue.n);
+}
+
+#define STACK_ID_FMT " > stack #%u\n"
+
 /*
  * printing stack
  */
@@ -273,10 +348,17 @@ unwind_tcb_print(struct tcb *tcp)
 		return;
 	}
 #endif
-	if (tcp->unwind_queue->head) {
+	if (tcp->cold->unwind_queue->head) {
 		debug_func_msg("head: tcp=%p, queue=%p",
-			       tcp, tcp->unwind_queue->head);
-		queue_print(tcp->unwind_queue);
+			       tcp, tcp->cold->unwind_queue->head);
+		queue_print(tcp->cold->unwind_queue);
+	} else if (stack_trace_ids) {
+		unsigned int id = get_stack_id(tcp);
+
+		if (id) {
+			tprintf(STACK_ID_FMT, id);
+			line_ended();
+		}
 	} else
 		unwinder.tcb_walk(tcp, print_call_cb, print_error_cb, NULL);
 }
@@ -293,12 +375,18 @@ unwind_tcb_capture(struct tcb *tcp)
 		return;
 	}
 #endif
-	if (tcp->unwind_queue->head)
+	if (tcp->cold->unwind_queue->head)
 		error_msg_and_die("bug: unprinted entries in queue");
-	else {
+	else if (stack_trace_ids) {
+		unsigned int id = get_stack_id(tcp);
+
+		if (id)
+			queue_put_line(tcp->cold->unwind_queue,
+				       xasprintf(STACK_ID_FMT, id));
+	} else {
 		debug_func_msg("walk: tcp=%p, queue=%p",
-			       tcp, tcp->unwind_queue->head);
+			       tcp, tcp->cold->unwind_queue->head);
 		unwinder.tcb_walk(tcp, queue_put_call, queue_put_error,
-				  tcp->unwind_queue);
+				  tcp->cold->unwind_queue);
 	}
 }
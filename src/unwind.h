@@ -27,6 +27,9 @@ typedef void (*unwind_call_action_fn)(void *data,
 typedef void (*unwind_error_action_fn)(void *data,
 				       const char *error,
 				       unsigned long true_offset);
+typedef void (*unwind_pc_action_fn)(void *data, unsigned long pc);
+
+#define UNWIND_MAX_PCS_FRAMES 256
 
 struct unwind_unwinder_t {
 	const char *name;
@@ -43,6 +46,15 @@ struct unwind_unwinder_t {
 			   unwind_call_action_fn,
 			   unwind_error_action_fn,
 			   void *);
+
+	/*
+	 * Walk the stack without symbolizing the frames,
+	 * reporting at most UNWIND_MAX_PCS_FRAMES of them.
+	 */
+	void   (*tcb_walk_pcs)(struct tcb *,
+			       unwind_pc_action_fn,
+			       unwind_error_action_fn,
+			       void *);
 };
 
 extern const struct unwind_unwinder_t unwinder;
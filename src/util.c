@@ -13,6 +13,7 @@
  */
 
 #include "defs.h"
+#include "bintrace.h"
 #include <limits.h>
 #include <fcntl.h>
 #include <stdarg.h>
@@ -754,7 +755,9 @@ printfd_pid(struct tcb *tcp, pid_t pid, int fd)
 	char path[PATH_MAX + 1];
 	bool deleted;
 	if (pid > 0 && !number_set_array_is_empty(decode_fd_set, 0)
-	    && getfdpath_pid(pid, fd, path, sizeof(path), &deleted) >= 0) {
+	    && (pid == tcp->pid
+		? getfdpath_cached(tcp, fd, path, sizeof(path), &deleted)
+		: getfdpath_pid(pid, fd, path, sizeof(path), &deleted)) >= 0) {
 		if (is_number_in_set(DECODE_FD_SOCKET, decode_fd_set) &&
 		    printsocket(tcp, fd, path))
 			goto printed;
@@ -838,6 +841,42 @@ proc_status_get_id_list(int proc_pid, int *id_buf, size_t id_buf_size,
 	return n;
 }
 
+/*
+ * Return the length of the longest prefix of `str' of at most `size' bytes
+ * that consists of printable characters other than '"' and '\\',
+ * i.e. of characters that are copied by string_quote as is.
+ * The bytes are checked a word at a time.
+ */
+static unsigned int
+unquoted_prefix_len(const unsigned char *const str, const unsigned int size)
+{
+	const unsigned long ones = -1UL / 0xff;
+	const unsigned long highs = ones << 7;
+	unsigned int i = 0;
+
+	for (; size - i >= sizeof(long); i += sizeof(long)) {
+		unsigned long w;
+		memcpy(&w, str + i, sizeof(w));
+
+		const unsigned long dq = w ^ (ones * '"');
+		const unsigned long bs = w ^ (ones * '\\');
+
+		if ((((w - ones * ' ') & ~w)	/* a byte below ' ' */
+		     | w | (w + ones)		/* a byte above '~' */
+		     | ((dq - ones) & ~dq)	/* a '"' byte */
+		     | ((bs - ones) & ~bs))	/* a '\\' byte */
+		    & highs)
+			break;
+	}
+
+	for (; i < size; ++i) {
+		if (!is_print(str[i]) || str[i] == '"' || str[i] == '\\')
+			break;
+	}
+
+	return i;
+}
+
 /*
  * Quote string `instr' of length `size'
  * Write up to (3 + `size' * 4) bytes to `outstr' buffer.
@@ -922,6 +961,20 @@ string_quote(const char *instr, char *outstr, const unsigned int size,
 	}
 
 	for (i = 0; i < size; ++i) {
+		/* Copy characters that need no escaping in bulk. */
+		if (!escape_chars) {
+			const unsigned int n =
+				unquoted_prefix_len(ustr + i, size - i);
+
+			if (n) {
+				memcpy(s, ustr + i, n);
+				s += n;
+				i += n;
+				if (i == size)
+					break;
+			}
+		}
+
 		c = ustr[i];
 		/* Check for NUL-terminated string. */
 		if (c == eol)
@@ -1007,6 +1060,20 @@ string_quote(const char *instr, char *outstr, const unsigned int size,
 	return 0;
 }
 
+/*
+ * The text output is discarded while recording a binary trace, so strings
+ * are not quoted then; this returns what string_quote would return.
+ */
+static int
+string_quote_rc(const char *instr, const unsigned int size,
+		const unsigned int style)
+{
+	if (style & QUOTE_0_TERMINATED)
+		return !memchr(instr, '\0', size + 1);
+
+	return !(size && (style & QUOTE_OMIT_TRAILING_0) && !instr[size - 1]);
+}
+
 #ifndef ALLOCA_CUTOFF
 # define ALLOCA_CUTOFF	4032
 #endif
@@ -1037,6 +1104,9 @@ print_quoted_string_ex(const char *str, unsigned int size,
 	if (size && style & QUOTE_0_TERMINATED)
 		--size;
 
+	if (bintrace_recording)
+		return string_quote_rc(str, size, style);
+
 	alloc_size = 4 * size;
 	if (alloc_size / 4 != size) {
 		error_func_msg("requested %u bytes exceeds %u bytes limit",
@@ -1195,6 +1265,9 @@ printstr_ex(struct tcb *const tcp, const kernel_ulong_t addr,
 		return rc;
 	}
 
+	if (bintrace_recording)
+		return rc;
+
 	if (size > max_strlen)
 		size = max_strlen;
 	else
@@ -7,6 +7,7 @@
 
 #include "xgetdents.h"
 #include "kernel_dirent.h"
+#include "secontext.h"
 
 static void
 decode_dents(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
@@ -123,9 +124,7 @@ xgetdents(struct tcb *const tcp, const unsigned int header_size,
 	if (entering(tcp)) {
 		/* fd */
 		printfd(tcp, tcp->u_arg[0]);
-#ifdef ENABLE_SECONTEXT
-		tcp->last_dirfd = (int) tcp->u_arg[0];
-#endif
+		selinux_set_last_dirfd(tcp, (int) tcp->u_arg[0]);
 		tprint_arg_next();
 		return 0;
 	}
@@ -58,6 +58,60 @@ xlat_bsearch_compare(const void *a, const void *b)
 	return (val1 > val2) ? 1 : (val1 < val2) ? -1 : 0;
 }
 
+static const struct xlat_data *xlat_index_sort_data;
+
+static int
+xlat_index_compare(const void *a, const void *b)
+{
+	const uint32_t idx1 = *(const uint32_t *) a;
+	const uint32_t idx2 = *(const uint32_t *) b;
+	const uint64_t val1 = xlat_index_sort_data[idx1].val;
+	const uint64_t val2 = xlat_index_sort_data[idx2].val;
+
+	if (val1 != val2)
+		return (val1 > val2) ? 1 : -1;
+	return (idx1 > idx2) ? 1 : (idx1 < idx2) ? -1 : 0;
+}
+
+/*
+ * Builds the sorted copy of the data of an XT_NORMAL xlat.  When several
+ * entries have the same value, the first one is kept, so that the lookup
+ * returns the same string as the linear search.
+ */
+static const struct xlat_index *
+get_xlat_index(const struct xlat *const x)
+{
+	struct xlat_index *const xi = x->index;
+
+	if (xi->data || !x->size)
+		return xi;
+
+	uint32_t *order = xcalloc(x->size, sizeof(*order));
+	for (uint32_t i = 0; i < x->size; ++i)
+		order[i] = i;
+
+	xlat_index_sort_data = x->data;
+	qsort(order, x->size, sizeof(*order), xlat_index_compare);
+	xlat_index_sort_data = NULL;
+
+	struct xlat_data *data = xcalloc(x->size, sizeof(*data));
+	uint32_t size = 0;
+
+	for (uint32_t i = 0; i < x->size; ++i) {
+		const struct xlat_data *const e = &x->data[order[i]];
+
+		if (size && data[size - 1].val == e->val)
+			continue;
+		data[size++] = *e;
+	}
+
+	free(order);
+	xi->data = data;
+	xi->size = size;
+
+	return xi;
+}
+
 const char *
 xlookup(const struct xlat *x, const uint64_t val)
 {
@@ -68,6 +122,18 @@ xlookup(const struct xlat *x, const uint64_t val)
 
 	switch (x->type) {
 	case XT_NORMAL:
+		if (x->index) {
+			const struct xlat_index *const xi = get_xlat_index(x);
+
+			e = bsearch((const void *) &val,
+				    xi->data, xi->size,
+				    sizeof(xi->data[0]),
+				    xlat_bsearch_compare);
+			if (e)
+				return e->str;
+			break;
+		}
+
 		for (size_t idx = 0; idx < x->size; idx++)
 			if (x->data[idx].val == val)
 				return x->data[idx].str;
@@ -274,38 +340,196 @@ sprintxval_ex(char *const buf, const size_t size, const struct xlat *const x,
 	return xsnprintf(buf, size, "%s", sprint_xlat_val(val, style));
 }
 
+/* The maximal number of entries matching a flags value.  */
+#define MAX_FLAGS_MATCHES 64
+/* The number of entries in the cache of flags decompositions.  */
+#define FLAGS_CACHE_SIZE 32
+
+/* The entries of an xlat matching a flags value, see match_flags.  */
+struct flags_match {
+	uint64_t rest;		/* The bits not matched by any entry */
+	unsigned int count;
+	uint32_t idx[MAX_FLAGS_MATCHES];
+};
+
+struct xlat_flags_map {
+	/* 1 + the index of the first entry of value 1 << bit, or 0.  */
+	uint32_t bit_entry[64];
+	/* The indices of the entries of more than one bit, in table order.  */
+	uint32_t *multibit;
+	uint32_t multibit_count;
+};
+
+static struct flags_cache_entry {
+	const struct xlat *xlat;
+	uint64_t flags;
+	struct flags_match match;
+} flags_cache[FLAGS_CACHE_SIZE];
+
+/* The recent results of sprintflags_ex without the prefix.  */
+static struct sprintflags_cache_entry {
+	const struct xlat *xlat;
+	uint64_t flags;
+	enum xlat_style style;
+	char sep;
+	bool is_null;
+	char str[96];
+} sprintflags_cache[FLAGS_CACHE_SIZE];
+
+static unsigned int
+flags_cache_hash(const struct xlat *const x, const uint64_t flags)
+{
+	const uint32_t hash = ((uint32_t) ((uintptr_t) x >> 4) ^
+			       (uint32_t) flags ^ (uint32_t) (flags >> 32)) *
+			      0x9e3779b1U;
+
+	return hash % FLAGS_CACHE_SIZE;
+}
+
+static bool
+flags_entry_matches(const struct xlat_data *const e, const uint64_t flags)
+{
+	return e->val && e->str && (flags & e->val) == e->val;
+}
+
+static const struct xlat_flags_map *
+get_xlat_flags_map(const struct xlat *const x)
+{
+	struct xlat_index *const xi = x->index;
+
+	if (xi->flags_map)
+		return xi->flags_map;
+
+	struct xlat_flags_map *const map = xcalloc(1, sizeof(*map));
+
+	for (uint32_t i = 0; i < x->size; ++i) {
+		const uint64_t v = x->data[i].val;
+
+		if (v && x->data[i].str && (v & (v - 1)))
+			++map->multibit_count;
+	}
+	map->multibit = xcalloc(map->multibit_count, sizeof(*map->multibit));
+
+	for (uint32_t i = 0, k = 0; i < x->size; ++i) {
+		const uint64_t v = x->data[i].val;
+
+		if (!v || !x->data[i].str)
+			continue;
+
+		if (v & (v - 1)) {
+			map->multibit[k++] = i;
+			continue;
+		}
+
+		unsigned int bit = 0;
+		while (v >> bit != 1)
+			++bit;
+		if (!map->bit_entry[bit])
+			map->bit_entry[bit] = i + 1;
+	}
+
+	xi->flags_map = map;
+
+	return map;
+}
+
+static void
+match_flags_linear(const struct xlat *const x, uint64_t flags,
+		   struct flags_match *const m)
+{
+	m->count = 0;
+
+	for (uint32_t idx = 0; flags && idx < x->size; ++idx) {
+		if (flags_entry_matches(&x->data[idx], flags)) {
+			m->idx[m->count++] = idx;
+			flags &= ~x->data[idx].val;
+		}
+	}
+
+	m->rest = flags;
+}
+
 /*
- * Interpret `xlat' as an array of flags.
- * Print to static string the entries whose bits are on in `flags'
- * Return static string.  If 0 is provided as flags, and there is no flag that
- * has the value of 0 (it should be the first in xlat table), return NULL.
- *
- * Expected output:
- * +------------+------------+---------+------------+
- * | flags != 0 | xlat found | style   | output     |
- * +------------+------------+---------+------------+
- * | false      | (any)      | raw     | <none>     |
- * | true       | (any)      | raw     | VAL        |
- * +------------+------------+---------+------------+
- * | false      | false      | abbrev  | <none>     |
- * | true       | false      | abbrev  | VAL        |
- * | (any)      | true       | abbrev  | XLAT       |
- * +------------+------------+---------+------------+
- * | false      | false      | verbose | <none>     |
- * | true       | false      | verbose | VAL        |
- * | (any)      | true       | verbose | VAL (XLAT) |
- * +------------+------------+---------+------------+
+ * Only the entries of single bits that are set in flags and the entries
+ * of several bits can match, so only they are checked, in table order.
  */
-const char *
-sprintflags_ex(const char *prefix, const struct xlat *xlat, uint64_t flags,
-	       char sep, enum xlat_style style)
+static void
+match_flags_mapped(const struct xlat *const x, uint64_t flags,
+		   struct flags_match *const m)
 {
-	static char outstr[1024];
-	char *outptr;
-	int found = 0;
+	const struct xlat_flags_map *const map = get_xlat_flags_map(x);
+	uint32_t bit_idx[64];
+	unsigned int nbits = 0;
+	uint64_t bits = flags;
 
-	outptr = stpcpy(outstr, prefix);
-	style = get_xlat_style(style);
+	for (unsigned int bit = 0; bits; ++bit, bits >>= 1) {
+		if (!(bits & 1) || !map->bit_entry[bit])
+			continue;
+
+		const uint32_t idx = map->bit_entry[bit] - 1;
+		unsigned int j = nbits++;
+
+		for (; j && bit_idx[j - 1] > idx; --j)
+			bit_idx[j] = bit_idx[j - 1];
+		bit_idx[j] = idx;
+	}
+
+	m->count = 0;
+
+	for (unsigned int i = 0, k = 0;
+	     flags && (i < nbits || k < map->multibit_count); ) {
+		const uint32_t idx =
+			k < map->multibit_count &&
+			(i == nbits || map->multibit[k] < bit_idx[i])
+			? map->multibit[k++] : bit_idx[i++];
+
+		if (flags_entry_matches(&x->data[idx], flags)) {
+			m->idx[m->count++] = idx;
+			flags &= ~x->data[idx].val;
+		}
+	}
+
+	m->rest = flags;
+}
+
+/*
+ * Finds the entries of xlat matching non-zero flags the same way
+ * the linear search in the table order does: an entry matches if all its
+ * bits are set and not matched by the previous entries.  The result is
+ * either stored in buf or taken from the cache of recent decompositions.
+ */
+static const struct flags_match *
+match_flags(const struct xlat *const x, const uint64_t flags,
+	    struct flags_match *const buf)
+{
+	if (!x->index) {
+		match_flags_linear(x, flags, buf);
+		return buf;
+	}
+
+	struct flags_cache_entry *const ce =
+		&flags_cache[flags_cache_hash(x, flags)];
+
+	if (ce->xlat != x || ce->flags != flags) {
+		match_flags_mapped(x, flags, &ce->match);
+		ce->xlat = x;
+		ce->flags = flags;
+	}
+
+	return &ce->match;
+}
+
+static char sprintflags_outstr[1024];
+
+/*
+ * Prints the flags to sprintflags_outstr starting at outptr.
+ * Returns the end of the output, or NULL if there is nothing to print.
+ */
+static char *
+sprintflags_body(char *outptr, const struct xlat *xlat, uint64_t flags,
+		 char sep, const enum xlat_style style)
+{
+	int found = 0;
 
 	if (xlat_verbose(style) == XLAT_STYLE_RAW) {
 		if (!flags || ((style & SPFF_AUXSTR_MODE) && !sep))
@@ -313,10 +537,10 @@ sprintflags_ex(const char *prefix, const struct xlat *xlat, uint64_t flags,
 
 		if (sep)
 			*outptr++ = sep;
-		outptr = xappendstr(outstr, outptr, "%s",
+		outptr = xappendstr(sprintflags_outstr, outptr, "%s",
 				    sprint_xlat_val(flags, style));
 
-		return outstr;
+		return outptr;
 	}
 
 	if (flags == 0 && xlat->data->val == 0 && xlat->data->str) {
@@ -324,13 +548,13 @@ sprintflags_ex(const char *prefix, const struct xlat *xlat, uint64_t flags,
 			*outptr++ = sep;
 		if (xlat_verbose(style) == XLAT_STYLE_VERBOSE &&
 		    !(style & SPFF_AUXSTR_MODE)) {
-			outptr = xappendstr(outstr, outptr, "0 /* %s */",
-					    xlat->data->str);
+			outptr = xappendstr(sprintflags_outstr, outptr,
+					    "0 /* %s */", xlat->data->str);
 		} else {
-			strcpy(outptr, xlat->data->str);
+			outptr = stpcpy(outptr, xlat->data->str);
 		}
 
-		return outstr;
+		return outptr;
 	}
 
 	if (xlat_verbose(style) == XLAT_STYLE_VERBOSE && flags &&
@@ -339,13 +563,16 @@ sprintflags_ex(const char *prefix, const struct xlat *xlat, uint64_t flags,
 			*outptr++ = sep;
 			sep = '\0';
 		}
-		outptr = xappendstr(outstr, outptr, "%s",
+		outptr = xappendstr(sprintflags_outstr, outptr, "%s",
 				    sprint_xlat_val(flags, style));
 	}
 
-	for (size_t idx = 0; flags && idx < xlat->size; idx++) {
-		if (xlat->data[idx].val && xlat->data[idx].str
-		    && (flags & xlat->data[idx].val) == xlat->data[idx].val) {
+	if (flags) {
+		struct flags_match buf;
+		const struct flags_match *const m =
+			match_flags(xlat, flags, &buf);
+
+		for (unsigned int i = 0; i < m->count; ++i) {
 			if (sep) {
 				*outptr++ = sep;
 			} else if (xlat_verbose(style) == XLAT_STYLE_VERBOSE &&
@@ -353,11 +580,11 @@ sprintflags_ex(const char *prefix, const struct xlat *xlat, uint64_t flags,
 				outptr = stpcpy(outptr, " /* ");
 			}
 
-			outptr = stpcpy(outptr, xlat->data[idx].str);
+			outptr = stpcpy(outptr, xlat->data[m->idx[i]].str);
 			found = 1;
 			sep = '|';
-			flags &= ~xlat->data[idx].val;
 		}
+		flags = m->rest;
 	}
 
 	if (flags) {
@@ -365,7 +592,7 @@ sprintflags_ex(const char *prefix, const struct xlat *xlat, uint64_t flags,
 			*outptr++ = sep;
 		if (found || (xlat_verbose(style) != XLAT_STYLE_VERBOSE &&
 			      (!(style & SPFF_AUXSTR_MODE) || sep)))
-			outptr = xappendstr(outstr, outptr, "%s",
+			outptr = xappendstr(sprintflags_outstr, outptr, "%s",
 					    sprint_xlat_val(flags, style));
 	} else {
 		if (!found)
@@ -376,7 +603,68 @@ sprintflags_ex(const char *prefix, const struct xlat *xlat, uint64_t flags,
 	    !(style & SPFF_AUXSTR_MODE))
 		outptr = stpcpy(outptr, " */");
 
-	return outptr != outstr ? outstr : NULL;
+	return outptr;
+}
+
+/*
+ * Interpret `xlat' as an array of flags.
+ * Print to static string the entries whose bits are on in `flags'
+ * Return static string.  If 0 is provided as flags, and there is no flag that
+ * has the value of 0 (it should be the first in xlat table), return NULL.
+ *
+ * Expected output:
+ * +------------+------------+---------+------------+
+ * | flags != 0 | xlat found | style   | output     |
+ * +------------+------------+---------+------------+
+ * | false      | (any)      | raw     | <none>     |
+ * | true       | (any)      | raw     | VAL        |
+ * +------------+------------+---------+------------+
+ * | false      | false      | abbrev  | <none>     |
+ * | true       | false      | abbrev  | VAL        |
+ * | (any)      | true       | abbrev  | XLAT       |
+ * +------------+------------+---------+------------+
+ * | false      | false      | verbose | <none>     |
+ * | true       | false      | verbose | VAL        |
+ * | (any)      | true       | verbose | VAL (XLAT) |
+ * +------------+------------+---------+------------+
+ */
+const char *
+sprintflags_ex(const char *prefix, const struct xlat *xlat, uint64_t flags,
+	       char sep, enum xlat_style style)
+{
+	char *const outptr = stpcpy(sprintflags_outstr, prefix);
+	char *end;
+
+	style = get_xlat_style(style);
+
+	/* Only the tables with an index are known to be constant.  */
+	if (!xlat->index) {
+		end = sprintflags_body(outptr, xlat, flags, sep, style);
+	} else {
+		struct sprintflags_cache_entry *const ce =
+			&sprintflags_cache[flags_cache_hash(xlat, flags)];
+
+		if (ce->xlat == xlat && ce->flags == flags &&
+		    ce->style == style && ce->sep == sep) {
+			end = ce->is_null ? NULL : stpcpy(outptr, ce->str);
+		} else {
+			end = sprintflags_body(outptr, xlat, flags, sep, style);
+
+			ce->xlat = NULL;
+			if (!end || (size_t) (end - outptr) < sizeof(ce->str)) {
+				ce->xlat = xlat;
+				ce->flags = flags;
+				ce->style = style;
+				ce->sep = sep;
+				ce->is_null = !end;
+				if (end)
+					memcpy(ce->str, outptr, end - outptr);
+				ce->str[end ? end - outptr : 0] = '\0';
+			}
+		}
+	}
+
+	return end && end != sprintflags_outstr ? sprintflags_outstr : NULL;
 }
 
 /**
@@ -430,23 +718,39 @@ printflags_ex(uint64_t flags, const char *dflt, enum xlat_style style,
 
 	va_start(args, xlat);
 	for (; xlat; xlat = va_arg(args, const struct xlat *)) {
-		for (size_t idx = 0; (flags || !n) && idx < xlat->size; ++idx) {
-			uint64_t v = xlat->data[idx].val;
-			if (xlat->data[idx].str
-			    && ((flags == v) || (v && (flags & v) == v))) {
-				if (xlat_verbose(style) == XLAT_STYLE_VERBOSE
-				    && !flags)
-					PRINT_VAL_U(0);
-				if (n++)
-					tprints("|");
-				else if (need_comment)
-					tprint_comment_begin();
-				tprints(xlat->data[idx].str);
-				flags &= ~v;
-			}
-			if (!flags)
+		if (!flags) {
+			if (n)
 				break;
+
+			/* Look for the entry of value 0.  */
+			for (size_t idx = 0; idx < xlat->size; ++idx) {
+				if (xlat->data[idx].str
+				    && !xlat->data[idx].val) {
+					if (xlat_verbose(style)
+					    == XLAT_STYLE_VERBOSE)
+						PRINT_VAL_U(0);
+					if (need_comment)
+						tprint_comment_begin();
+					tprints(xlat->data[idx].str);
+					n++;
+					break;
+				}
+			}
+			continue;
+		}
+
+		struct flags_match buf;
+		const struct flags_match *const m =
+			match_flags(xlat, flags, &buf);
+
+		for (unsigned int i = 0; i < m->count; ++i) {
+			if (n++)
+				tprints("|");
+			else if (need_comment)
+				tprint_comment_begin();
+			tprints(xlat->data[m->idx[i]].str);
 		}
+		flags = m->rest;
 	}
 	va_end(args);
 
@@ -53,12 +53,26 @@ struct xlat_data {
 	const char *str;
 };
 
+struct xlat_flags_map;
+
+/*
+ * A copy of the data of an XT_NORMAL xlat sorted by value, with only
+ * the first entry kept for every value, built on the first lookup,
+ * and the map of bits to entries built on the first flags decoding.
+ */
+struct xlat_index {
+	const struct xlat_data *data;
+	uint32_t size;
+	struct xlat_flags_map *flags_map;
+};
+
 struct xlat {
 	const struct xlat_data *data;
 	size_t flags_strsz;
 	uint32_t size;
 	enum xlat_type type;
 	uint64_t flags_mask;
+	struct xlat_index *index;	/* XT_NORMAL only, may be NULL */
 };
 
 # define XLAT(val)			{ (unsigned)(val), #val }
@@ -9,6 +9,10 @@
 
 export LC_ALL=C
 
+# The minimal number of entries in an XT_NORMAL xlat for which
+# a sorted index is used for lookups instead of the linear search.
+xlat_index_min_size=8
+
 usage()
 {
 	cat <<EOF
@@ -354,6 +358,13 @@ gen_header()
 		echo "st_CHECK_ENUMS_${name}" >&3
 	) >> "${output_m4}"
 
+	local index=
+	if [ XT_NORMAL = "$xlat_type" ] &&
+	   [ "$xlat_flag_cnt" -ge "$xlat_index_min_size" ]; then
+		index=1
+		echo "static struct xlat_index ${name}_index;"
+	fi
+
 	if [ -n "$in_defs" ]; then
 		:
 	elif [ -n "$in_mpers" ]; then
@@ -374,6 +385,8 @@ gen_header()
 			 .size = ARRAY_SIZE(${name}_xdata),
 			 .type = ${xlat_type},
 	EOF
+	[ -z "$index" ] ||
+		echo " .index = &${name}_index,"
 
 	echo " .flags_mask = 0"
 	for i in $(seq 0 "$((xlat_flag_cnt - 1))"); do
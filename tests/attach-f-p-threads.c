@@ -0,0 +1,103 @@
+/*
+ * This file is part of attach-f-p-threads strace test.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define N 32
+
+static const char text_parent[] = "attach-f-p-threads.test parent";
+static const char text_chain[] = "attach-f-p-threads.test chain %u";
+static pthread_attr_t attr;
+static int done_pipe[2];
+static volatile int stop;
+
+/*
+ * Every thread of a chain creates the next thread of the chain and exits,
+ * so new threads keep appearing while the tracer attaches, and if one
+ * of them is missed, the rest of the chain is not traced either.
+ */
+static void *
+thread(void *a)
+{
+	const unsigned int no = (long) a;
+	char name[sizeof(text_chain) + sizeof(int) * 3];
+
+	if (!stop) {
+		pthread_t t;
+
+		errno = pthread_create(&t, &attr, thread, a);
+		if (errno)
+			perror_msg_and_fail("pthread_create");
+		return NULL;
+	}
+
+	snprintf(name, sizeof(name), text_chain, no);
+	assert(chdir(name) == -1);
+	if (write(done_pipe[1], "", 1) != 1)
+		perror_msg_and_fail("write");
+
+	return NULL;
+}
+
+int
+main(int ac, char **av)
+{
+	if (ac != 2)
+		error_msg_and_fail("usage: attach-f-p-threads file");
+
+	if (pipe(done_pipe))
+		perror_msg_and_fail("pipe");
+
+	errno = pthread_attr_init(&attr);
+	if (errno)
+		perror_msg_and_fail("pthread_attr_init");
+	errno = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (errno)
+		perror_msg_and_fail("pthread_attr_setdetachstate");
+
+	for (unsigned int i = 0; i < N; ++i) {
+		pthread_t t;
+
+		errno = pthread_create(&t, &attr, thread, (void *) (long) i);
+		if (errno)
+			perror_msg_and_fail("pthread_create");
+	}
+
+	if (write(1, "\n", 1) != 1)
+		perror_msg_and_fail("write");
+
+	/* wait for the command run by the tracer to write to the file */
+	for (;;) {
+		struct stat st;
+
+		if (stat(av[1], &st))
+			perror_msg_and_fail("stat: %s", av[1]);
+		if (st.st_size)
+			break;
+	}
+
+	stop = 1;
+
+	for (unsigned int i = 0; i < N; ++i) {
+		char c;
+
+		if (read(done_pipe[0], &c, 1) != 1)
+			perror_msg_and_fail("read");
+	}
+
+	assert(chdir(text_parent) == -1);
+
+	return 0;
+}
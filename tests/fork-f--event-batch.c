@@ -0,0 +1 @@
+#include "fork-f.c"
@@ -0,0 +1,121 @@
+/*
+ * Fork children under -f and print the tracer CPU time spent per fork.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include "xmalloc.h"
+#include <ctype.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define BATCH 64
+
+static volatile bool stop = false;
+
+static void
+handler(int signo)
+{
+	stop = true;
+}
+
+static int
+get_tracer_pid(void)
+{
+	static const char status[] = "/proc/self/status";
+	FILE *fp = fopen(status, "r");
+	if (!fp)
+		perror_msg_and_fail("fopen: %s", status);
+
+	static const char prefix[] = "TracerPid:";
+	const size_t prefix_len = sizeof(prefix) - 1;
+	int pid = 0;
+	char *line = NULL;
+	size_t n = 0;
+
+	while (getline(&line, &n, fp) > 0) {
+		if (strncmp(line, prefix, prefix_len) == 0) {
+			pid = atoi(line + prefix_len);
+			break;
+		}
+	}
+	free(line);
+	fclose(fp);
+
+	return pid;
+}
+
+/* Returns the user and system CPU time of pid in clock ticks.  */
+static unsigned long long
+get_cpu_ticks(int pid)
+{
+	char *stat = xasprintf("/proc/%d/stat", pid);
+	FILE *fp = fopen(stat, "r");
+	if (!fp)
+		perror_msg_and_fail("fopen: %s", stat);
+	char buf[4096];
+	if (!fgets(buf, sizeof(buf), fp))
+		perror_msg_and_fail("fgets: %s", stat);
+
+	fclose(fp);
+
+	const char *p = strrchr(buf, ')');
+	if (!p)
+		error_msg_and_fail("%s: parenthesis not found", stat);
+	++p;
+
+	unsigned long long utime, stime;
+	if (sscanf(p, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+		   &utime, &stime) != 2)
+		error_msg_and_fail("%s: sscanf failed", stat);
+
+	free(stat);
+	return utime + stime;
+}
+
+int
+main(void)
+{
+	const int tracer_pid = get_tracer_pid();
+	if (!tracer_pid)
+		error_msg_and_skip("not traced");
+
+	const long ticks_per_sec = sysconf(_SC_CLK_TCK);
+	if (ticks_per_sec <= 0)
+		perror_msg_and_skip("sysconf(_SC_CLK_TCK)");
+
+	const unsigned long long start = get_cpu_ticks(tracer_pid);
+	unsigned int i;
+
+	signal(SIGALRM, handler);
+	alarm(3);
+
+	for (i = 0; !stop; i += BATCH) {
+		for (unsigned int j = 0; j < BATCH; ++j) {
+			pid_t pid = fork();
+			if (pid < 0)
+				perror_msg_and_fail("fork");
+			if (!pid)
+				_exit(0);
+		}
+		for (unsigned int j = 0; j < BATCH; ++j) {
+			if (wait(NULL) < 0)
+				perror_msg_and_fail("wait");
+		}
+	}
+
+	const unsigned long long ticks = get_cpu_ticks(tracer_pid) - start;
+
+	/* The number of forks and the tracer CPU time per fork in ns.  */
+	printf("%u %llu\n", i, ticks * 1000000000ULL / ticks_per_sec / i);
+	return 0;
+}
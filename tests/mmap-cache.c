@@ -0,0 +1,113 @@
+/*
+ * Change memory mappings in all the ways the mmap cache of strace
+ * reproduces without re-reading /proc/pid/maps.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static int
+create_file(const char *const fname, const size_t size)
+{
+	const int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+	if (fd < 0)
+		perror_msg_and_fail("open: %s", fname);
+	if (ftruncate(fd, size))
+		perror_msg_and_fail("ftruncate: %s", fname);
+
+	return fd;
+}
+
+static void
+map_fixed(char *const addr, const size_t len, const int prot,
+	  const int flags, const int fd, const off_t offset)
+{
+	if (mmap(addr, len, prot, flags | MAP_FIXED, fd, offset) != addr)
+		perror_msg_and_fail("mmap: %p", addr);
+}
+
+static void
+remap_fixed(char *const old_addr, const size_t old_len, const size_t new_len,
+	    char *const new_addr)
+{
+	if (mremap(old_addr, old_len, new_len, MREMAP_MAYMOVE | MREMAP_FIXED,
+		   new_addr) != new_addr)
+		perror_msg_and_fail("mremap: %p", old_addr);
+}
+
+int
+main(void)
+{
+	const size_t page = get_page_size();
+	const int fd = create_file("mmap-cache.data", 16 * page);
+
+	/* A reserved range to map into at known addresses.  */
+	char *const area = mmap(NULL, 32 * page, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		perror_msg_and_fail("mmap");
+
+	/* A private file mapping.  */
+	map_fixed(area, 8 * page, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	/* A MAP_FIXED overwrite of its middle with another part of the file.  */
+	map_fixed(area + 2 * page, 2 * page, PROT_READ | PROT_EXEC,
+		  MAP_PRIVATE, fd, 10 * page);
+
+	/* A shared file mapping right after it.  */
+	map_fixed(area + 8 * page, 4 * page, PROT_READ | PROT_WRITE,
+		  MAP_SHARED, fd, 8 * page);
+
+	/* Partial munmaps at the start and in the middle of a mapping.  */
+	if (munmap(area, page) || munmap(area + 5 * page, page))
+		perror_msg_and_fail("munmap");
+
+	/* An mprotect that splits a mapping in three, and one that joins it.  */
+	if (mprotect(area + 9 * page, page, PROT_READ))
+		perror_msg_and_fail("mprotect");
+	if (mprotect(area + 9 * page, page, PROT_READ | PROT_WRITE))
+		perror_msg_and_fail("mprotect");
+
+	/* An mremap that moves a part of a mapping.  */
+	remap_fixed(area + 7 * page, page, page, area + 20 * page);
+
+	/* An mremap that moves a mapping and grows it.  */
+	remap_fixed(area + 20 * page, page, 2 * page, area + 24 * page);
+
+	/* mremaps that shrink a mapping and grow it back in place.  */
+	if (mremap(area + 8 * page, 4 * page, 2 * page, 0) != area + 8 * page)
+		perror_msg_and_fail("mremap");
+	if (mremap(area + 8 * page, 2 * page, 3 * page, 0) != area + 8 * page)
+		perror_msg_and_fail("mremap");
+
+	/* An anonymous mapping over a part of a file mapping.  */
+	map_fixed(area + 2 * page, page, PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	/*
+	 * A mapping of a deleted file; the file is not mapped before,
+	 * as its existing mappings would change their names.
+	 */
+	const int deleted_fd = create_file("mmap-cache.deleted", page);
+	if (unlink("mmap-cache.deleted"))
+		perror_msg_and_fail("unlink");
+	map_fixed(area + 28 * page, page, PROT_READ, MAP_PRIVATE,
+		  deleted_fd, 0);
+	close(deleted_fd);
+	close(fd);
+
+	/* The heap grows, shrinks, and goes away.  */
+	char *const brk0 = sbrk(0);
+	if (brk(brk0 + 3 * page) || brk(brk0 + page) || brk(brk0))
+		perror_msg_and_fail("brk");
+
+	return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Check that ip:port pairs associated with socket descriptors
+ * are updated when the socket is connected again.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static unsigned int
+bind_loopback(const int fd)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+	socklen_t len = sizeof(addr);
+
+	if (bind(fd, (struct sockaddr *) &addr, len))
+		perror_msg_and_skip("bind");
+	if (getsockname(fd, (struct sockaddr *) &addr, &len))
+		perror_msg_and_fail("getsockname");
+
+	return ntohs(addr.sin_port);
+}
+
+static void
+connect_loopback(const int fd, const unsigned int local_port,
+		 const unsigned int port, const unsigned int prev_port)
+{
+	const struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+
+	if (connect(fd, (const struct sockaddr *) &addr, sizeof(addr)))
+		perror_msg_and_fail("connect");
+
+	printf("connect(%d<UDP:[127.0.0.1:%u", fd, local_port);
+	if (prev_port)
+		printf("->127.0.0.1:%u", prev_port);
+	printf("]>, {sa_family=AF_INET, sin_port=htons(%u)"
+	       ", sin_addr=inet_addr(\"127.0.0.1\")}, %u) = 0\n",
+	       port, (unsigned int) sizeof(addr));
+}
+
+static void
+print_peer(const int fd, const unsigned int local_port,
+	   const unsigned int port)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+
+	if (getpeername(fd, (struct sockaddr *) &addr, &len))
+		perror_msg_and_fail("getpeername");
+	printf("getpeername(%d<UDP:[127.0.0.1:%u->127.0.0.1:%u]>"
+	       ", {sa_family=AF_INET, sin_port=htons(%u)"
+	       ", sin_addr=inet_addr(\"127.0.0.1\")}, [%u]) = 0\n",
+	       fd, local_port, port, port, (unsigned int) len);
+}
+
+int
+main(void)
+{
+	skip_if_unavailable("/proc/self/fd/");
+
+	const int fd_a = socket(AF_INET, SOCK_DGRAM, 0);
+	const int fd_b = socket(AF_INET, SOCK_DGRAM, 0);
+	const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd_a < 0 || fd_b < 0 || fd < 0)
+		perror_msg_and_skip("socket");
+
+	const unsigned int port_a = bind_loopback(fd_a);
+	const unsigned int port_b = bind_loopback(fd_b);
+	const unsigned int local_port = bind_loopback(fd);
+
+	/*
+	 * The details of the socket are cached when it is connected
+	 * for the first time, and have to be refreshed on reconnect.
+	 */
+	connect_loopback(fd, local_port, port_a, 0);
+	print_peer(fd, local_port, port_a);
+	connect_loopback(fd, local_port, port_b, port_a);
+	print_peer(fd, local_port, port_b);
+	connect_loopback(fd, local_port, port_a, port_b);
+	print_peer(fd, local_port, port_a);
+
+	puts("+++ exited with 0 +++");
+	return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * Make system calls across several summary intervals.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ROUNDS 5
+#define CALLS_PER_ROUND 3
+
+int
+main(void)
+{
+	const struct timespec ts = { .tv_nsec = 300000000 };
+
+	for (unsigned int i = 0; i < ROUNDS; ++i) {
+		for (unsigned int j = 0; j < CALLS_PER_ROUND; ++j) {
+			if (chdir("."))
+				perror_msg_and_fail("chdir");
+		}
+		if (nanosleep(&ts, NULL))
+			perror_msg_and_fail("nanosleep");
+	}
+
+	printf("%u\n", ROUNDS * CALLS_PER_ROUND);
+	return 0;
+}
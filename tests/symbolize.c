@@ -0,0 +1,89 @@
+/*
+ * Check symbolization of stack traces recorded with --stack-trace-ids.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void ATTRIBUTE_NOINLINE
+symbolize_me(void)
+{
+	if (getpid() < 0)
+		abort();
+}
+
+static unsigned long
+file_offset(const char *exe, unsigned long addr)
+{
+	FILE *fp = fopen("/proc/self/maps", "r");
+	if (!fp)
+		perror_msg_and_skip("fopen: %s", "/proc/self/maps");
+
+	char line[PATH_MAX + 128];
+	while (fgets(line, sizeof(line), fp)) {
+		unsigned long start, end, pgoff;
+		char path[PATH_MAX];
+
+		if (sscanf(line, "%lx-%lx %*s %lx %*s %*s %s",
+			   &start, &end, &pgoff, path) != 4)
+			continue;
+		if (addr < start || addr >= end)
+			continue;
+		if (strcmp(path, exe))
+			error_msg_and_skip("%#lx is not mapped from %s",
+					   addr, exe);
+		fclose(fp);
+		return addr - start + pgoff;
+	}
+
+	error_msg_and_skip("%#lx is not mapped", addr);
+}
+
+int
+main(int ac, char **av)
+{
+	if (ac != 2)
+		error_msg_and_fail("usage: symbolize FILE");
+
+	char exe[PATH_MAX];
+	ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (len < 0)
+		perror_msg_and_skip("readlink: %s", "/proc/self/exe");
+	exe[len] = '\0';
+
+	symbolize_me();
+	unsigned long offset =
+		file_offset(exe, (unsigned long) (void *) symbolize_me) + 1;
+
+	FILE *fp = fopen(av[1], "w");
+	if (!fp)
+		perror_msg_and_fail("fopen: %s", av[1]);
+	fprintf(fp, "# strace stack ids 1\n"
+		"M 1 - %s\n"
+		"S 1 1+%#lx 0+0x1234\n"
+		"M 2 - /nonexistent\n"
+		"S 2 2+0x10 1+%#lx\n",
+		exe, offset, offset);
+	if (fclose(fp))
+		perror_msg_and_fail("fclose: %s", av[1]);
+
+	printf("stack #1:\n"
+	       " > %s(symbolize_me+0x1) [%#lx]\n"
+	       " > ?? [0x1234]\n"
+	       "stack #2:\n"
+	       " > /nonexistent() [0x10]\n"
+	       " > %s(symbolize_me+0x1) [%#lx]\n",
+	       exe, offset, exe, offset);
+
+	return 0;
+}
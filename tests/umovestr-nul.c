@@ -0,0 +1,102 @@
+/*
+ * Check that umovestr finds the terminating NUL byte at every position
+ * within a word, stops at the end of the mapped memory, and does not
+ * read past the string length limit.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include "scno.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static void
+fill_str(char *const p, const unsigned int len)
+{
+	for (unsigned int i = 0; i < len; ++i)
+		p[i] = 'A' + i % 26;
+}
+
+static void
+test_str(const char *const p, const unsigned int len)
+{
+	const char *errstr = sprintrc(syscall(__NR_delete_module, p, 0));
+
+	if (len > DEFAULT_STRLEN)
+		printf("delete_module(\"%.*s\"..., 0) = %s\n",
+		       DEFAULT_STRLEN, p, errstr);
+	else
+		printf("delete_module(\"%.*s\", 0) = %s\n", len, p, errstr);
+}
+
+static void
+test_efault(const char *const p)
+{
+	const char *errstr = sprintrc(syscall(__NR_delete_module, p, 0));
+
+	printf("delete_module(%p, 0) = %s\n", p, errstr);
+}
+
+int
+main(void)
+{
+	const unsigned int max_len = 2 * sizeof(long);
+	char *const buf = tail_alloc(4 * sizeof(long));
+
+	/*
+	 * The terminating NUL at every position of the first two words
+	 * for every alignment of the string, followed by non-zero bytes
+	 * that look like a zero byte to a sloppy word check.
+	 */
+	for (unsigned int offset = 0; offset < sizeof(long); ++offset) {
+		for (unsigned int len = 0; len <= max_len; ++len) {
+			char *const p = buf + offset;
+
+			for (unsigned int i = 0; i < 4 * sizeof(long); ++i)
+				buf[i] = (i & 1) ? '\x80' : '\x01';
+			fill_str(p, len);
+			p[len] = '\0';
+			test_str(p, len);
+		}
+	}
+
+	/*
+	 * Strings ending right before an unmapped page,
+	 * with and without the terminating NUL.
+	 */
+	for (unsigned int size = 1; size <= max_len + 1; ++size) {
+		char *const p = tail_alloc(size);
+
+		fill_str(p, size);
+		test_efault(p);
+		p[size - 1] = '\0';
+		test_str(p, size - 1);
+	}
+
+	/*
+	 * Strings around the length limit; only the first DEFAULT_STRLEN + 1
+	 * bytes are needed to tell whether the string is truncated, even if
+	 * the string is not terminated before an unmapped page.
+	 */
+	for (unsigned int len = DEFAULT_STRLEN - 1;
+	     len <= DEFAULT_STRLEN + 2; ++len) {
+		char *const p = tail_alloc(len + 1);
+
+		fill_str(p, len);
+		p[len] = '\0';
+		test_str(p, len);
+		if (len > DEFAULT_STRLEN) {
+			p[len] = 'x';
+			test_str(p, len);
+		}
+	}
+
+	puts("+++ exited with 0 +++");
+	return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Check decoding of constants and flags from xlat tables of 8 or more
+ * entries, which are looked up using a sorted index and a map of bits:
+ * values past the first entries of the tables, unknown values and bits,
+ * zero values, and flags matched by entries of several bits.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include "scno.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+struct strval {
+	kernel_ulong_t val;
+	const char *str;
+};
+
+static void
+test_madvise(const struct strval *const advice)
+{
+	long rc = syscall(__NR_madvise, 0, 0, advice->val);
+	printf("madvise(NULL, 0, %s) = %s\n", advice->str, sprintrc(rc));
+}
+
+static void
+test_mprotect(const struct strval *const prot)
+{
+	long rc = syscall(__NR_mprotect, 0, 0, prot->val);
+	printf("mprotect(NULL, 0, %s) = %s\n", prot->str, sprintrc(rc));
+}
+
+static void
+test_statx(const struct strval *const mask)
+{
+	long rc = syscall(__NR_statx, -1, 0, 0, mask->val, 0);
+	printf("statx(-1, NULL, AT_STATX_SYNC_AS_STAT, %s, NULL) = %s\n",
+	       mask->str, sprintrc(rc));
+}
+
+int
+main(void)
+{
+	/* madvise_cmds: the values past the first 8 entries.  */
+	static const struct strval advices[] = {
+		{ 0, "MADV_NORMAL" },
+		{ 20, "MADV_COLD" },
+		{ 21, "MADV_PAGEOUT" },
+		{ 22, "MADV_POPULATE_READ" },
+		{ 100, "MADV_HWPOISON" },
+		{ 101, "MADV_SOFT_OFFLINE" },
+		{ 25, "0x19 /* MADV_??? */" },
+		{ 102, "0x66 /* MADV_??? */" },
+		{ 0xbadc0ded, "0xbadc0ded /* MADV_??? */" },
+	};
+	/* mmap_prot: the value of the first entry is 0.  */
+	static const struct strval prots[] = {
+		{ 0, "PROT_NONE" },
+		{ 0x1000002, "PROT_WRITE|PROT_GROWSDOWN" },
+		{ 0x3000007, "PROT_READ|PROT_WRITE|PROT_EXEC|PROT_GROWSDOWN"
+			     "|PROT_GROWSUP" },
+		{ 0x40005, "PROT_READ|PROT_EXEC|0x40000" },
+		{ 0x40000, "0x40000 /* PROT_??? */" },
+	};
+	/* statx_masks: the first entries have several bits.  */
+	static const struct strval masks[] = {
+		{ 0, "0" },
+		{ 0xfff, "STATX_ALL" },
+		{ 0x1fff, "STATX_ALL|STATX_MNT_ID" },
+		{ 0x17ff, "STATX_BASIC_STATS|STATX_MNT_ID" },
+		{ 0x7fe, "STATX_MODE|STATX_NLINK|STATX_UID|STATX_GID"
+			 "|STATX_ATIME|STATX_MTIME|STATX_CTIME|STATX_INO"
+			 "|STATX_SIZE|STATX_BLOCKS" },
+		{ 0x801, "STATX_TYPE|STATX_BTIME" },
+		{ 0x80001001, "STATX_TYPE|STATX_MNT_ID|0x80000000" },
+		{ 0x80000000, "0x80000000 /* STATX_??? */" },
+	};
+
+	/* The second pass gets the results of recent lookups.  */
+	for (unsigned int pass = 0; pass < 2; ++pass) {
+		for (unsigned int i = 0; i < ARRAY_SIZE(advices); ++i)
+			test_madvise(&advices[i]);
+		for (unsigned int i = 0; i < ARRAY_SIZE(prots); ++i)
+			test_mprotect(&prots[i]);
+		for (unsigned int i = 0; i < ARRAY_SIZE(masks); ++i)
+			test_statx(&masks[i]);
+	}
+
+	puts("+++ exited with 0 +++");
+	return 0;
+}